@@ -8,52 +8,227 @@
 * (http://en.wikipedia.org/wiki/Chudnovsky_algorithm) and n prime numbers (http://en.wikipedia.org/wiki/Prime_number)
 * and uses the GNU Multiple Precision Arithmetic Library for most of the computations.
 *
-* Compile using gcc : gcc -O3 -Wall -o cpubench cpubench.c -lgmp -lssl -lcrypto -fopenmp
+* This file is libcpubench, the workloads themselves. The command line tool lives in main.c.
+*
+* Compile using gcc : gcc -O3 -Wall -o cpubench cpubench.c main.c exporter.c profiler.c -lgmp -lssl -lcrypto -lm -fopenmp -lpthread -rdynamic
 *
 */
 
+#define _GNU_SOURCE
 #include <gmp.h>
+#include <math.h>
+#include <float.h>
+#include <sched.h>
+#include <dirent.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
-#include <sys/resource.h>
-#include <sys/utsname.h>
-#include <openssl/md5.h>
+#include <errno.h>
+#include <pthread.h>
+#include <malloc.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define CLC_HAVE_TSC 1
+#define CLC_HAVE_X86_SIMD 1
+#endif
+#include <openssl/ec.h>
+#include <openssl/evp.h>
+#include <openssl/rsa.h>
 #include <omp.h>
 
+#include "cpubench.h"
+
 /* You can't compile this on Windows */
 #ifdef _WIN32
 #error Sorry, you cannot compile this program on Windows because of some *nix-specific code
 #endif
 
-/* Build timestamp */
-#define build_time __TIME__
-#define build_date __DATE__
-
-/* Define color codes that we will be using */
-#define TXTNORMAL  "\x1B[0m"
-#define TXTRED     "\x1B[31m"
-#define TXTYELLOW  "\x1B[33m"
-#define TXTGREEN   "\x1B[32m"
-
-/* Variables we require */
-struct timespec start, end;
-struct timespec pstart, pend;
-unsigned long int i, ti, constant1, constant2, constant3;
-unsigned long precision;
-unsigned long long x = 0;
-unsigned long long y = 0;
-unsigned char digest[16];
-char *oput;
-int pnum = 0;
-int tpnums = 0;
-int u;
-double bits;
-mpz_t v1, v2, v3, v4, v5;
-mpf_t V1, V2, V3, total, tmp, res;
-mp_exp_t exponent;
-MD5_CTX context;
+/* How long each TSC calibration pass runs (seconds) */
+#define CLC_CALIBRATION_TIME 0.02
+
+/* Reads used to measure timer resolution and overhead */
+#define CLC_TIMER_PROBES 10000
+
+/* STREAM kernels, in the order they run */
+enum
+{
+    CLC_STREAM_COPY,
+    CLC_STREAM_SCALE,
+    CLC_STREAM_ADD,
+    CLC_STREAM_TRIAD,
+    CLC_STREAM_READ,
+    CLC_STREAM_WRITE,
+    CLC_STREAM_KERNELS
+};
+
+/* Dependent loads timed per working set size */
+#define CLC_CHASE_LOADS (1ULL << 21)
+
+/* Most working set sizes the latency probe measures, two per doubling */
+#define CLC_MAX_SIZES 96
+
+/* Latency rise over a plateau that marks the end of a cache level, and the rise per step
+ * that still counts as climbing towards the next one */
+#define CLC_LEVEL_STEP 1.8
+#define CLC_LEVEL_CLIMB 1.1
+
+/* Injection delays of the loaded latency curve, in ns between 4 KB blocks of every load
+ * thread. Negative means no load at all */
+static const long clc_injection_delays[] = { -1, 25600, 12800, 6400, 3200, 1600, 800, 400, 200, 100, 0 };
+#define CLC_INJECTION_POINTS ((int)(sizeof(clc_injection_delays) / sizeof(clc_injection_delays[0])))
+
+/* GEMM cache blocking: kc x nr panels of B stay in L1, mc x kc blocks of A in L2 and the
+ * kc x nc slab of B in L3 */
+#define CLC_GEMM_MC 96
+#define CLC_GEMM_KC 256
+#define CLC_GEMM_NC 3072
+
+/* Largest micro-kernel tile */
+#define CLC_GEMM_MAX_MR 6
+#define CLC_GEMM_MAX_NR 32
+
+/* HPL's bound on the scaled residual of a correct solve */
+#define CLC_HPL_THRESHOLD 16.0
+
+/* Panel width below which the LU panel is factored column by column */
+#define CLC_HPL_PANEL_MIN 16
+
+/* Rows per partial sum of the CG dot products. Fixed, so the sums don't depend on the thread count */
+#define CLC_CG_CHUNK 4096
+
+/* Longest FFT row done in one piece, so a row and its Stockham scratch stay in L2. Longer 1D
+ * transforms go through the six-step algorithm on rows of at most this length */
+#define CLC_FFT_DIRECT (1UL << 14)
+
+/* Tile edge of the FFT transposes */
+#define CLC_FFT_TILE 32
+
+/* Transforms up to this size are checked bin by bin against a direct DFT, larger ones at
+ * CLC_FFT_CHECK_BINS sampled bins */
+#define CLC_FFT_CHECK_ALL 4096
+#define CLC_FFT_CHECK_BINS 16
+
+/* Largest error of a checked bin, relative to the largest reference bin */
+#define CLC_FFT_TOLERANCE 1E-10
+
+/* Spatial blocks of the stencil: rows per block, and points per row segment */
+#define CLC_STENCIL_BY 16
+#define CLC_STENCIL_BX 256
+
+/* Tallest SELL-C-sigma chunk */
+#define CLC_SELL_MAX_C 32
+
+/* Colours of the 27-point grid: neighbours always differ in the parity of some coordinate */
+#define CLC_CG_COLOURS 8
+
+/* FMA pipes per core assumed for the theoretical peak */
+#define CLC_FMA_PIPES 2
+
+/* Loops left to the vectorizer get AVX-512 and AVX2 clones, picked by CPU features when the
+ * program loads */
+#ifdef CLC_HAVE_X86_SIMD
+#define CLC_SIMD_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define CLC_SIMD_CLONES
+#endif
+
+/* Size of a transparent or hugetlbfs huge page */
+#define CLC_HUGE_PAGE (2UL << 20)
+
+/* Stack every worker touches up front in isolation mode */
+#define CLC_STACK_PREFAULT (256 * 1024)
+
+/* Clock sources, best first */
+enum
+{
+    CLC_TIMER_RDTSCP,
+    CLC_TIMER_RDTSC,
+    CLC_TIMER_CLOCK
+};
+
+/* Memory policy modes of set_mempolicy(2) and mbind(2), we don't depend on libnuma */
+#define CLC_MPOL_DEFAULT     0
+#define CLC_MPOL_BIND        2
+#define CLC_MPOL_INTERLEAVE  3
+#define CLC_MPOL_LOCAL       4
+#define CLC_MPOL_MF_MOVE     (1 << 1)
+
+/* Benchmark context */
+struct cpubench_ctx
+{
+    cpubench_result_cb result_cb;
+    void *result_user;
+
+    /* Progress reporting, rate limited to one call per interval */
+    cpubench_progress_cb progress_cb;
+    void *progress_user;
+    double progress_interval;
+    double progress_last;
+    int progress_busy;
+
+    /* Threads used when params->threads is 0, sized to the cgroup quota */
+    int default_threads;
+
+    /* Affinity of the creating thread, restored after pinned runs */
+    cpu_set_t affinity;
+
+    /* CPUBENCH_ISOLATE_* measures in effect */
+    unsigned int isolation;
+
+    /* Pre-faulted scratch memory handed out to workloads */
+    void *scratch;
+    size_t scratch_size;
+
+    /* 426880 * sqrt(10005), cached for the precision it was computed at */
+    mpf_t pi_const;
+    unsigned long pi_const_prec;
+};
+
+/* Process-wide timer state, the TSC is a property of the machine rather than of a context */
+static struct
+{
+    int source;
+    double seconds_per_tick;
+    double tsc_hz;
+    double resolution_ns;
+    double overhead_ns;
+} clc_timer;
+static pthread_once_t clc_timer_once = PTHREAD_ONCE_INIT;
+
+/* Workload names, indexed by cpubench_workload */
+static const char *const workload_names[CPUBENCH_WORKLOAD_COUNT] =
+{
+    "pi",
+    "primes",
+    "stream",
+    "latency",
+    "loaded_latency",
+    "gemm",
+    "hpl",
+    "hpcg",
+    "fft",
+    "stencil",
+    "spmv",
+    "hash",
+    "aead",
+    "pkey",
+    "gmp",
+    "bigmul"
+};
+
+/* Names of the CPUBENCH_ISOLATE_* bits, lowest first */
+static const char *const isolation_names[] =
+{
+    "prefault",
+    "mlock",
+    "fifo"
+};
 
 /* Calculate log to the base 2 using GCC's bit scan reverse intrinsic */
 static __inline__ unsigned int clc_log2(const unsigned int num)
@@ -61,250 +236,6441 @@ static __inline__ unsigned int clc_log2(const unsigned int num)
     return ((num <= 1) ? 0 : 32 - (__builtin_clz(num - 1)));
 }
 
-/* Calculate MD5 checksum for verification */
-static __inline__ char *clc_md5(const char *string)
+/* Nanoseconds on the raw monotonic clock */
+static __inline__ unsigned long long clc_clock_ns(void)
 {
+    struct timespec ts;
 
-    /* Allocate memory to store checksum */
-    char *checksum = (char*)malloc(33);
-    /* Initialize MD5 context */
-    MD5_Init(&context);
-    /* Compute MD5 hash */
-    MD5_Update(&context, string, strlen(string));
-    /* Store MD5 hash */
-    MD5_Final(digest, &context);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
 
-    /* Format digest */
-    for (u = 0; u < 16; ++u)
+/* Read the selected clock */
+static __inline__ unsigned long long clc_ticks(int source)
+{
+#ifdef CLC_HAVE_TSC
+    unsigned int aux;
+
+    /* rdtscp waits for earlier instructions, plain rdtsc needs a fence to do the same */
+    if (source == CLC_TIMER_RDTSCP)
     {
-        snprintf(&(checksum[u*2]), 3, "%02x", (unsigned int)digest[u]);
+        return __rdtscp(&aux);
     }
+    if (source == CLC_TIMER_RDTSC)
+    {
+        _mm_lfence();
+        return __rdtsc();
+    }
+#endif
+    (void)source;
+    return clc_clock_ns();
+}
 
-    /* Return checksum */
-    return checksum;
+#ifdef CLC_HAVE_TSC
+/* TSC frequency from one pass against the monotonic clock */
+static double clc_calibrate_tsc(int source)
+{
+    unsigned long long t0 = clc_clock_ns();
+    unsigned long long c0 = clc_ticks(source);
+    unsigned long long t1, c1;
+
+    do
+    {
+        t1 = clc_clock_ns();
+        c1 = clc_ticks(source);
+    } while ((t1 - t0) < (unsigned long long)(CLC_CALIBRATION_TIME * 1E9));
+    return (double)(c1 - c0) / ((double)(t1 - t0) / 1E9);
 }
 
-/* Calculate prime numbers */
-static __inline__ int clc_prime(unsigned long long max)
+/* Whether the kernel still trusts the TSC; it drops it from the list once marked unstable */
+static int clc_kernel_trusts_tsc(void)
 {
-    /* Get high-res time */
-    clock_gettime(CLOCK_MONOTONIC_RAW, &pstart);
+    char buf[256];
+    FILE *file = fopen("/sys/devices/system/clocksource/clocksource0/available_clocksource", "r");
+
+    if (file == NULL)
+    {
+        return 1;
+    }
+    int ok = (fgets(buf, sizeof(buf), file) != NULL && strstr(buf, "tsc") != NULL);
+    fclose(file);
+    return ok;
+}
+#endif
 
-    #pragma omp parallel for shared (max) private (x, y, pnum) reduction (+:tpnums)
+/* Pick and calibrate the clock, then measure its resolution and overhead */
+static void clc_timer_init(void)
+{
+    unsigned long long prev, now, begin, min_step = ~0ULL;
+    int k;
 
-    /* Start computing primes */
-    for (x = 2; x <= max; x++)
+    clc_timer.source = CLC_TIMER_CLOCK;
+    clc_timer.seconds_per_tick = 1E-9;
+
+#ifdef CLC_HAVE_TSC
+    unsigned int eax, ebx, ecx, edx;
+    int invariant = 0, rdtscp = 0;
+
+    /* Invariant TSC ticks at a constant rate through frequency and power state changes */
+    if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+    {
+        invariant = (edx >> 8) & 1;
+    }
+    if (__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx))
     {
-        pnum = 1;
+        rdtscp = (edx >> 27) & 1;
+    }
+    if (invariant && clc_kernel_trusts_tsc())
+    {
+        int source = rdtscp ? CLC_TIMER_RDTSCP : CLC_TIMER_RDTSC;
+        double hz1 = clc_calibrate_tsc(source);
+        double hz2 = clc_calibrate_tsc(source);
 
-        for (y = 2; y < x; y++)
+        /* Two passes that disagree mean something (a VM, a migration) is skewing the TSC */
+        if (hz1 > 0 && fabs(hz1 - hz2) / hz1 < 0.001)
         {
-            if (x % y == 0)
-            {
-                pnum = 0;
-                break;
-            }
+            clc_timer.source = source;
+            clc_timer.tsc_hz = (hz1 + hz2) / 2;
+            clc_timer.seconds_per_tick = 1 / clc_timer.tsc_hz;
         }
-        tpnums = tpnums + pnum;
     }
+#endif
 
-    /* Get high-res time */
-    clock_gettime(CLOCK_MONOTONIC_RAW, &pend);
-
-    /* Calculate and print time taken */
-    double ptime_taken = (double)(pend.tv_sec - pstart.tv_sec) + (double)(pend.tv_nsec - pstart.tv_nsec) / 1E9;
-    printf("Done!\n\nTime taken (seconds): %lf\n", ptime_taken);
+    /* Resolution is the smallest non-zero step, overhead the mean cost of one read */
+    begin = prev = clc_ticks(clc_timer.source);
+    for (k = 0; k < CLC_TIMER_PROBES; k++)
+    {
+        now = clc_ticks(clc_timer.source);
+        if (now > prev && now - prev < min_step)
+        {
+            min_step = now - prev;
+        }
+        prev = now;
+    }
+    clc_timer.overhead_ns = (double)(prev - begin) * clc_timer.seconds_per_tick * 1E9 / CLC_TIMER_PROBES;
+    clc_timer.resolution_ns = (min_step == ~0ULL) ? NAN : (double)min_step * clc_timer.seconds_per_tick * 1E9;
+}
 
-    /* Return total primes */
-    return tpnums;
+/* Current timestamp in ticks */
+unsigned long long cpubench_timer_now(void)
+{
+    pthread_once(&clc_timer_once, clc_timer_init);
+    return clc_ticks(clc_timer.source);
 }
 
-/* Calculate pi digits main function */
-static __inline__ char *clc_pi(unsigned long dgts)
+/* Convert a tick difference to seconds */
+double cpubench_timer_seconds(unsigned long long ticks)
 {
-    /* Compute required iterations */
-    unsigned long iters = (dgts / 15) + 1;
+    pthread_once(&clc_timer_once, clc_timer_init);
+    return (double)ticks * clc_timer.seconds_per_tick;
+}
 
-    /* Initialize variables */
-    constant1 = 545140134;
-    constant2 = 13591409;
-    constant3 = 640320;
-    bits = clc_log2(10);
-    precision = (dgts * bits) + 1;
-    mpf_set_default_prec(precision);
-    mpz_inits(v1, v2, v3, v4, v5, NULL);
-    mpf_inits(res, tmp, V1, V2, V3, total, NULL);
-    mpf_set_ui(total, 0);
-    mpf_sqrt_ui(tmp, 10005);
-    mpf_mul_ui(tmp, tmp, 426880);
+/* Describe the clock in use */
+cpubench_status cpubench_timer_get_info(cpubench_timer_info *out)
+{
+    static const char *const names[] = { "rdtscp", "rdtsc", "clock_gettime" };
 
-    /* Get high-res time */
-    clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+    if (out == NULL)
+    {
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+    pthread_once(&clc_timer_once, clc_timer_init);
+    out->source = names[clc_timer.source];
+    out->tsc_hz = clc_timer.tsc_hz;
+    out->resolution_ns = clc_timer.resolution_ns;
+    out->overhead_ns = clc_timer.overhead_ns;
+    return CPUBENCH_OK;
+}
 
-    /* Print total iterations and start computation of digits */
-    printf("Total iterations: %lu\n\n", iters - 1);
+/* Read the first number in a sysfs file */
+static int clc_read_sysfs(const char *path, double *out)
+{
+    FILE *file = fopen(path, "r");
+    int ok;
 
-    /* Iterate and compute value using Chudnovsky Algorithm */
-    for (i = 0x0; i < iters; i++)
+    if (file == NULL)
     {
-        ti = i * 3;
-        mpz_fac_ui(v1, 6 * i);
-        mpz_set_ui(v2, constant1);
-        mpz_mul_ui(v2, v2, i);
-        mpz_add_ui(v2, v2, constant2);
-        mpz_fac_ui(v3, ti);
-        mpz_fac_ui(v4, i);
-        mpz_pow_ui(v4, v4, 3);
-        mpz_ui_pow_ui(v5, constant3, ti);
-        if ((1 & ti) == 1)
-        {
-            mpz_neg(v5, v5);
-        }
-        mpz_mul(v1, v1, v2);
-        mpf_set_z(V1, v1);
-        mpz_mul(v3, v3, v4);
-        mpz_mul(v3, v3, v5);
-        mpf_set_z(V2, v3);
-        mpf_div(V3, V1, V2);
-        mpf_add(total, total, V3);
+        return 0;
+    }
+    ok = (fscanf(file, "%lf", out) == 1);
+    fclose(file);
+    return ok;
+}
 
-        /* Print interations executed if debugging (I don't like spamming stdout unnecesarily) */
-#ifdef DEBUG
-        printf("Iteration %lu of %lu successfully executed\n", i, iters - 1);
-#endif
+/* Calculate MD5 checksum for verification */
+static __inline__ void clc_md5(const char *string, char checksum[33])
+{
+    unsigned char digest[16];
+    int u;
+
+    /* Compute MD5 hash */
+    EVP_Digest(string, strlen(string), digest, NULL, EVP_md5(), NULL);
+
+    /* Format digest */
+    for (u = 0; u < 16; ++u)
+    {
+        snprintf(&(checksum[u*2]), 3, "%02x", (unsigned int)digest[u]);
     }
+}
 
-    /* Some final computations */
-    mpf_ui_div(total, 1, total);
-    mpf_mul(total, total, tmp);
+/* Append a metric to a result */
+static cpubench_status clc_add_metric(cpubench_result *result, const char *name, const char *label, const char *unit, double value)
+{
+    cpubench_metric *metrics = realloc(result->metrics, (result->nmetrics + 1) * sizeof(*metrics));
+    if (metrics == NULL)
+    {
+        return CPUBENCH_ERR_NOMEM;
+    }
+    result->metrics = metrics;
 
-    /* Get high-res time */
-    clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+    cpubench_metric *m = &metrics[result->nmetrics++];
+    /* Overlong strings are cut to fit */
+    snprintf(m->name, sizeof(m->name), "%.*s", (int)sizeof(m->name) - 1, name);
+    snprintf(m->label, sizeof(m->label), "%.*s", (int)sizeof(m->label) - 1, label ? label : "");
+    snprintf(m->unit, sizeof(m->unit), "%.*s", (int)sizeof(m->unit) - 1, unit ? unit : "");
+    m->value = value;
+    m->lower_is_better = (strcmp(m->unit, "ns") == 0 || strcmp(m->unit, "us") == 0 || strcmp(m->unit, "cycles/B") == 0);
+    return CPUBENCH_OK;
+}
 
-    /* Calculate and print time taken */
-    double time_taken = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1E9;
-    printf("Done!\n\nTime taken (seconds): %lf\n", time_taken);
+/* Resolve the thread count requested by params */
+static __inline__ int clc_threads(const cpubench_ctx *ctx, const cpubench_params *params)
+{
+    if (params->threads > 0)
+    {
+        return params->threads;
+    }
+    int pinned = cpubench_cpumask_count(&params->cpus);
+    return (pinned > 0) ? pinned : ctx->default_threads;
+}
 
-    /* Store output */
-    oput = mpf_get_str(NULL, &exponent, 10, dgts, total);
+/* The n-th CPU of a mask, wrapping around. -1 for an empty mask */
+static int clc_nth_cpu(const cpubench_cpumask *mask, int n)
+{
+    int count = cpubench_cpumask_count(mask);
+    int cpu;
 
-    /* Free up space consumed by variables */
-    mpz_clears(v1, v2, v3, v4, v5, NULL);
-    mpf_clears(res, tmp, V1, V2, V3, total, NULL);
+    if (count == 0)
+    {
+        return -1;
+    }
+    n %= count;
+    for (cpu = 0; cpu < CPUBENCH_MAX_CPUS; cpu++)
+    {
+        if (cpubench_cpumask_isset(mask, cpu) && n-- == 0)
+        {
+            return cpu;
+        }
+    }
+    return -1;
+}
 
-    /* Return value */
-    return oput;
+/* Kernel mode number of a memory policy */
+static int clc_mpol_mode(cpubench_mem_policy policy)
+{
+    switch (policy)
+    {
+    case CPUBENCH_MEM_LOCAL:
+        return CLC_MPOL_LOCAL;
+    case CPUBENCH_MEM_BIND:
+        return CLC_MPOL_BIND;
+    case CPUBENCH_MEM_INTERLEAVE:
+        return CLC_MPOL_INTERLEAVE;
+    default:
+        return CLC_MPOL_DEFAULT;
+    }
 }
 
-/* Entry point of program */
-int main(int argc, char *argv[])
+/* Apply the memory policy of params to the calling thread. Returns 0 on success */
+static int clc_apply_mempolicy(const cpubench_params *params)
 {
+    unsigned long nodemask[2] = { (unsigned long)params->mem_nodes, 0 };
+    int mode = clc_mpol_mode(params->mem_policy);
 
-    /* Set number of threads to split the computation between when doing multithreaded bench */
-    int numthreads = omp_get_max_threads();
-    omp_set_num_threads(numthreads);
+    if (mode == CLC_MPOL_DEFAULT || mode == CLC_MPOL_LOCAL)
+    {
+        return (int)syscall(SYS_set_mempolicy, mode, NULL, 0UL);
+    }
+    return (int)syscall(SYS_set_mempolicy, mode, nodemask, (unsigned long)(sizeof(nodemask) * 8));
+}
 
-    /* Variable declaration and initialization */
-    unsigned long cpvalue = 10000;
-    unsigned int base = 10;
-    char *tmp_ptr;
-    int pd = 0;
-    int dd = 0;
-    int threading = 0;
+/* Pin the calling thread to the CPU params assigns to it and apply the memory policy.
+ * Call at the top of parallel regions */
+static void clc_place_worker(const cpubench_params *params, int thread)
+{
+    cpu_set_t set;
+    int cpu = clc_nth_cpu(&params->cpus, thread);
 
-    /* Try setting process priority to highest */
-    int returnvalue = setpriority(PRIO_PROCESS, (id_t)0, -20);
-    if (returnvalue == -1)
+    if (cpu >= 0)
+    {
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        sched_setaffinity(0, sizeof(set), &set);
+    }
+    if (params->mem_policy != CPUBENCH_MEM_DEFAULT)
     {
-        printf("%sWARN: Unable to max out priority. Did you not run this app as root?%s\n", TXTYELLOW, TXTNORMAL);
+        clc_apply_mempolicy(params);
     }
+}
+
+/* Give the calling thread and the pool workers their original affinity and memory policy back */
+static void clc_release_workers(cpubench_ctx *ctx, int threads)
+{
+    sched_setaffinity(0, sizeof(ctx->affinity), &ctx->affinity);
+    syscall(SYS_set_mempolicy, CLC_MPOL_DEFAULT, NULL, 0UL);
 
-    /* Parse command line */
-    if (argc == 4 && ((strcmp(argv[3], "--printdigits") == 0) || (strcmp(argv[3], "--nodigits") == 0) || (strcmp(argv[3], "--dumpdigits") == 0)))
+    #pragma omp parallel num_threads (threads)
     {
-        cpvalue = strtol(argv[1], &tmp_ptr, base);
-        threading = (strcmp(argv[2], "--singlethreaded") == 0) ? 1 : 0;
-        threading = (strcmp(argv[2], "--multithreaded") == 0) ? 0 : 1;
-        pd = (strcmp(argv[3], "--printdigits") == 0) ? 1 : 0;
-        dd = (strcmp(argv[3], "--dumpdigits") == 0) ? 1 : 0;
+        sched_setaffinity(0, sizeof(ctx->affinity), &ctx->affinity);
+        syscall(SYS_set_mempolicy, CLC_MPOL_DEFAULT, NULL, 0UL);
     }
+}
 
-    /* Invalid command line parameters */
-    else
+/* Move an existing buffer to where the memory policy of params wants it. Any other policy
+ * clears what an earlier run left on the range, and with "local" the pages are dropped so
+ * the placed workers fault them in again on their own nodes */
+static void clc_bind_memory(const cpubench_params *params, void *buf, size_t size)
+{
+    unsigned long nodemask[2] = { (unsigned long)params->mem_nodes, 0 };
+    int mode = clc_mpol_mode(params->mem_policy);
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t first = ((uintptr_t)buf + page - 1) & ~(page - 1);
+    uintptr_t last = ((uintptr_t)buf + size) & ~(page - 1);
+
+    if (mode == CLC_MPOL_BIND || mode == CLC_MPOL_INTERLEAVE)
+    {
+        syscall(SYS_mbind, buf, size, mode, nodemask, (unsigned long)(sizeof(nodemask) * 8), CLC_MPOL_MF_MOVE);
+        return;
+    }
+    /* Moving with MPOL_DEFAULT would gather every page on the caller's node, so don't */
+    syscall(SYS_mbind, buf, size, CLC_MPOL_DEFAULT, NULL, 0UL, 0U);
+    if (mode == CLC_MPOL_LOCAL && last > first)
     {
-        fprintf(stderr, "%sError: Invalid command-line arguments!%s\nUsage: cpubench [value] [threading] [parameter]\nValue: Any number from 1 to 2^32-1\n(in case of single threaded bench, it will be used to compute primes from 1 to n (where n = value between 1 and 2^32-1) or n digits of PI (where n = value between 1 and 2^32-1)\nParameter:\n--printdigits : Prints all digits of PI on console\n--nodigits : Suppresses printing of digits of PI on console (Use this when doing multithreaded bench)\n--dumpdigits : Saves all the digits of PI to a text file\nThreading:\n--singlethreaded : Stresses only one core (PI)\n--multithreaded : Stresses all the cores (PRIMES)\n\nUsage example: cpubench 50000 --singlethreaded --printdigits\n", TXTRED, TXTNORMAL);
-        exit(1);
+        madvise((void *)first, last - first, MADV_DONTNEED);
     }
+}
 
-    /* Print introductory text */
-    struct utsname uname_ptr;
-    uname(&uname_ptr);
-    printf("%s\n---------------------------------------------------------------", TXTGREEN);
-    printf("\nCPU Bench v1.0 beta (%s)\nBuild date: %s %s\n", uname_ptr.machine, build_date, build_time);
-    printf("---------------------------------------------------------------%s\n\n", TXTNORMAL);
+/* Bit mask of the online NUMA nodes, node 0 alone when the system has no NUMA support */
+static unsigned long long clc_online_nodes(void)
+{
+    char buf[256];
+    cpubench_cpumask mask;
+    FILE *file = fopen("/sys/devices/system/node/online", "r");
 
-    /* Check if digits isnt zero or below */
-    if (cpvalue < 1)
+    if (file == NULL)
     {
-        fprintf(stderr, "%sError: Digit cannot be lower than 1%s\n", TXTRED, TXTNORMAL);
-        exit(1);
+        return 1;
     }
+    int ok = (fgets(buf, sizeof(buf), file) != NULL && cpubench_cpumask_parse(&mask, buf) == CPUBENCH_OK);
+    fclose(file);
+    return (ok && mask.bits[0] != 0) ? mask.bits[0] : 1;
+}
 
-    /* Perform single threaded benchmark */
-    if (threading == 1)
+/* Whether a file of space separated words, such as cgroup.controllers, holds word */
+static int clc_file_has_word(const char *path, const char *word)
+{
+    char buf[512], *tok, *save;
+    FILE *file = fopen(path, "r");
+    int found = 0;
+
+    if (file == NULL)
+    {
+        return 0;
+    }
+    if (fgets(buf, sizeof(buf), file) != NULL)
     {
+        for (tok = strtok_r(buf, " \n", &save); tok != NULL && !found; tok = strtok_r(NULL, " \n", &save))
+        {
+            found = (strcmp(tok, word) == 0);
+        }
+    }
+    fclose(file);
+    return found;
+}
 
-        /* Calculate digits of pi */
-        printf("Performing single-threaded benchmarking [PI]\nComputing %lu digits of PI...\n", cpvalue);
-        char *digits_of_pi = clc_pi(cpvalue);
+/* Find the directory of our cgroup that holds the CPU controller. Returns the cgroup version */
+static int clc_cgroup_dir(char *dir, size_t len)
+{
+    static const char *const v1_mounts[] = { "/sys/fs/cgroup/cpu,cpuacct", "/sys/fs/cgroup/cpu", NULL };
+    char line[512];
+    char probe[768];
+    int version = 0;
+    int k;
+    FILE *file = fopen("/proc/self/cgroup", "r");
+
+    if (file == NULL)
+    {
+        return 0;
+    }
 
-        /* Print the digits if user specified the --printdigits flag */
-        if (pd == 1)
+    /* Lines are "id:controllers:path", cgroup v2 is the one with id 0 and no controllers */
+    while (version == 0 && fgets(line, sizeof(line), file) != NULL)
+    {
+        char *controllers = strchr(line, ':');
+        char *path = controllers ? strchr(controllers + 1, ':') : NULL;
+        if (path == NULL)
         {
-            printf("Here are the digits:\n\n%.1s.%s\n", digits_of_pi, digits_of_pi + 1);
+            continue;
         }
+        *path++ = '\0';
+        path[strcspn(path, "\n")] = '\0';
+        controllers++;
 
-        /* Save digits to text file if user specified the --dumpdigits flag */
-        if (dd == 1)
+        if (strcmp(line, "0") == 0 && *controllers == '\0')
         {
-            FILE *file;
-            if ((file = fopen("pidigits.txt", "w")) == NULL)
+            /* Only counts if the unified hierarchy actually has the cpu controller: our cgroup has
+             * cpu.max, or we are in the root, which never has one, and the root lists the controller */
+            snprintf(probe, sizeof(probe), "/sys/fs/cgroup%s/cpu.max", path);
+            if (access(probe, R_OK) == 0
+                || (strcmp(path, "/") == 0 && clc_file_has_word("/sys/fs/cgroup/cgroup.controllers", "cpu")))
             {
-                fprintf(stderr, "%sError while opening file%s\n", TXTRED, TXTNORMAL);
-                exit(-1);
+                snprintf(dir, len, "/sys/fs/cgroup%s", strcmp(path, "/") == 0 ? "" : path);
+                version = 2;
             }
-            else
+        }
+        else
+        {
+            char *tok, *save;
+            for (tok = strtok_r(controllers, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save))
             {
-                fprintf(file, "%.1s.%s\n", digits_of_pi, digits_of_pi + 1);
+                if (strcmp(tok, "cpu") != 0)
+                {
+                    continue;
+                }
+                /* Inside a container the mount is often our own cgroup, not the host root */
+                for (k = 0; v1_mounts[k] != NULL && version == 0; k++)
+                {
+                    snprintf(probe, sizeof(probe), "%s%s/cpu.cfs_quota_us", v1_mounts[k], path);
+                    if (access(probe, R_OK) == 0)
+                    {
+                        snprintf(dir, len, "%s%s", v1_mounts[k], strcmp(path, "/") == 0 ? "" : path);
+                        version = 1;
+                    }
+                    else
+                    {
+                        snprintf(probe, sizeof(probe), "%s/cpu.cfs_quota_us", v1_mounts[k]);
+                        if (access(probe, R_OK) == 0)
+                        {
+                            snprintf(dir, len, "%s", v1_mounts[k]);
+                            version = 1;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    fclose(file);
+    return version;
+}
+
+/* Tightest CPU bandwidth limit of our cgroup and its ancestors, in CPUs, 0 when unlimited */
+static double clc_cgroup_quota(const char *dir, int version)
+{
+    char path[768];
+    char buf[64];
+    double best = 0;
+    size_t len = strlen(dir);
+    size_t root = strlen((version == 2) ? "/sys/fs/cgroup" : "/sys/fs/cgroup/cpu");
+
+    for (;;)
+    {
+        double quota = -1, period = 0;
+        FILE *file;
+
+        if (version == 2)
+        {
+            snprintf(path, sizeof(path), "%.*s/cpu.max", (int)len, dir);
+            if ((file = fopen(path, "r")) != NULL)
+            {
+                /* "max 100000" or "<quota> <period>" */
+                if (fscanf(file, "%63s %lf", buf, &period) == 2 && strcmp(buf, "max") != 0)
+                {
+                    quota = atof(buf);
+                }
                 fclose(file);
             }
         }
+        else
+        {
+            snprintf(path, sizeof(path), "%.*s/cpu.cfs_quota_us", (int)len, dir);
+            if (clc_read_sysfs(path, &quota))
+            {
+                snprintf(path, sizeof(path), "%.*s/cpu.cfs_period_us", (int)len, dir);
+                if (!clc_read_sysfs(path, &period))
+                {
+                    quota = -1;
+                }
+            }
+        }
+        if (quota > 0 && period > 0 && (best == 0 || quota / period < best))
+        {
+            best = quota / period;
+        }
+
+        /* Walk up to the parent cgroup */
+        while (len > root && dir[len - 1] != '/')
+        {
+            len--;
+        }
+        if (len <= root)
+        {
+            break;
+        }
+        len--;
+    }
+    return best;
+}
+
+/* Throttling counters of our cgroup */
+static void clc_cgroup_throttling(unsigned long long *periods, double *seconds)
+{
+    char dir[512];
+    char path[600];
+    char key[64];
+    unsigned long long value;
+    int version = clc_cgroup_dir(dir, sizeof(dir));
+    FILE *file;
+
+    *periods = 0;
+    *seconds = 0;
+    snprintf(path, sizeof(path), "%s/cpu.stat", dir);
+    if (version == 0 || (file = fopen(path, "r")) == NULL)
+    {
+        return;
+    }
+    while (fscanf(file, "%63s %llu", key, &value) == 2)
+    {
+        if (strcmp(key, "nr_throttled") == 0)
+        {
+            *periods = value;
+        }
+        else if (strcmp(key, "throttled_usec") == 0)
+        {
+            *seconds = value / 1E6;
+        }
+        else if (strcmp(key, "throttled_time") == 0)
+        {
+            *seconds = value / 1E9;
+        }
+    }
+    fclose(file);
+}
+
+/* Touch every page of a buffer so it is backed by memory before it is measured */
+static void clc_prefault(void *buf, size_t size)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    size_t off;
 
-        /* Print MD5 checksum */
-        char *md5 = clc_md5(digits_of_pi);
-        printf("MD5 checksum (for verification): %s\n", md5);
+    for (off = 0; off < size; off += (size_t)page)
+    {
+        ((volatile char *)buf)[off] = 0;
+    }
+}
 
-        /* Free the memory */
-        free(digits_of_pi);
+/* Get scratch memory of at least size bytes, reusing the context's pre-faulted arena.
+ * With params, the memory is moved to the nodes its memory policy asks for. A new arena
+ * is left unfaulted under a policy, so the placed workers are the ones to touch it first */
+static void *clc_scratch(cpubench_ctx *ctx, const cpubench_params *params, size_t size)
+{
+    if (size > ctx->scratch_size)
+    {
+        void *buf;
+        if (posix_memalign(&buf, 64, size) != 0)
+        {
+            return NULL;
+        }
+        if (params == NULL || params->mem_policy == CPUBENCH_MEM_DEFAULT)
+        {
+            clc_prefault(buf, size);
+        }
+        free(ctx->scratch);
+        ctx->scratch = buf;
+        ctx->scratch_size = size;
+    }
+    if (params != NULL)
+    {
+        clc_bind_memory(params, ctx->scratch, size);
     }
+    return ctx->scratch;
+}
 
-    /* Perform multi-threaded benchmark */
-    else if (threading == 0)
+/* Report progress if a callback is set and the interval has passed. Safe to call from any thread */
+static void clc_progress(cpubench_ctx *ctx, cpubench_workload workload, unsigned long long done, unsigned long long total, unsigned long long start)
+{
+    cpubench_progress progress;
+    double last;
+
+    double elapsed = cpubench_timer_seconds(cpubench_timer_now() - start);
+    __atomic_load(&ctx->progress_last, &last, __ATOMIC_RELAXED);
+    if (elapsed - last < ctx->progress_interval && done < total)
     {
+        return;
+    }
 
-        printf("Performing multi-threaded benchmarking [Primes]\nComputing primes under %lu...\n", cpvalue);
-        long int tot = clc_prime(cpvalue);
-        printf("Total primes found are %lu\n", tot);
+    /* Whoever gets here first reports, everyone else carries on */
+    if (__atomic_exchange_n(&ctx->progress_busy, 1, __ATOMIC_ACQUIRE) != 0)
+    {
+        return;
+    }
+    progress.workload = workload;
+    progress.fraction = (double)done / (double)total;
+    progress.elapsed = elapsed;
+    progress.rate = (elapsed > 0) ? (double)done / elapsed : 0;
+    ctx->progress_cb(&progress, ctx->progress_user);
+    __atomic_store(&ctx->progress_last, &elapsed, __ATOMIC_RELAXED);
+    __atomic_store_n(&ctx->progress_busy, 0, __ATOMIC_RELEASE);
+}
 
-        /* Print MD5 checksum */
-        char *buffer = malloc(sizeof(tot) + 1);
-        sprintf(buffer, "%lu", tot);
-        char *md5 = clc_md5(buffer);
-        printf("MD5 checksum (for verification): %s\n", md5);
+/* Calculate prime numbers */
+static cpubench_status clc_prime(cpubench_ctx *ctx, const cpubench_params *params, cpubench_result *result)
+{
+    unsigned long long max = params->u.prime.max;
+    unsigned long long x, y;
+    unsigned long long tpnums = 0;
+    unsigned long long done = 0;
+    int threads = clc_threads(ctx, params);
+    unsigned long long pstart, pend;
+    char buffer[24];
 
+    if (max < 1)
+    {
+        return CPUBENCH_ERR_INVALID_ARG;
     }
 
-    /* Time to go! */
-    printf("Goodbye!\n");
-    return 0;
+    /* Get high-res time */
+    pstart = cpubench_timer_now();
+
+    /* Start computing primes */
+    #pragma omp parallel num_threads (threads)
+    {
+        unsigned long long tested = 0;
+        clc_place_worker(params, omp_get_thread_num());
+
+        #pragma omp for private (y) reduction (+:tpnums)
+        for (x = 2; x <= max; x++)
+        {
+            int pnum = 1;
+
+            for (y = 2; y < x; y++)
+            {
+                if (x % y == 0)
+                {
+                    pnum = 0;
+                    break;
+                }
+            }
+            tpnums = tpnums + pnum;
+
+            /* Publish progress in batches to keep the shared counter cold */
+            if (ctx->progress_cb != NULL && ++tested == 4096)
+            {
+                clc_progress(ctx, CPUBENCH_WORKLOAD_PRIMES, __atomic_add_fetch(&done, tested, __ATOMIC_RELAXED), max, pstart);
+                tested = 0;
+            }
+        }
+    }
+
+    /* Get high-res time */
+    pend = cpubench_timer_now();
+
+    /* Store time taken and total primes */
+    result->threads = threads;
+    result->seconds = cpubench_timer_seconds(pend - pstart);
+    result->count = tpnums;
+
+    /* Checksum the decimal representation of the count */
+    snprintf(buffer, sizeof(buffer), "%llu", tpnums);
+    clc_md5(buffer, result->checksum);
+
+    return clc_add_metric(result, "numbers_per_second", NULL, "1/s", (double)max / result->seconds);
+}
+
+/* Calculate pi digits main function */
+static cpubench_status clc_pi(cpubench_ctx *ctx, const cpubench_params *params, cpubench_result *result)
+{
+    unsigned long dgts = params->u.pi.digits;
+    unsigned long i, ti;
+    const unsigned long constant1 = 545140134;
+    const unsigned long constant2 = 13591409;
+    const unsigned long constant3 = 640320;
+    unsigned long long start, end;
+    mpz_t v1, v2, v3, v4, v5;
+    mpf_t V1, V2, V3, total;
+    mp_exp_t exponent;
+
+    if (dgts < 1)
+    {
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+
+    /* Compute required iterations */
+    unsigned long iters = (dgts / 15) + 1;
+
+    /* Initialize variables */
+    double bits = clc_log2(10);
+    unsigned long precision = (dgts * bits) + 1;
+    mpz_inits(v1, v2, v3, v4, v5, NULL);
+
+    /* Explicit precision, the default one is process-wide and per-node instances run concurrently */
+    mpf_init2(V1, precision);
+    mpf_init2(V2, precision);
+    mpf_init2(V3, precision);
+    mpf_init2(total, precision);
+    mpf_set_ui(total, 0);
+
+    /* The final multiplier only depends on the precision, so repeated runs reuse it */
+    if (ctx->pi_const_prec != precision)
+    {
+        mpf_set_prec(ctx->pi_const, precision);
+        mpf_sqrt_ui(ctx->pi_const, 10005);
+        mpf_mul_ui(ctx->pi_const, ctx->pi_const, 426880);
+        ctx->pi_const_prec = precision;
+    }
+
+    /* Get high-res time */
+    start = cpubench_timer_now();
+
+    /* Iterate and compute value using Chudnovsky Algorithm */
+    for (i = 0x0; i < iters; i++)
+    {
+        ti = i * 3;
+        mpz_fac_ui(v1, 6 * i);
+        mpz_set_ui(v2, constant1);
+        mpz_mul_ui(v2, v2, i);
+        mpz_add_ui(v2, v2, constant2);
+        mpz_fac_ui(v3, ti);
+        mpz_fac_ui(v4, i);
+        mpz_pow_ui(v4, v4, 3);
+        mpz_ui_pow_ui(v5, constant3, ti);
+        if ((1 & ti) == 1)
+        {
+            mpz_neg(v5, v5);
+        }
+        mpz_mul(v1, v1, v2);
+        mpf_set_z(V1, v1);
+        mpz_mul(v3, v3, v4);
+        mpz_mul(v3, v3, v5);
+        mpf_set_z(V2, v3);
+        mpf_div(V3, V1, V2);
+        mpf_add(total, total, V3);
+
+        if (ctx->progress_cb != NULL)
+        {
+            clc_progress(ctx, CPUBENCH_WORKLOAD_PI, (i + 1) * dgts / iters, dgts, start);
+        }
+    }
+
+    /* Some final computations */
+    mpf_ui_div(total, 1, total);
+    mpf_mul(total, total, ctx->pi_const);
+
+    /* Get high-res time */
+    end = cpubench_timer_now();
+
+    /* Store time taken and output */
+    result->threads = 1;
+    result->seconds = cpubench_timer_seconds(end - start);
+    result->count = iters - 1;
+    result->digits = mpf_get_str(NULL, &exponent, 10, dgts, total);
+
+    /* Free up space consumed by variables */
+    mpz_clears(v1, v2, v3, v4, v5, NULL);
+    mpf_clears(V1, V2, V3, total, NULL);
+
+    if (result->digits == NULL)
+    {
+        return CPUBENCH_ERR_NOMEM;
+    }
+    clc_md5(result->digits, result->checksum);
+
+    return clc_add_metric(result, "digits_per_second", NULL, "1/s", (double)dgts / result->seconds);
+}
+
+/* Time every STREAM kernel over ntimes passes with the given number of threads, keeping the
+ * fastest pass of each. Returns 0 if the arrays hold the values the kernels should produce */
+static int clc_stream_pass(const cpubench_params *params, int threads, double *a, double *b, double *c, size_t n, double best[CLC_STREAM_KERNELS])
+{
+    const double scalar = 3.0;
+    int ntimes = params->u.stream.ntimes;
+    unsigned long long start = 0;
+    double sum = 0;
+    double ea = 1.0, eb = 2.0, ec = 0.0;
+    int k, kernel, bad = 0;
+    size_t j;
+
+    for (kernel = 0; kernel < CLC_STREAM_KERNELS; kernel++)
+    {
+        best[kernel] = 0;
+    }
+
+    #pragma omp parallel num_threads (threads) private (k, kernel, j)
+    {
+        clc_place_worker(params, omp_get_thread_num());
+
+        /* Same static schedule as the kernels, so under a memory policy, where the arena is left
+         * unfaulted, every thread is the first to touch the memory it works on */
+        #pragma omp for schedule (static)
+        for (j = 0; j < n; j++)
+        {
+            a[j] = 1.0;
+            b[j] = 2.0;
+            c[j] = 0.0;
+        }
+
+        for (k = 0; k < ntimes; k++)
+        {
+            /* What one element should hold after this pass */
+            #pragma omp master
+            {
+                ec = ea;
+                eb = scalar * ec;
+                ec = ea + eb;
+                ea = eb + scalar * ec;
+                ec = scalar;
+            }
+
+            for (kernel = 0; kernel < CLC_STREAM_KERNELS; kernel++)
+            {
+                #pragma omp master
+                {
+                    sum = 0;
+                    start = cpubench_timer_now();
+                }
+                #pragma omp barrier
+
+                switch (kernel)
+                {
+                case CLC_STREAM_COPY:
+                    #pragma omp for schedule (static)
+                    for (j = 0; j < n; j++)
+                    {
+                        c[j] = a[j];
+                    }
+                    break;
+                case CLC_STREAM_SCALE:
+                    #pragma omp for schedule (static)
+                    for (j = 0; j < n; j++)
+                    {
+                        b[j] = scalar * c[j];
+                    }
+                    break;
+                case CLC_STREAM_ADD:
+                    #pragma omp for schedule (static)
+                    for (j = 0; j < n; j++)
+                    {
+                        c[j] = a[j] + b[j];
+                    }
+                    break;
+                case CLC_STREAM_TRIAD:
+                    #pragma omp for schedule (static)
+                    for (j = 0; j < n; j++)
+                    {
+                        a[j] = b[j] + scalar * c[j];
+                    }
+                    break;
+                case CLC_STREAM_READ:
+                    /* Summing in a tree keeps the loop from waiting on one long chain of adds */
+                    #pragma omp for schedule (static) reduction (+:sum)
+                    for (j = 0; j < n; j += 8)
+                    {
+                        sum += ((a[j] + a[j + 1]) + (a[j + 2] + a[j + 3])) + ((a[j + 4] + a[j + 5]) + (a[j + 6] + a[j + 7]));
+                    }
+                    break;
+                default:
+                    /* Non-temporal stores skip the read for ownership and bypass the caches */
+#ifdef __SSE2__
+                    #pragma omp for schedule (static) nowait
+                    for (j = 0; j < n; j += 2)
+                    {
+                        _mm_stream_pd(&c[j], _mm_set1_pd(scalar));
+                    }
+                    _mm_sfence();
+                    #pragma omp barrier
+#else
+                    #pragma omp for schedule (static)
+                    for (j = 0; j < n; j++)
+                    {
+                        c[j] = scalar;
+                    }
+#endif
+                    break;
+                }
+
+                /* The first pass only warms up, unless it is the only one */
+                #pragma omp master
+                {
+                    double t = cpubench_timer_seconds(cpubench_timer_now() - start);
+                    if ((k > 0 || ntimes == 1) && (best[kernel] == 0 || t < best[kernel]))
+                    {
+                        best[kernel] = t;
+                    }
+                    if (kernel == CLC_STREAM_READ && fabs(sum - ea * (double)n) > 1E-8 * ea * (double)n)
+                    {
+                        bad = 1;
+                    }
+                }
+                #pragma omp barrier
+            }
+
+        }
+    }
+
+    /* Every element went through the same operations, so they must match exactly */
+    for (j = 0; j < n && !bad; j++)
+    {
+        bad = (a[j] != ea || b[j] != eb || c[j] != ec);
+    }
+    return bad;
+}
+
+/* Measure memory bandwidth with the STREAM kernels */
+static cpubench_status clc_stream(cpubench_ctx *ctx, const cpubench_params *params, cpubench_result *result)
+{
+    static const char *const kernel_names[CLC_STREAM_KERNELS] = { "copy", "scale", "add", "triad", "read", "write" };
+    /* Arrays each kernel moves, non-temporal stores don't read the destination first */
+    static const int kernel_arrays[CLC_STREAM_KERNELS] = { 2, 2, 3, 3, 1, 1 };
+    double best[CLC_STREAM_KERNELS];
+    double sweep[CLC_STREAM_KERNELS];
+    int threads = clc_threads(ctx, params);
+    unsigned long long start;
+    cpubench_status status;
+    char buffer[96];
+    char label[64];
+    int kernel, t;
+
+    /* Whole cache lines per thread chunk and an even count for the paired non-temporal stores */
+    size_t n = (size_t)(params->u.stream.bytes / sizeof(double)) & ~(size_t)7;
+    if (n == 0 || params->u.stream.ntimes < 1 || n > SIZE_MAX / (3 * sizeof(double)))
+    {
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+    double *a = clc_scratch(ctx, params, 3 * n * sizeof(double));
+    if (a == NULL)
+    {
+        return CPUBENCH_ERR_NOMEM;
+    }
+    double *b = a + n;
+    double *c = b + n;
+
+    start = cpubench_timer_now();
+    int bad = clc_stream_pass(params, threads, a, b, c, n, best);
+
+    result->threads = threads;
+    result->seconds = cpubench_timer_seconds(cpubench_timer_now() - start);
+    result->count = n;
+
+    /* The final values only depend on the number of passes, never on timing or thread count */
+    snprintf(buffer, sizeof(buffer), "%s %d %.17g %.17g %.17g", bad ? "invalid" : "valid", params->u.stream.ntimes, a[0], b[0], c[0]);
+    clc_md5(buffer, result->checksum);
+
+    /* Triad first, it is the figure everyone quotes */
+    status = clc_add_metric(result, "bandwidth", kernel_names[CLC_STREAM_TRIAD], "B/s", 3.0 * (double)(n * sizeof(double)) / best[CLC_STREAM_TRIAD]);
+    for (kernel = 0; kernel < CLC_STREAM_KERNELS && status == CPUBENCH_OK; kernel++)
+    {
+        if (kernel != CLC_STREAM_TRIAD)
+        {
+            status = clc_add_metric(result, "bandwidth", kernel_names[kernel], "B/s", kernel_arrays[kernel] * (double)(n * sizeof(double)) / best[kernel]);
+        }
+    }
+
+    /* Triad at 1, 2, 4, ... threads, the full count is already known */
+    for (t = 1; params->u.stream.sweep && t < threads && status == CPUBENCH_OK; t *= 2)
+    {
+        clc_stream_pass(params, t, a, b, c, n, sweep);
+        snprintf(label, sizeof(label), "triad, %d threads", t);
+        status = clc_add_metric(result, "bandwidth_scaling", label, "B/s", 3.0 * (double)(n * sizeof(double)) / sweep[CLC_STREAM_TRIAD]);
+    }
+    if (params->u.stream.sweep && status == CPUBENCH_OK)
+    {
+        snprintf(label, sizeof(label), "triad, %d threads", threads);
+        status = clc_add_metric(result, "bandwidth_scaling", label, "B/s", result->metrics[0].value);
+    }
+    return status;
+}
+
+/* An anonymous mapping, aligned for huge pages when asked for them */
+struct clc_mapping
+{
+    void *base;
+    size_t len;
+    char *buf;
+    int huge;
+};
+
+/* Map size bytes backed by 4 KB pages, or huge pages from hugetlbfs or failing that THP */
+static int clc_map(struct clc_mapping *map, size_t size, int huge)
+{
+    map->huge = 0;
+    if (huge)
+    {
+        map->len = (size + CLC_HUGE_PAGE - 1) & ~(CLC_HUGE_PAGE - 1);
+        map->base = mmap(NULL, map->len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (map->base != MAP_FAILED)
+        {
+            map->buf = map->base;
+            map->huge = 1;
+            return 0;
+        }
+    }
+
+    /* THP only backs 2 MB aligned ranges, so over-allocate and align */
+    map->len = size + (huge ? CLC_HUGE_PAGE : 0);
+    map->base = mmap(NULL, map->len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map->base == MAP_FAILED)
+    {
+        return -1;
+    }
+    map->buf = map->base;
+    if (huge)
+    {
+        map->buf = (char *)(((uintptr_t)map->base + CLC_HUGE_PAGE - 1) & ~(uintptr_t)(CLC_HUGE_PAGE - 1));
+        map->huge = (madvise(map->buf, size, MADV_HUGEPAGE) == 0);
+    }
+    else
+    {
+        madvise(map->buf, size, MADV_NOHUGEPAGE);
+    }
+    return 0;
+}
+
+/* Link the first nlines cache lines of buf into one random cycle (Sattolo's algorithm), so
+ * neither the prefetchers nor the line order give the next address away */
+static void clc_build_chase(char *buf, unsigned int *order, size_t nlines)
+{
+    unsigned long long rng = 0x9E3779B97F4A7C15ULL ^ nlines;
+    size_t i, j;
+
+    for (i = 0; i < nlines; i++)
+    {
+        order[i] = (unsigned int)i;
+    }
+    for (i = nlines - 1; i > 0; i--)
+    {
+        unsigned int tmp;
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        j = (size_t)(rng % i);
+        tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+    for (i = 0; i < nlines; i++)
+    {
+        *(void **)(buf + (size_t)order[i] * 64) = buf + (size_t)order[(i + 1) % nlines] * 64;
+    }
+}
+
+/* Follow the chain for loads steps, every load depends on the one before */
+static __attribute__((noinline)) void *clc_chase(void *p, unsigned long long loads)
+{
+    for (; loads >= 8; loads -= 8)
+    {
+        p = *(void **)p;
+        p = *(void **)p;
+        p = *(void **)p;
+        p = *(void **)p;
+        p = *(void **)p;
+        p = *(void **)p;
+        p = *(void **)p;
+        p = *(void **)p;
+    }
+    return p;
+}
+
+/* Average load-to-use latency in ns for every working set size. Appends the line each chase
+ * ended on to trail, which only depends on the sizes */
+static int clc_chase_sizes(cpubench_ctx *ctx, const cpubench_params *params, const size_t *sizes, int nsizes, int huge, double *latency,
+                           int *got_huge, char *trail, size_t trail_len, unsigned long long start)
+{
+    struct clc_mapping map;
+    unsigned int *order;
+    size_t len;
+    int i;
+
+    if (clc_map(&map, sizes[nsizes - 1], huge) != 0)
+    {
+        return -1;
+    }
+    if ((order = malloc((sizes[nsizes - 1] / 64) * sizeof(*order))) == NULL)
+    {
+        munmap(map.base, map.len);
+        return -1;
+    }
+    clc_bind_memory(params, map.buf, sizes[nsizes - 1]);
+    *got_huge = map.huge;
+
+    for (i = 0; i < nsizes; i++)
+    {
+        size_t nlines = sizes[i] / 64;
+        unsigned long long t0;
+        void *p;
+
+        /* One lap to pull the working set in, then the timed loads */
+        clc_build_chase(map.buf, order, nlines);
+        p = clc_chase(map.buf, (nlines < CLC_CHASE_LOADS) ? (nlines + 7) & ~7ULL : CLC_CHASE_LOADS);
+        t0 = cpubench_timer_now();
+        p = clc_chase(p, CLC_CHASE_LOADS);
+        latency[i] = cpubench_timer_seconds(cpubench_timer_now() - t0) * 1E9 / CLC_CHASE_LOADS;
+
+        len = strlen(trail);
+        snprintf(trail + len, trail_len - len, " %lu", (unsigned long)(((char *)p - map.buf) / 64));
+        if (ctx->progress_cb != NULL)
+        {
+            clc_progress(ctx, CPUBENCH_WORKLOAD_LATENCY, (unsigned long long)(i + 1), (unsigned long long)nsizes, start);
+        }
+    }
+
+    free(order);
+    munmap(map.base, map.len);
+    return 0;
+}
+
+/* Human readable working set size, e.g. "64 B", "48 KiB" or "1.5 MiB" */
+static void clc_format_size(char *out, size_t len, unsigned long long bytes)
+{
+    if (bytes >= (1ULL << 30))
+    {
+        snprintf(out, len, "%g GiB", (double)bytes / (1ULL << 30));
+    }
+    else if (bytes >= (1ULL << 20))
+    {
+        snprintf(out, len, "%g MiB", (double)bytes / (1ULL << 20));
+    }
+    else if (bytes < (1ULL << 10))
+    {
+        snprintf(out, len, "%llu B", bytes);
+    }
+    else
+    {
+        snprintf(out, len, "%g KiB", (double)bytes / (1ULL << 10));
+    }
+}
+
+/* Data and unified caches of a CPU from sysfs, smallest first. Returns how many were found */
+static int clc_read_caches(int cpu, char names[][16], unsigned long long *sizes, int max)
+{
+    char path[128];
+    char type[32];
+    double value;
+    int index, level, n = 0;
+
+    for (index = 0; n < max; index++)
+    {
+        unsigned long long size;
+        char unit = 'K';
+        FILE *file;
+
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/type", cpu, index);
+        if ((file = fopen(path, "r")) == NULL)
+        {
+            break;
+        }
+        if (fscanf(file, "%31s", type) != 1)
+        {
+            type[0] = '\0';
+        }
+        fclose(file);
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/level", cpu, index);
+        level = clc_read_sysfs(path, &value) ? (int)value : 0;
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/size", cpu, index);
+        if (strcmp(type, "Instruction") == 0 || level <= 0 || (file = fopen(path, "r")) == NULL)
+        {
+            continue;
+        }
+        if (fscanf(file, "%llu%c", &size, &unit) >= 1)
+        {
+            sizes[n] = size << ((unit == 'M') ? 20 : (unit == 'G') ? 30 : 10);
+            snprintf(names[n], 16, "L%d%s", level, (strcmp(type, "Data") == 0) ? "d" : "");
+            n++;
+        }
+        fclose(file);
+    }
+    return n;
+}
+
+/* Measure load-to-use latency across the cache and TLB hierarchy */
+static cpubench_status clc_latency(cpubench_ctx *ctx, const cpubench_params *params, cpubench_result *result)
+{
+    size_t sizes[CLC_MAX_SIZES];
+    double small[CLC_MAX_SIZES], huge[CLC_MAX_SIZES];
+    char cache_names[8][16];
+    unsigned long long cache_sizes[8];
+    char label[64];
+    char trail[CLC_MAX_SIZES * 12] = "";
+    char huge_trail[CLC_MAX_SIZES * 12] = "";
+    unsigned long long start, base;
+    cpubench_status status = CPUBENCH_OK;
+    int nsizes = 0, ncaches, got_huge = 0, i, c, level;
+    const double *curve;
+
+    /* Two sizes per doubling, in whole cache lines */
+    for (base = params->u.latency.min_bytes & ~63ULL; base >= 64 && base <= params->u.latency.max_bytes && nsizes < CLC_MAX_SIZES - 1; base *= 2)
+    {
+        sizes[nsizes++] = (size_t)base;
+        if (base + base / 2 <= params->u.latency.max_bytes)
+        {
+            sizes[nsizes++] = (size_t)(base + base / 2);
+        }
+    }
+    if (nsizes == 0 || sizes[nsizes - 1] / 64 > 0xFFFFFFFFULL)
+    {
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+
+    start = cpubench_timer_now();
+    if (clc_chase_sizes(ctx, params, sizes, nsizes, 0, small, &c, trail, sizeof(trail), start) != 0)
+    {
+        return CPUBENCH_ERR_NOMEM;
+    }
+    if (params->u.latency.hugepages && clc_chase_sizes(ctx, params, sizes, nsizes, 1, huge, &got_huge, huge_trail, sizeof(huge_trail), start) != 0)
+    {
+        return CPUBENCH_ERR_NOMEM;
+    }
+
+    result->threads = 1;
+    result->seconds = cpubench_timer_seconds(cpubench_timer_now() - start);
+    result->count = (unsigned long long)nsizes;
+    /* Both page sizes walk the same cycles, so they have to end on the same lines */
+    clc_md5((params->u.latency.hugepages && strcmp(trail, huge_trail) != 0) ? "invalid" : trail, result->checksum);
+
+    /* Huge pages show the caches without TLB misses in the way, when we got them */
+    curve = got_huge ? huge : small;
+    clc_format_size(label, sizeof(label), sizes[nsizes - 1]);
+    status = clc_add_metric(result, "memory_latency", label, "ns", curve[nsizes - 1]);
+    for (i = 0; i < nsizes && status == CPUBENCH_OK; i++)
+    {
+        clc_format_size(label, sizeof(label), sizes[i]);
+        status = clc_add_metric(result, "latency", label, "ns", small[i]);
+        if (got_huge && status == CPUBENCH_OK)
+        {
+            status = clc_add_metric(result, "latency_hugepages", label, "ns", huge[i]);
+        }
+    }
+
+    /* What the kernel says the caches are */
+    int cpu = sched_getcpu();
+    ncaches = clc_read_caches((cpu >= 0) ? cpu : 0, cache_names, cache_sizes, 8);
+    for (c = 0; c < ncaches && status == CPUBENCH_OK; c++)
+    {
+        status = clc_add_metric(result, "cache_size", cache_names[c], "B", (double)cache_sizes[c]);
+    }
+
+    /* Walk the curve: a level ends where latency leaves its plateau, the next plateau begins
+     * once the climb flattens out again. Name each level after the cache it lines up with */
+    for (i = 0, level = 1; i < nsizes && status == CPUBENCH_OK; level++)
+    {
+        double plateau = curve[i];
+        const char *name = NULL;
+
+        while (i + 1 < nsizes && curve[i + 1] < plateau * CLC_LEVEL_STEP)
+        {
+            i++;
+        }
+        for (c = 0; c < ncaches; c++)
+        {
+            if (sizes[i] * 2 >= cache_sizes[c] && sizes[i] <= cache_sizes[c] * 2)
+            {
+                name = cache_names[c];
+            }
+        }
+        if (i + 1 == nsizes)
+        {
+            /* The last plateau is memory, if we got past the caches */
+            name = (ncaches > 0 && sizes[i] > 2 * cache_sizes[ncaches - 1] && plateau > 2 * curve[0]) ? "DRAM" : "last";
+            status = clc_add_metric(result, "level_latency", name, "ns", plateau);
+            break;
+        }
+        if (name == NULL)
+        {
+            snprintf(label, sizeof(label), "level %d", level);
+            name = label;
+        }
+        status = clc_add_metric(result, "level_latency", name, "ns", plateau);
+        if (status == CPUBENCH_OK)
+        {
+            status = clc_add_metric(result, "level_boundary", name, "B", (double)sizes[i]);
+        }
+        for (i++; i + 1 < nsizes && curve[i + 1] > curve[i] * CLC_LEVEL_CLIMB; i++)
+        {
+        }
+    }
+
+    /* The TLB runs out of reach where 4 KB pages start falling behind huge pages */
+    for (i = 0; got_huge && i < nsizes && status == CPUBENCH_OK; i++)
+    {
+        if (small[i] > huge[i] * CLC_LEVEL_STEP && small[i] - huge[i] > 1.0)
+        {
+            status = clc_add_metric(result, "tlb_reach", NULL, "B", (double)((i > 0) ? sizes[i - 1] : 0));
+            if (status == CPUBENCH_OK)
+            {
+                status = clc_add_metric(result, "tlb_miss_penalty", NULL, "ns", small[nsizes - 1] - huge[nsizes - 1]);
+            }
+            break;
+        }
+    }
+    return status;
+}
+
+/* Generate memory traffic over buf until *stop is set, touching every cache line of one 4 KB
+ * block after another and waiting delay_ticks between block starts. Writes the first
+ * write_percent of the lines in each block and reads the rest. Counts touched bytes in *counter */
+static long clc_generate_load(char *buf, size_t bytes, int write_percent, unsigned long long delay_ticks, const int *stop, unsigned long long *counter)
+{
+    size_t nblocks = bytes / 4096, b;
+    int writes = 64 * write_percent / 100;
+    long sink = 0;
+    int l;
+
+    while (!__atomic_load_n(stop, __ATOMIC_ACQUIRE))
+    {
+        for (b = 0; b < nblocks && !__atomic_load_n(stop, __ATOMIC_RELAXED); b++)
+        {
+            volatile long *block = (volatile long *)(buf + b * 4096);
+            unsigned long long t0 = (delay_ticks > 0) ? cpubench_timer_now() : 0;
+
+            for (l = 0; l < writes; l++)
+            {
+                block[l * 8] = l;
+            }
+            for (; l < 64; l++)
+            {
+                sink += block[l * 8];
+            }
+            __atomic_store_n(counter, *counter + 4096, __ATOMIC_RELAXED);
+
+            while (delay_ticks > 0 && cpubench_timer_now() - t0 < delay_ticks)
+            {
+#ifdef CLC_HAVE_TSC
+                _mm_pause();
+#endif
+            }
+        }
+    }
+    return sink;
+}
+
+/* Measure memory latency on one core while the others load the memory system */
+static cpubench_status clc_loaded_latency(cpubench_ctx *ctx, const cpubench_params *params, cpubench_result *result)
+{
+    double latency[CLC_INJECTION_POINTS], bandwidth[CLC_INJECTION_POINTS];
+    int threads = clc_threads(ctx, params);
+    size_t nlines = (size_t)(params->u.loaded.bytes / 64);
+    size_t load_bytes = (size_t)(params->u.loaded.load_bytes & ~4095ULL);
+    struct clc_mapping map;
+    unsigned int *order;
+    unsigned long long (*counters)[8];
+    unsigned long long start;
+    void *end = NULL;
+    int stop = 0;
+    long sink = 0;
+    char buffer[64];
+    char label[64];
+    cpubench_status status;
+    int p, peak = 1;
+
+    /* Without other threads there is only the idle point */
+    int npoints = (threads > 1) ? CLC_INJECTION_POINTS : 1;
+
+    if (nlines < 2 || nlines > 0xFFFFFFFFULL || params->u.loaded.write_percent < 0 || params->u.loaded.write_percent > 100
+        || (threads > 1 && load_bytes == 0))
+    {
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+
+    /* Huge pages keep TLB misses out of the latency, the load buffers come from scratch */
+    char *loads = (threads > 1) ? clc_scratch(ctx, params, (size_t)(threads - 1) * load_bytes) : NULL;
+    if ((threads > 1 && loads == NULL) || clc_map(&map, nlines * 64, 1) != 0)
+    {
+        return CPUBENCH_ERR_NOMEM;
+    }
+    if ((order = malloc(nlines * sizeof(*order))) == NULL || posix_memalign((void **)&counters, 64, (size_t)threads * sizeof(*counters)) != 0)
+    {
+        free(order);
+        munmap(map.base, map.len);
+        return CPUBENCH_ERR_NOMEM;
+    }
+    memset(counters, 0, (size_t)threads * sizeof(*counters));
+    clc_bind_memory(params, map.buf, nlines * 64);
+    clc_build_chase(map.buf, order, nlines);
+    free(order);
+
+    start = cpubench_timer_now();
+
+    #pragma omp parallel num_threads (threads) private (p) reduction (+:sink)
+    {
+        int me = omp_get_thread_num();
+        clc_place_worker(params, me);
+
+        for (p = 0; p < npoints; p++)
+        {
+            #pragma omp barrier
+            if (me == 0)
+            {
+                unsigned long long bytes0 = 0, bytes1 = 0, t0, t1;
+                void *q;
+                int t;
+
+                /* One lap with the load already running, then the timed loads */
+                q = clc_chase(map.buf, (nlines < CLC_CHASE_LOADS) ? (nlines + 7) & ~7ULL : CLC_CHASE_LOADS);
+                for (t = 1; t < threads; t++)
+                {
+                    bytes0 += __atomic_load_n(&counters[t][0], __ATOMIC_RELAXED);
+                }
+                t0 = cpubench_timer_now();
+                end = clc_chase(q, CLC_CHASE_LOADS);
+                t1 = cpubench_timer_now();
+                for (t = 1; t < threads; t++)
+                {
+                    bytes1 += __atomic_load_n(&counters[t][0], __ATOMIC_RELAXED);
+                }
+                __atomic_store_n(&stop, 1, __ATOMIC_RELEASE);
+
+                latency[p] = cpubench_timer_seconds(t1 - t0) * 1E9 / CLC_CHASE_LOADS;
+                bandwidth[p] = (double)(bytes1 - bytes0) / cpubench_timer_seconds(t1 - t0);
+                if (ctx->progress_cb != NULL)
+                {
+                    clc_progress(ctx, CPUBENCH_WORKLOAD_LOADED_LATENCY, (unsigned long long)(p + 1), (unsigned long long)npoints, start);
+                }
+            }
+            else if (clc_injection_delays[p] >= 0)
+            {
+                unsigned long long delay_ticks = (unsigned long long)(clc_injection_delays[p] * 1E-9 / cpubench_timer_seconds(1));
+                sink += clc_generate_load(loads + (size_t)(me - 1) * load_bytes, load_bytes, params->u.loaded.write_percent, delay_ticks, &stop, &counters[me][0]);
+            }
+            #pragma omp barrier
+
+            #pragma omp master
+            stop = 0;
+        }
+    }
+
+    result->threads = threads;
+    result->seconds = cpubench_timer_seconds(cpubench_timer_now() - start);
+    result->count = (unsigned long long)npoints;
+
+    /* Where the chase ends only depends on the permutation */
+    snprintf(buffer, sizeof(buffer), "%lu %lu", (unsigned long)nlines, (unsigned long)(((char *)end - map.buf) / 64));
+    clc_md5(buffer, result->checksum);
+    free(counters);
+    munmap(map.base, map.len);
+    (void)sink;
+
+    for (p = 2; p < npoints; p++)
+    {
+        if (bandwidth[p] > bandwidth[peak])
+        {
+            peak = p;
+        }
+    }
+    status = clc_add_metric(result, "peak_bandwidth", NULL, "B/s", (threads > 1) ? bandwidth[peak] : 0);
+    if (status == CPUBENCH_OK)
+    {
+        status = clc_add_metric(result, "idle_latency", NULL, "ns", latency[0]);
+    }
+    if (status == CPUBENCH_OK && threads > 1)
+    {
+        status = clc_add_metric(result, "latency_at_peak", NULL, "ns", latency[peak]);
+    }
+
+    /* The curve, from idle to unthrottled */
+    for (p = 1; p < npoints && status == CPUBENCH_OK; p++)
+    {
+        snprintf(label, sizeof(label), "delay %ld ns", clc_injection_delays[p]);
+        status = clc_add_metric(result, "loaded_bandwidth", label, "B/s", bandwidth[p]);
+        if (status == CPUBENCH_OK)
+        {
+            status = clc_add_metric(result, "loaded_latency", label, "ns", latency[p]);
+        }
+    }
+    return status;
+}
+
+/* A GEMM micro-kernel: adds the product of an mr x kc panel of A and a kc x nr panel of B,
+ * both packed, to the mr x nr tile of C at c with row stride ldc */
+struct clc_gemm_kernel
+{
+    const char *name;
+    int mr;
+    int nr;
+    /* Elements per vector register, for the theoretical peak */
+    int lanes;
+    void (*run)(int kc, const void *a, const void *b, void *c, size_t ldc);
+};
+
+/* Portable 4x4 kernels, left to the compiler to vectorize */
+static void clc_dgemm_4x4(int kc, const void *pa, const void *pb, void *pc, size_t ldc)
+{
+    const double *a = pa, *b = pb;
+    double *c = pc;
+    double acc[4][4] = { { 0 } };
+    int p, r, j;
+
+    for (p = 0; p < kc; p++, a += 4, b += 4)
+    {
+        for (r = 0; r < 4; r++)
+        {
+            for (j = 0; j < 4; j++)
+            {
+                acc[r][j] += a[r] * b[j];
+            }
+        }
+    }
+    for (r = 0; r < 4; r++)
+    {
+        for (j = 0; j < 4; j++)
+        {
+            c[r * ldc + j] += acc[r][j];
+        }
+    }
+}
+
+static void clc_sgemm_4x4(int kc, const void *pa, const void *pb, void *pc, size_t ldc)
+{
+    const float *a = pa, *b = pb;
+    float *c = pc;
+    float acc[4][4] = { { 0 } };
+    int p, r, j;
+
+    for (p = 0; p < kc; p++, a += 4, b += 4)
+    {
+        for (r = 0; r < 4; r++)
+        {
+            for (j = 0; j < 4; j++)
+            {
+                acc[r][j] += a[r] * b[j];
+            }
+        }
+    }
+    for (r = 0; r < 4; r++)
+    {
+        for (j = 0; j < 4; j++)
+        {
+            c[r * ldc + j] += acc[r][j];
+        }
+    }
+}
+
+#ifdef CLC_HAVE_X86_SIMD
+/* 6 rows of A broadcast against two vectors of B, twelve accumulators. The packed B panels
+ * are 64-byte aligned, C may not be */
+__attribute__((target("avx2,fma")))
+static void clc_dgemm_6x8_avx2(int kc, const void *pa, const void *pb, void *pc, size_t ldc)
+{
+    const double *a = pa, *b = pb;
+    double *c = pc;
+    __m256d acc[6][2];
+    int p, r;
+
+    for (r = 0; r < 6; r++)
+    {
+        acc[r][0] = acc[r][1] = _mm256_setzero_pd();
+    }
+    for (p = 0; p < kc; p++, a += 6, b += 8)
+    {
+        __m256d b0 = _mm256_load_pd(b), b1 = _mm256_load_pd(b + 4);
+        for (r = 0; r < 6; r++)
+        {
+            __m256d ar = _mm256_broadcast_sd(a + r);
+            acc[r][0] = _mm256_fmadd_pd(ar, b0, acc[r][0]);
+            acc[r][1] = _mm256_fmadd_pd(ar, b1, acc[r][1]);
+        }
+    }
+    for (r = 0; r < 6; r++)
+    {
+        _mm256_storeu_pd(c + r * ldc, _mm256_add_pd(_mm256_loadu_pd(c + r * ldc), acc[r][0]));
+        _mm256_storeu_pd(c + r * ldc + 4, _mm256_add_pd(_mm256_loadu_pd(c + r * ldc + 4), acc[r][1]));
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void clc_sgemm_6x16_avx2(int kc, const void *pa, const void *pb, void *pc, size_t ldc)
+{
+    const float *a = pa, *b = pb;
+    float *c = pc;
+    __m256 acc[6][2];
+    int p, r;
+
+    for (r = 0; r < 6; r++)
+    {
+        acc[r][0] = acc[r][1] = _mm256_setzero_ps();
+    }
+    for (p = 0; p < kc; p++, a += 6, b += 16)
+    {
+        __m256 b0 = _mm256_load_ps(b), b1 = _mm256_load_ps(b + 8);
+        for (r = 0; r < 6; r++)
+        {
+            __m256 ar = _mm256_broadcast_ss(a + r);
+            acc[r][0] = _mm256_fmadd_ps(ar, b0, acc[r][0]);
+            acc[r][1] = _mm256_fmadd_ps(ar, b1, acc[r][1]);
+        }
+    }
+    for (r = 0; r < 6; r++)
+    {
+        _mm256_storeu_ps(c + r * ldc, _mm256_add_ps(_mm256_loadu_ps(c + r * ldc), acc[r][0]));
+        _mm256_storeu_ps(c + r * ldc + 8, _mm256_add_ps(_mm256_loadu_ps(c + r * ldc + 8), acc[r][1]));
+    }
+}
+
+__attribute__((target("avx512f")))
+static void clc_dgemm_6x16_avx512(int kc, const void *pa, const void *pb, void *pc, size_t ldc)
+{
+    const double *a = pa, *b = pb;
+    double *c = pc;
+    __m512d acc[6][2];
+    int p, r;
+
+    for (r = 0; r < 6; r++)
+    {
+        acc[r][0] = acc[r][1] = _mm512_setzero_pd();
+    }
+    for (p = 0; p < kc; p++, a += 6, b += 16)
+    {
+        __m512d b0 = _mm512_load_pd(b), b1 = _mm512_load_pd(b + 8);
+        for (r = 0; r < 6; r++)
+        {
+            __m512d ar = _mm512_set1_pd(a[r]);
+            acc[r][0] = _mm512_fmadd_pd(ar, b0, acc[r][0]);
+            acc[r][1] = _mm512_fmadd_pd(ar, b1, acc[r][1]);
+        }
+    }
+    for (r = 0; r < 6; r++)
+    {
+        _mm512_storeu_pd(c + r * ldc, _mm512_add_pd(_mm512_loadu_pd(c + r * ldc), acc[r][0]));
+        _mm512_storeu_pd(c + r * ldc + 8, _mm512_add_pd(_mm512_loadu_pd(c + r * ldc + 8), acc[r][1]));
+    }
+}
+
+__attribute__((target("avx512f")))
+static void clc_sgemm_6x32_avx512(int kc, const void *pa, const void *pb, void *pc, size_t ldc)
+{
+    const float *a = pa, *b = pb;
+    float *c = pc;
+    __m512 acc[6][2];
+    int p, r;
+
+    for (r = 0; r < 6; r++)
+    {
+        acc[r][0] = acc[r][1] = _mm512_setzero_ps();
+    }
+    for (p = 0; p < kc; p++, a += 6, b += 32)
+    {
+        __m512 b0 = _mm512_load_ps(b), b1 = _mm512_load_ps(b + 16);
+        for (r = 0; r < 6; r++)
+        {
+            __m512 ar = _mm512_set1_ps(a[r]);
+            acc[r][0] = _mm512_fmadd_ps(ar, b0, acc[r][0]);
+            acc[r][1] = _mm512_fmadd_ps(ar, b1, acc[r][1]);
+        }
+    }
+    for (r = 0; r < 6; r++)
+    {
+        _mm512_storeu_ps(c + r * ldc, _mm512_add_ps(_mm512_loadu_ps(c + r * ldc), acc[r][0]));
+        _mm512_storeu_ps(c + r * ldc + 16, _mm512_add_ps(_mm512_loadu_ps(c + r * ldc + 16), acc[r][1]));
+    }
+}
+#endif
+
+/* Kernels from best to most portable, per precision */
+static const struct clc_gemm_kernel clc_dgemm_kernels[] =
+{
+#ifdef CLC_HAVE_X86_SIMD
+    { "avx512", 6, 16, 8, clc_dgemm_6x16_avx512 },
+    { "avx2", 6, 8, 4, clc_dgemm_6x8_avx2 },
+#endif
+    { "generic", 4, 4, 1, clc_dgemm_4x4 }
+};
+static const struct clc_gemm_kernel clc_sgemm_kernels[] =
+{
+#ifdef CLC_HAVE_X86_SIMD
+    { "avx512", 6, 32, 16, clc_sgemm_6x32_avx512 },
+    { "avx2", 6, 16, 8, clc_sgemm_6x16_avx2 },
+#endif
+    { "generic", 4, 4, 1, clc_sgemm_4x4 }
+};
+
+/* Best kernel the CPU supports */
+static const struct clc_gemm_kernel *clc_gemm_kernel(int single, int generic)
+{
+    const struct clc_gemm_kernel *kernels = single ? clc_sgemm_kernels : clc_dgemm_kernels;
+    size_t count = single ? sizeof(clc_sgemm_kernels) / sizeof(*clc_sgemm_kernels) : sizeof(clc_dgemm_kernels) / sizeof(*clc_dgemm_kernels);
+
+#ifdef CLC_HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (!generic && __builtin_cpu_supports("avx512f"))
+    {
+        return &kernels[0];
+    }
+    if (!generic && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        return &kernels[1];
+    }
+#endif
+    (void)generic;
+    return &kernels[count - 1];
+}
+
+/* Element i of a GEMM matrix, as double or float */
+#define CLC_ELEM(m, i, single) ((single) ? (double)((float *)(m))[i] : ((double *)(m))[i])
+
+/* Pack rows [i0, i0 + mc) x columns [p0, p0 + kc) of the row-major matrix a with row stride
+ * ld into panels of mr rows, stored column by column, multiplied by scale and padded with zeros */
+static void clc_gemm_pack_a(const void *a, size_t ld, int single, size_t i0, size_t mc, size_t p0, size_t kc, int mr, double scale, void *dst)
+{
+    size_t ir, p;
+    int r;
+
+    for (ir = 0; ir < mc; ir += (size_t)mr)
+    {
+        for (p = 0; p < kc; p++)
+        {
+            for (r = 0; r < mr; r++)
+            {
+                size_t at = (ir / (size_t)mr) * (size_t)mr * kc + p * (size_t)mr + (size_t)r;
+                double v = (ir + (size_t)r < mc) ? scale * CLC_ELEM(a, (i0 + ir + (size_t)r) * ld + p0 + p, single) : 0;
+                if (single)
+                {
+                    ((float *)dst)[at] = (float)v;
+                }
+                else
+                {
+                    ((double *)dst)[at] = v;
+                }
+            }
+        }
+    }
+}
+
+/* Pack one panel of nr columns from j0 over rows [p0, p0 + kc) of b, stored row by row */
+static void clc_gemm_pack_b(const void *b, size_t ld, int single, size_t p0, size_t kc, size_t j0, size_t ncols, int nr, void *dst)
+{
+    size_t p;
+    int j;
+
+    for (p = 0; p < kc; p++)
+    {
+        for (j = 0; j < nr; j++)
+        {
+            double v = ((size_t)j < ncols) ? CLC_ELEM(b, (p0 + p) * ld + j0 + (size_t)j, single) : 0;
+            if (single)
+            {
+                ((float *)dst)[p * (size_t)nr + (size_t)j] = (float)v;
+            }
+            else
+            {
+                ((double *)dst)[p * (size_t)nr + (size_t)j] = v;
+            }
+        }
+    }
+}
+
+/* Add the product of a packed mb x kc block of A and a packed kc x nc slab of B to the block of
+ * C at c, with row stride ldc. Partial tiles at the edges go through a scratch tile */
+static void clc_gemm_block(const struct clc_gemm_kernel *k, int single, size_t mb, size_t nc, size_t kc, const char *apack, const char *bpack, char *c, size_t ldc)
+{
+    char tile[CLC_GEMM_MAX_MR * CLC_GEMM_MAX_NR * sizeof(double)] __attribute__((aligned(64)));
+    size_t es = single ? sizeof(float) : sizeof(double);
+    size_t ir, jr, r, j;
+
+    for (jr = 0; jr < nc; jr += (size_t)k->nr)
+    {
+        for (ir = 0; ir < mb; ir += (size_t)k->mr)
+        {
+            const char *ap = apack + ir * kc * es;
+            const char *bp = bpack + jr * kc * es;
+            char *cp = c + (ir * ldc + jr) * es;
+            size_t rows = (mb - ir < (size_t)k->mr) ? mb - ir : (size_t)k->mr;
+            size_t cols = (nc - jr < (size_t)k->nr) ? nc - jr : (size_t)k->nr;
+
+            if (rows == (size_t)k->mr && cols == (size_t)k->nr)
+            {
+                k->run((int)kc, ap, bp, cp, ldc);
+                continue;
+            }
+
+            memset(tile, 0, sizeof(tile));
+            k->run((int)kc, ap, bp, tile, (size_t)k->nr);
+            for (r = 0; r < rows; r++)
+            {
+                for (j = 0; j < cols; j++)
+                {
+                    if (single)
+                    {
+                        ((float *)cp)[r * ldc + j] += ((float *)tile)[r * (size_t)k->nr + j];
+                    }
+                    else
+                    {
+                        ((double *)cp)[r * ldc + j] += ((double *)tile)[r * (size_t)k->nr + j];
+                    }
+                }
+            }
+        }
+    }
+}
+
+/* C = A * B, blocked for the cache hierarchy. B slabs are packed by all threads together, then
+ * every thread takes whole mc row blocks of A through its own packing buffer */
+static void clc_gemm_multiply(const struct clc_gemm_kernel *k, const cpubench_params *params, int threads, size_t n, size_t mc,
+                              const void *a, const void *b, void *c, char *bpack, char *apacks)
+{
+    int single = params->u.gemm.single;
+    size_t es = single ? sizeof(float) : sizeof(double);
+    size_t jc, pc;
+
+    memset(c, 0, n * n * es);
+
+    #pragma omp parallel num_threads (threads) private (jc, pc)
+    {
+        char *apack = apacks + (size_t)omp_get_thread_num() * (mc + CLC_GEMM_MAX_MR) * CLC_GEMM_KC * es;
+        clc_place_worker(params, omp_get_thread_num());
+
+        for (jc = 0; jc < n; jc += CLC_GEMM_NC)
+        {
+            size_t nc = (n - jc < CLC_GEMM_NC) ? n - jc : CLC_GEMM_NC;
+            for (pc = 0; pc < n; pc += CLC_GEMM_KC)
+            {
+                size_t kc = (n - pc < CLC_GEMM_KC) ? n - pc : CLC_GEMM_KC;
+                size_t jr, ic;
+
+                #pragma omp for schedule (static)
+                for (jr = 0; jr < nc; jr += (size_t)k->nr)
+                {
+                    clc_gemm_pack_b(b, n, single, pc, kc, jc + jr, (nc - jr < (size_t)k->nr) ? nc - jr : (size_t)k->nr, k->nr, bpack + jr * kc * es);
+                }
+
+                #pragma omp for schedule (dynamic)
+                for (ic = 0; ic < n; ic += mc)
+                {
+                    size_t mb = (n - ic < mc) ? n - ic : mc;
+                    clc_gemm_pack_a(a, n, single, ic, mb, pc, kc, k->mr, 1.0, apack);
+                    clc_gemm_block(k, single, mb, nc, kc, apack, bpack, (char *)c + (ic * n + jc) * es, n);
+                }
+            }
+        }
+    }
+}
+
+/* Entries of the GEMM inputs: small integers, so every product and sum is exact in either
+ * precision and the result doesn't depend on the order of the additions */
+static __inline__ int clc_gemm_a(size_t i, size_t k)
+{
+    return (int)((i * 7 + k * 3) % 9) - 4;
+}
+
+static __inline__ int clc_gemm_b(size_t k, size_t j)
+{
+    return (int)((k * 5 + j * 11) % 7) - 3;
+}
+
+/* Clock frequency of the calling core right now, from a chain of dependent adds that retire
+ * one per cycle. 0 where we can't measure it */
+static double clc_measure_frequency(void)
+{
+#ifdef CLC_HAVE_X86_SIMD
+    unsigned long long x = 0, start, rounds;
+
+    start = cpubench_timer_now();
+    for (rounds = 0; rounds < 1000000; rounds++)
+    {
+        __asm__ __volatile__("add $1, %0\n\tadd $1, %0\n\tadd $1, %0\n\tadd $1, %0\n\t"
+                             "add $1, %0\n\tadd $1, %0\n\tadd $1, %0\n\tadd $1, %0\n\t"
+                             "add $1, %0\n\tadd $1, %0\n\tadd $1, %0\n\tadd $1, %0\n\t"
+                             "add $1, %0\n\tadd $1, %0\n\tadd $1, %0\n\tadd $1, %0" : "+r"(x));
+    }
+    return (double)x / cpubench_timer_seconds(cpubench_timer_now() - start);
+#else
+    return 0;
+#endif
+}
+
+/* Physical cores the threads of a run occupy. SMT siblings share their core's FMA pipes, so two
+ * threads on one core count once. Pinned runs count the cores of the CPUs the threads go to,
+ * floating ones assume the scheduler spreads them over the cores first */
+static int clc_cores_used(const cpubench_params *params, int threads)
+{
+    cpubench_topology topology;
+    int cores = 0, t, u, c;
+
+    if (cpubench_topology_read(&topology) != CPUBENCH_OK)
+    {
+        return threads;
+    }
+    if (cpubench_cpumask_count(&params->cpus) == 0)
+    {
+        cores = (topology.ncores > 0 && topology.ncores < threads) ? topology.ncores : threads;
+        cpubench_topology_clear(&topology);
+        return cores;
+    }
+    for (t = 0; t < threads; t++)
+    {
+        const cpubench_cpu_info *mine = NULL, *other = NULL;
+        int cpu = clc_nth_cpu(&params->cpus, t), seen = 0;
+
+        for (c = 0; c < topology.ncpus; c++)
+        {
+            mine = (topology.cpus[c].cpu == cpu) ? &topology.cpus[c] : mine;
+        }
+        for (u = 0; u < t && mine != NULL && !seen; u++)
+        {
+            int earlier = clc_nth_cpu(&params->cpus, u);
+            for (c = 0, other = NULL; c < topology.ncpus; c++)
+            {
+                other = (topology.cpus[c].cpu == earlier) ? &topology.cpus[c] : other;
+            }
+            seen = (other != NULL && other->package_id == mine->package_id && other->core_id == mine->core_id);
+        }
+        cores += !seen;
+    }
+    cpubench_topology_clear(&topology);
+    return cores;
+}
+
+/* Theoretical peak in FLOP/s: two flops per FMA lane and CLC_FMA_PIPES pipes per core, at
+ * the measured frequency, or the highest one cpufreq reports, or the TSC frequency */
+static double clc_peak_flops(int lanes, int cores, double hz)
+{
+    double khz;
+
+    if (hz <= 0)
+    {
+        hz = clc_read_sysfs("/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq", &khz) ? khz * 1E3 : clc_timer.tsc_hz;
+    }
+    return 2.0 * lanes * CLC_FMA_PIPES * hz * cores;
+}
+
+/* Dense matrix multiply */
+static cpubench_status clc_gemm(cpubench_ctx *ctx, const cpubench_params *params, cpubench_result *result)
+{
+    const struct clc_gemm_kernel *k = clc_gemm_kernel(params->u.gemm.single, params->u.gemm.generic);
+    const struct clc_gemm_kernel *best = clc_gemm_kernel(params->u.gemm.single, 0);
+    int single = params->u.gemm.single;
+    size_t n = params->u.gemm.n;
+    size_t es = single ? sizeof(float) : sizeof(double);
+    int threads = clc_threads(ctx, params);
+    unsigned long long checksum = 0, start;
+    double seconds = 0;
+    char label[64];
+    int rep, bad = 0;
+    size_t i, j, s;
+    cpubench_status status;
+
+    if (n < 1 || n > 65536 || params->u.gemm.ntimes < 1)
+    {
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+
+    /* Enough row blocks that every thread gets one */
+    size_t mc = (n + (size_t)threads - 1) / (size_t)threads;
+    mc = ((mc + (size_t)k->mr - 1) / (size_t)k->mr) * (size_t)k->mr;
+    if (mc > CLC_GEMM_MC)
+    {
+        mc = CLC_GEMM_MC;
+    }
+
+    /* A, B, C, the shared B slab and one A block per thread, each 64-byte aligned */
+    size_t matrix = ((n * n * es) + 63) & ~(size_t)63;
+    size_t slab = (((size_t)CLC_GEMM_NC + CLC_GEMM_MAX_NR) * CLC_GEMM_KC * es + 63) & ~(size_t)63;
+    size_t block = (mc + CLC_GEMM_MAX_MR) * CLC_GEMM_KC * es;
+    char *mem = clc_scratch(ctx, params, 3 * matrix + slab + (size_t)threads * block);
+    if (mem == NULL)
+    {
+        return CPUBENCH_ERR_NOMEM;
+    }
+    void *a = mem, *b = mem + matrix, *c = mem + 2 * matrix;
+
+    for (i = 0; i < n; i++)
+    {
+        for (j = 0; j < n; j++)
+        {
+            if (single)
+            {
+                ((float *)a)[i * n + j] = (float)clc_gemm_a(i, j);
+                ((float *)b)[i * n + j] = (float)clc_gemm_b(i, j);
+            }
+            else
+            {
+                ((double *)a)[i * n + j] = clc_gemm_a(i, j);
+                ((double *)b)[i * n + j] = clc_gemm_b(i, j);
+            }
+        }
+    }
+
+    /* One untimed multiply warms caches and page tables */
+    start = cpubench_timer_now();
+    for (rep = 0; rep <= params->u.gemm.ntimes; rep++)
+    {
+        unsigned long long t0 = cpubench_timer_now();
+        clc_gemm_multiply(k, params, threads, n, mc, a, b, c, mem + 3 * matrix, mem + 3 * matrix + slab);
+        double t = cpubench_timer_seconds(cpubench_timer_now() - t0);
+        if (rep > 0 && (seconds == 0 || t < seconds))
+        {
+            seconds = t;
+        }
+        if (ctx->progress_cb != NULL)
+        {
+            clc_progress(ctx, CPUBENCH_WORKLOAD_GEMM, (unsigned long long)(rep + 1), (unsigned long long)params->u.gemm.ntimes + 1, start);
+        }
+    }
+
+    /* Right after the multiplies, so it reflects any frequency drop under vector load */
+    double hz = clc_measure_frequency();
+
+    /* Spot check entries against a plain dot product, then fold every entry into the checksum */
+    for (s = 0; s < 64; s++)
+    {
+        long long dot = 0;
+        size_t kk;
+        i = (s * 2654435761UL) % n;
+        j = (s * 40503UL + 17) % n;
+        for (kk = 0; kk < n; kk++)
+        {
+            dot += (long long)clc_gemm_a(i, kk) * clc_gemm_b(kk, j);
+        }
+        bad |= (CLC_ELEM(c, i * n + j, single) != (double)dot);
+    }
+    for (i = 0; i < n * n; i++)
+    {
+        checksum += (unsigned long long)(long long)CLC_ELEM(c, i, single) * ((i % 1009) + 1);
+    }
+    snprintf(label, sizeof(label), "%s %lu %llu", bad ? "invalid" : "valid", (unsigned long)n, checksum);
+    clc_md5(label, result->checksum);
+
+    result->threads = threads;
+    result->seconds = seconds;
+    result->count = 2ULL * n * n * n;
+
+    double flops = 2.0 * (double)n * (double)n * (double)n / seconds;
+    double peak = clc_peak_flops(best->lanes, clc_cores_used(params, threads), hz);
+    snprintf(label, sizeof(label), "%s %s %dx%d", single ? "sgemm" : "dgemm", k->name, k->mr, k->nr);
+    status = clc_add_metric(result, "flops", label, "FLOP/s", flops);
+    if (status == CPUBENCH_OK && peak > 0)
+    {
+        snprintf(label, sizeof(label), "%s, %d lanes x %d FMA pipes", best->name, best->lanes, CLC_FMA_PIPES);
+        status = clc_add_metric(result, "peak_flops", label, "FLOP/s", peak);
+        if (status == CPUBENCH_OK)
+        {
+            status = clc_add_metric(result, "peak_percent", NULL, "%", 100 * flops / peak);
+        }
+        if (status == CPUBENCH_OK && hz > 0)
+        {
+            status = clc_add_metric(result, "frequency", NULL, "Hz", hz);
+        }
+    }
+    return status;
+}
+
+/* splitmix64: successive z give independent looking 64-bit values */
+static __inline__ unsigned long long clc_mix64(unsigned long long z)
+{
+    z += 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/* A uniform value in [-0.5, 0.5) from any 64-bit position */
+static __inline__ double clc_unit_hash(unsigned long long z)
+{
+    return (double)(clc_mix64(z) >> 11) * (1.0 / 9007199254740992.0) - 0.5;
+}
+
+/* Entries of the HPL matrix (j < n) and right-hand side (j == n), computed from the position
+ * alone, so the residual check regenerates A instead of keeping a copy */
+static __inline__ double clc_hpl_entry(unsigned long long i, unsigned long long j, unsigned long long n)
+{
+    return clc_unit_hash(i * (n + 1) + j);
+}
+
+/* Apply the row swaps of the panel at c0 to columns [j0, j0 + wj) */
+static void clc_hpl_swap(double *a, size_t lda, size_t c0, size_t w, const size_t *piv, size_t j0, size_t wj)
+{
+    size_t c, j;
+
+    for (c = c0; c < c0 + w; c++)
+    {
+        if (piv[c] != c)
+        {
+            for (j = j0; j < j0 + wj; j++)
+            {
+                double t = a[c * lda + j];
+                a[c * lda + j] = a[piv[c] * lda + j];
+                a[piv[c] * lda + j] = t;
+            }
+        }
+    }
+}
+
+/* Solve rows [c0, c0 + w) of columns [j0, j0 + wj) with the unit lower triangle at c0 */
+static void clc_hpl_trsm(double *a, size_t lda, size_t c0, size_t w, size_t j0, size_t wj)
+{
+    size_t r, q, j;
+
+    for (r = c0 + 1; r < c0 + w; r++)
+    {
+        double *row = a + r * lda + j0;
+        for (q = c0; q < r; q++)
+        {
+            double l = a[r * lda + q];
+            const double *u = a + q * lda + j0;
+            for (j = 0; j < wj; j++)
+            {
+                row[j] -= l * u[j];
+            }
+        }
+    }
+}
+
+/* LU with partial pivoting of columns [c0, c0 + w) over rows [c0, n). Recursive halving keeps the
+ * number of passes over the tall panel logarithmic in w, narrow panels are done column by column.
+ * Swaps only move the panel, the rest of each row follows when its column block is updated */
+static void clc_hpl_panel(double *a, size_t lda, size_t n, size_t c0, size_t w, size_t *piv)
+{
+    size_t c, i, j, q;
+
+    if (w > CLC_HPL_PANEL_MIN)
+    {
+        size_t w1 = w / 2, c1 = c0 + w1, w2 = w - w1;
+
+        clc_hpl_panel(a, lda, n, c0, w1, piv);
+        clc_hpl_swap(a, lda, c0, w1, piv, c1, w2);
+        clc_hpl_trsm(a, lda, c0, w1, c1, w2);
+        for (i = c1; i < n; i++)
+        {
+            double *row = a + i * lda;
+            for (q = c0; q < c1; q++)
+            {
+                double l = row[q];
+                const double *u = a + q * lda;
+                for (j = c1; j < c0 + w; j++)
+                {
+                    row[j] -= l * u[j];
+                }
+            }
+        }
+        clc_hpl_panel(a, lda, n, c1, w2, piv);
+        clc_hpl_swap(a, lda, c1, w2, piv, c0, w1);
+        return;
+    }
+
+    for (c = c0; c < c0 + w; c++)
+    {
+        double best = fabs(a[c * lda + c]);
+        size_t p = c;
+
+        for (i = c + 1; i < n; i++)
+        {
+            if (fabs(a[i * lda + c]) > best)
+            {
+                best = fabs(a[i * lda + c]);
+                p = i;
+            }
+        }
+        piv[c] = p;
+        if (p != c)
+        {
+            for (j = c0; j < c0 + w; j++)
+            {
+                double t = a[c * lda + j];
+                a[c * lda + j] = a[p * lda + j];
+                a[p * lda + j] = t;
+            }
+        }
+        /* Singular, the residual check will fail */
+        if (best == 0)
+        {
+            continue;
+        }
+
+        double inv = 1.0 / a[c * lda + c];
+        const double *u = a + c * lda;
+        for (i = c + 1; i < n; i++)
+        {
+            double *row = a + i * lda;
+            double l = (row[c] *= inv);
+            for (j = c + 1; j < c0 + w; j++)
+            {
+                row[j] -= l * u[j];
+            }
+        }
+    }
+}
+
+/* Bring the U rows of column block [j0, j0 + wj) up to date with the panel at c0: swap, solve
+ * with the panel's unit lower triangle, and pack the result for the trailing update */
+static void clc_hpl_solve_block(const struct clc_gemm_kernel *k, double *a, size_t lda, size_t c0, size_t w, const size_t *piv,
+                                size_t j0, size_t wj, char *upack)
+{
+    size_t j;
+
+    clc_hpl_swap(a, lda, c0, w, piv, j0, wj);
+    clc_hpl_trsm(a, lda, c0, w, j0, wj);
+    for (j = 0; j < wj; j += (size_t)k->nr)
+    {
+        clc_gemm_pack_b(a, lda, 0, c0, w, j0 + j, (wj - j < (size_t)k->nr) ? wj - j : (size_t)k->nr, k->nr, upack + j * w * sizeof(double));
+    }
+}
+
+/* Blocked right-looking LU with partial pivoting. Every step packs the panel's L (negated) and
+ * the solved U rows once, then the trailing update runs on mc-row tiles of every column block.
+ * Thread 0 updates the next panel first and factors it while the others carry on with the rest
+ * of the trailing matrix, so panel factorization stays off the critical path */
+static void clc_hpl_factor(cpubench_ctx *ctx, const struct clc_gemm_kernel *k, const cpubench_params *params, int threads,
+                           double *a, size_t lda, size_t n, size_t nb, size_t *piv, char *lpack, char *upacks, unsigned long long start)
+{
+    size_t nblocks = (n + nb - 1) / nb;
+    size_t ustride = (nb + CLC_GEMM_MAX_NR) * nb * sizeof(double);
+    size_t mc = CLC_GEMM_MC;
+
+    #pragma omp parallel num_threads (threads)
+    {
+        size_t kb, t;
+        clc_place_worker(params, omp_get_thread_num());
+
+        #pragma omp single
+        clc_hpl_panel(a, lda, n, 0, (nb < n) ? nb : n, piv);
+
+        for (kb = 0; kb + 1 < nblocks; kb++)
+        {
+            size_t c0 = kb * nb, m0 = c0 + nb;
+            size_t nchunks = (n - m0 + mc - 1) / mc;
+            size_t nright = nblocks - kb - 1;
+
+            /* Pack L by row chunks and solve U by column blocks */
+            #pragma omp for schedule (dynamic)
+            for (t = 0; t < nchunks + nright; t++)
+            {
+                if (t < nchunks)
+                {
+                    size_t ic = m0 + t * mc;
+                    clc_gemm_pack_a(a, lda, 0, ic, (n - ic < mc) ? n - ic : mc, c0, nb, k->mr, -1.0, lpack + (ic - m0) * nb * sizeof(double));
+                }
+                else
+                {
+                    size_t j0 = m0 + (t - nchunks) * nb;
+                    clc_hpl_solve_block(k, a, lda, c0, nb, piv, j0, (n - j0 < nb) ? n - j0 : nb, upacks + (t - nchunks) * ustride);
+                }
+            }
+
+            /* Look-ahead: the next panel is updated and factored by thread 0 alone */
+            if (omp_get_thread_num() == 0)
+            {
+                size_t w = (n - m0 < nb) ? n - m0 : nb;
+                size_t ic;
+                for (ic = m0; ic < n; ic += mc)
+                {
+                    clc_gemm_block(k, 0, (n - ic < mc) ? n - ic : mc, w, nb, lpack + (ic - m0) * nb * sizeof(double), upacks,
+                                   (char *)(a + ic * lda + m0), lda);
+                }
+                clc_hpl_panel(a, lda, n, m0, w, piv);
+                if (ctx->progress_cb != NULL)
+                {
+                    unsigned long long left = (unsigned long long)(n - m0 - w);
+                    clc_progress(ctx, CPUBENCH_WORKLOAD_HPL, (unsigned long long)n * n * n - left * left * left,
+                                 (unsigned long long)n * n * n, start);
+                }
+            }
+
+            #pragma omp for schedule (dynamic) nowait
+            for (t = 0; t < nchunks * (nright - 1); t++)
+            {
+                size_t ic = m0 + (t % nchunks) * mc;
+                size_t jb = 1 + t / nchunks;
+                size_t j0 = m0 + jb * nb;
+                clc_gemm_block(k, 0, (n - ic < mc) ? n - ic : mc, (n - j0 < nb) ? n - j0 : nb, nb, lpack + (ic - m0) * nb * sizeof(double),
+                               upacks + jb * ustride, (char *)(a + ic * lda + j0), lda);
+            }
+            #pragma omp barrier
+        }
+
+        /* Later swaps never reached the L columns left of their panel */
+        #pragma omp for schedule (dynamic)
+        for (t = 0; t < nblocks - 1; t++)
+        {
+            for (kb = t + 1; kb < nblocks; kb++)
+            {
+                clc_hpl_swap(a, lda, kb * nb, (n - kb * nb < nb) ? n - kb * nb : nb, piv, t * nb, nb);
+            }
+        }
+    }
+}
+
+/* Solve LUx = Pb in place */
+static void clc_hpl_solve(const double *a, size_t lda, size_t n, const size_t *piv, double *x)
+{
+    size_t i, j;
+
+    for (i = 0; i < n; i++)
+    {
+        if (piv[i] != i)
+        {
+            double t = x[i];
+            x[i] = x[piv[i]];
+            x[piv[i]] = t;
+        }
+    }
+    for (i = 1; i < n; i++)
+    {
+        double sum = x[i];
+        for (j = 0; j < i; j++)
+        {
+            sum -= a[i * lda + j] * x[j];
+        }
+        x[i] = sum;
+    }
+    for (i = n; i-- > 0; )
+    {
+        double sum = x[i];
+        for (j = i + 1; j < n; j++)
+        {
+            sum -= a[i * lda + j] * x[j];
+        }
+        x[i] = sum / a[i * lda + i];
+    }
+}
+
+/* HPL-style dense linear solve */
+static cpubench_status clc_hpl(cpubench_ctx *ctx, const cpubench_params *params, cpubench_result *result)
+{
+    const struct clc_gemm_kernel *k = clc_gemm_kernel(0, params->u.hpl.generic);
+    const struct clc_gemm_kernel *best = clc_gemm_kernel(0, 0);
+    size_t n = params->u.hpl.n;
+    size_t nb = (size_t)params->u.hpl.nb;
+    int threads = clc_threads(ctx, params);
+    double anorm = 0, bnorm = 0, xnorm = 0, rnorm = 0;
+    unsigned long long start;
+    char label[64];
+    size_t i;
+    cpubench_status status;
+
+    if (n < 1 || n > 65536 || nb < 1 || nb > CLC_GEMM_KC)
+    {
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+    if (nb > n)
+    {
+        nb = n;
+    }
+
+    /* Rows an odd number of cache lines apart, so the columns of a panel don't all land in the
+     * same few cache sets when n is a multiple of a large power of two */
+    size_t lda = (((n + 7) / 8) | 1) * 8;
+
+    /* A, x, the pivots, the packed L panel and one packed U block per column block */
+    size_t nblocks = (n + nb - 1) / nb;
+    size_t matrix = ((n * lda * sizeof(double)) + 63) & ~(size_t)63;
+    size_t vector = ((n * sizeof(double)) + 63) & ~(size_t)63;
+    size_t lpack = (((n + CLC_GEMM_MC) * nb * sizeof(double)) + 63) & ~(size_t)63;
+    size_t upacks = nblocks * (nb + CLC_GEMM_MAX_NR) * nb * sizeof(double);
+    char *mem = clc_scratch(ctx, params, matrix + 2 * vector + lpack + upacks);
+    if (mem == NULL)
+    {
+        return CPUBENCH_ERR_NOMEM;
+    }
+    double *a = (double *)mem, *x = (double *)(mem + matrix);
+    size_t *piv = (size_t *)(mem + matrix + vector);
+
+    #pragma omp parallel num_threads (threads)
+    {
+        clc_place_worker(params, omp_get_thread_num());
+
+        #pragma omp for schedule (static)
+        for (i = 0; i < n; i++)
+        {
+            size_t j;
+            for (j = 0; j < n; j++)
+            {
+                a[i * lda + j] = clc_hpl_entry(i, j, n);
+            }
+        }
+    }
+    for (i = 0; i < n; i++)
+    {
+        x[i] = clc_hpl_entry(i, n, n);
+    }
+
+    start = cpubench_timer_now();
+    clc_hpl_factor(ctx, k, params, threads, a, lda, n, nb, piv, mem + matrix + 2 * vector, mem + matrix + 2 * vector + lpack, start);
+    clc_hpl_solve(a, lda, n, piv, x);
+    double seconds = cpubench_timer_seconds(cpubench_timer_now() - start);
+    double hz = clc_measure_frequency();
+
+    /* ||Ax - b|| / (eps * (||A|| * ||x|| + ||b||) * n) in the infinity norm, on a regenerated A */
+    #pragma omp parallel num_threads (threads) reduction (max : anorm, bnorm, rnorm)
+    {
+        clc_place_worker(params, omp_get_thread_num());
+
+        #pragma omp for schedule (static)
+        for (i = 0; i < n; i++)
+        {
+            double sum = 0, row = 0, bi = clc_hpl_entry(i, n, n);
+            size_t j;
+            for (j = 0; j < n; j++)
+            {
+                double aij = clc_hpl_entry(i, j, n);
+                sum += aij * x[j];
+                row += fabs(aij);
+            }
+            anorm = (row > anorm) ? row : anorm;
+            bnorm = (fabs(bi) > bnorm) ? fabs(bi) : bnorm;
+            rnorm = (fabs(sum - bi) > rnorm) ? fabs(sum - bi) : rnorm;
+        }
+    }
+    /* Written so that a NaN in x carries through and fails the check */
+    for (i = 0; i < n; i++)
+    {
+        xnorm = (fabs(x[i]) <= xnorm) ? xnorm : fabs(x[i]);
+    }
+    double residual = rnorm / ((DBL_EPSILON / 2) * (anorm * xnorm + bnorm) * (double)n);
+    int valid = (residual < CLC_HPL_THRESHOLD);
+
+    /* x itself depends on the order of the additions, so only the verdict goes in the checksum */
+    snprintf(label, sizeof(label), "%s %lu", valid ? "valid" : "invalid", (unsigned long)n);
+    clc_md5(label, result->checksum);
+
+    double ops = 2.0 / 3.0 * (double)n * (double)n * (double)n + 1.5 * (double)n * (double)n;
+    result->threads = threads;
+    result->seconds = seconds;
+    result->count = (unsigned long long)ops;
+
+    double flops = ops / seconds;
+    double peak = clc_peak_flops(best->lanes, clc_cores_used(params, threads), hz);
+    snprintf(label, sizeof(label), "n=%lu nb=%lu, %s %dx%d", (unsigned long)n, (unsigned long)nb, k->name, k->mr, k->nr);
+    status = clc_add_metric(result, "flops", label, "FLOP/s", flops);
+    if (status == CPUBENCH_OK)
+    {
+        status = clc_add_metric(result, "residual", valid ? "passed" : "failed", "", residual);
+    }
+    if (status == CPUBENCH_OK && peak > 0)
+    {
+        snprintf(label, sizeof(label), "%s, %d lanes x %d FMA pipes", best->name, best->lanes, CLC_FMA_PIPES);
+        status = clc_add_metric(result, "peak_flops", label, "FLOP/s", peak);
+        if (status == CPUBENCH_OK)
+        {
+            status = clc_add_metric(result, "peak_percent", NULL, "%", 100 * flops / peak);
+        }
+    }
+    return status;
+}
+
+/* 27-point operator on an n^3 grid in CSR form, plus the diagonal for symmetric Gauss-Seidel.
+ * Unknowns are numbered colour by colour, so every colour is one contiguous range of rows */
+struct clc_cg_matrix
+{
+    size_t n;
+    size_t rows;
+    size_t nnz;
+    size_t *start;
+    unsigned int *cols;
+    double *vals;
+    double *diag;
+    size_t colour[CLC_CG_COLOURS + 1];
+};
+
+/* HPCG's problem: 26 on the diagonal and -1 for every neighbour in the grid. The right-hand side
+ * is the row sum, so the exact solution is all ones */
+static void clc_cg_generate(const struct clc_cg_matrix *m, const unsigned int *point, const unsigned int *index, double *b)
+{
+    size_t n = m->n;
+    size_t row;
+
+    #pragma omp for schedule (static)
+    for (row = 0; row < m->rows; row++)
+    {
+        size_t g = point[row];
+        size_t ix = g % n, iy = (g / n) % n, iz = g / (n * n);
+        size_t at = m->start[row];
+        double sum = 0;
+        int dx, dy, dz;
+
+        for (dz = -1; dz <= 1; dz++)
+        {
+            for (dy = -1; dy <= 1; dy++)
+            {
+                for (dx = -1; dx <= 1; dx++)
+                {
+                    if ((dx < 0 && ix == 0) || (dx > 0 && ix == n - 1) || (dy < 0 && iy == 0) || (dy > 0 && iy == n - 1)
+                        || (dz < 0 && iz == 0) || (dz > 0 && iz == n - 1))
+                    {
+                        continue;
+                    }
+                    double v = (dx == 0 && dy == 0 && dz == 0) ? 26.0 : -1.0;
+                    m->cols[at] = index[g + (size_t)((long)dx + (long)n * ((long)dy + (long)n * dz))];
+                    m->vals[at++] = v;
+                    sum += v;
+                }
+            }
+        }
+        m->diag[row] = 26.0;
+        b[row] = sum;
+    }
+}
+
+/* y = A x */
+static void clc_cg_spmv(const struct clc_cg_matrix *m, const double *x, double *y)
+{
+    size_t row;
+
+    #pragma omp for schedule (static)
+    for (row = 0; row < m->rows; row++)
+    {
+        double sum = 0;
+        size_t e;
+        for (e = m->start[row]; e < m->start[row + 1]; e++)
+        {
+            sum += m->vals[e] * x[m->cols[e]];
+        }
+        y[row] = sum;
+    }
+}
+
+/* Relax one row of A x = r in place */
+static __inline__ void clc_cg_relax(const struct clc_cg_matrix *m, const double *r, double *x, size_t row)
+{
+    double sum = r[row];
+    size_t e;
+
+    for (e = m->start[row]; e < m->start[row + 1]; e++)
+    {
+        sum -= m->vals[e] * x[m->cols[e]];
+    }
+    x[row] += sum / m->diag[row];
+}
+
+/* One symmetric Gauss-Seidel sweep on A x = r, forward then backward. Rows of one colour don't
+ * depend on each other, so each colour is split over the threads, and the result is the same as
+ * a sequential sweep */
+static void clc_cg_symgs(const struct clc_cg_matrix *m, const double *r, double *x)
+{
+    size_t i;
+    int c;
+
+    for (c = 0; c < CLC_CG_COLOURS; c++)
+    {
+        #pragma omp for schedule (static)
+        for (i = m->colour[c]; i < m->colour[c + 1]; i++)
+        {
+            clc_cg_relax(m, r, x, i);
+        }
+    }
+    for (c = CLC_CG_COLOURS - 1; c >= 0; c--)
+    {
+        #pragma omp for schedule (static)
+        for (i = m->colour[c]; i < m->colour[c + 1]; i++)
+        {
+            clc_cg_relax(m, r, x, m->colour[c + 1] - 1 - (i - m->colour[c]));
+        }
+    }
+}
+
+/* x . y, seen by every thread. Partial sums over fixed chunks are added in order, so the result
+ * is identical for any number of threads */
+static double clc_cg_dot(const double *x, const double *y, size_t rows, double *partial)
+{
+    size_t nchunks = (rows + CLC_CG_CHUNK - 1) / CLC_CG_CHUNK;
+    double sum = 0;
+    size_t c, i;
+
+    #pragma omp for schedule (static)
+    for (c = 0; c < nchunks; c++)
+    {
+        size_t end = (c + 1) * CLC_CG_CHUNK;
+        double s = 0;
+        for (i = c * CLC_CG_CHUNK; i < end && i < rows; i++)
+        {
+            s += x[i] * y[i];
+        }
+        partial[c] = s;
+    }
+    for (c = 0; c < nchunks; c++)
+    {
+        sum += partial[c];
+    }
+    /* Nobody may overwrite the partial sums before everyone has added them up */
+    #pragma omp barrier
+    return sum;
+}
+
+/* w = alpha x + beta y */
+static void clc_cg_waxpby(size_t rows, double alpha, const double *x, double beta, const double *y, double *w)
+{
+    size_t i;
+
+    #pragma omp for schedule (static)
+    for (i = 0; i < rows; i++)
+    {
+        w[i] = alpha * x[i] + beta * y[i];
+    }
+}
+
+/* HPCG-style preconditioned conjugate gradient */
+static cpubench_status clc_hpcg(cpubench_ctx *ctx, const cpubench_params *params, cpubench_result *result)
+{
+    struct clc_cg_matrix m;
+    size_t n = params->u.hpcg.n;
+    int iterations = params->u.hpcg.iterations;
+    int threads = clc_threads(ctx, params);
+    double spmv_seconds = 0, symgs_seconds = 0, normr0 = 0, normr = 0;
+    unsigned long long start = 0;
+    double seconds = 0;
+    char label[64];
+    size_t row, i;
+    int c;
+    cpubench_status status;
+
+    if (n < 2 || n > 1024 || iterations < 1)
+    {
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+
+    /* Every row has a neighbour count of 2 or 3 in each dimension */
+    m.n = n;
+    m.rows = n * n * n;
+    m.nnz = (3 * n - 2) * (3 * n - 2) * (3 * n - 2);
+
+    /* The matrix, the numbering both ways, the six CG vectors and the partial sums, each 64-byte aligned */
+    size_t nchunks = (m.rows + CLC_CG_CHUNK - 1) / CLC_CG_CHUNK;
+    size_t vector = ((m.rows * sizeof(double)) + 63) & ~(size_t)63;
+    size_t starts = (((m.rows + 1) * sizeof(size_t)) + 63) & ~(size_t)63;
+    size_t cols = ((m.nnz * sizeof(unsigned int)) + 63) & ~(size_t)63;
+    size_t vals = ((m.nnz * sizeof(double)) + 63) & ~(size_t)63;
+    size_t order = ((m.rows * sizeof(unsigned int)) + 63) & ~(size_t)63;
+    char *mem = clc_scratch(ctx, params, starts + cols + vals + 2 * order + 7 * vector + nchunks * sizeof(double));
+    if (mem == NULL)
+    {
+        return CPUBENCH_ERR_NOMEM;
+    }
+    m.start = (size_t *)mem;
+    m.cols = (unsigned int *)(mem + starts);
+    m.vals = (double *)(mem + starts + cols);
+    unsigned int *point = (unsigned int *)(mem + starts + cols + vals);
+    unsigned int *index = (unsigned int *)(mem + starts + cols + vals + order);
+    m.diag = (double *)(mem + starts + cols + vals + 2 * order);
+    double *b = (double *)(mem + starts + cols + vals + 2 * order + vector);
+    double *x = b + vector / sizeof(double);
+    double *r = x + vector / sizeof(double);
+    double *z = r + vector / sizeof(double);
+    double *p = z + vector / sizeof(double);
+    double *ap = p + vector / sizeof(double);
+    double *partial = ap + vector / sizeof(double);
+
+    /* The colour numbering (grid point of every row and back) and the row offsets are cheap
+     * enough to lay out serially */
+    for (c = 0, i = 0; c < CLC_CG_COLOURS; c++)
+    {
+        m.colour[c] = i;
+        for (row = 0; row < m.rows; row++)
+        {
+            if ((int)((row % n) & 1) + (int)(((row / n) % n) & 1) * 2 + (int)(((row / (n * n)) & 1) * 4) == c)
+            {
+                index[row] = (unsigned int)i;
+                point[i++] = (unsigned int)row;
+            }
+        }
+    }
+    m.colour[CLC_CG_COLOURS] = i;
+    m.start[0] = 0;
+    for (row = 0; row < m.rows; row++)
+    {
+        size_t g = point[row];
+        size_t ix = g % n, iy = (g / n) % n, iz = g / (n * n);
+        m.start[row + 1] = m.start[row] + (1 + (ix > 0) + (ix < n - 1)) * (1 + (iy > 0) + (iy < n - 1)) * (1 + (iz > 0) + (iz < n - 1));
+    }
+
+    #pragma omp parallel num_threads (threads) private (i)
+    {
+        double rtz = 0, oldrtz, alpha, beta;
+        int k;
+        clc_place_worker(params, omp_get_thread_num());
+
+        /* Generated by the threads that will use it, so under a memory policy the pages land on their nodes */
+        clc_cg_generate(&m, point, index, b);
+        #pragma omp for schedule (static)
+        for (i = 0; i < m.rows; i++)
+        {
+            x[i] = 0;
+            r[i] = b[i];
+            z[i] = p[i] = ap[i] = 0;
+        }
+
+        /* Every thread gets the same norms, one stores them. They are read after the region ends */
+        double norm = sqrt(clc_cg_dot(r, r, m.rows, partial));
+        #pragma omp master
+        {
+            normr0 = norm;
+            start = cpubench_timer_now();
+        }
+
+        for (k = 0; k < iterations; k++)
+        {
+            unsigned long long t0 = cpubench_timer_now();
+
+            /* z = M^-1 r, one sweep from zero */
+            #pragma omp for schedule (static)
+            for (i = 0; i < m.rows; i++)
+            {
+                z[i] = 0;
+            }
+            clc_cg_symgs(&m, r, z);
+            if (omp_get_thread_num() == 0)
+            {
+                symgs_seconds += cpubench_timer_seconds(cpubench_timer_now() - t0);
+            }
+
+            oldrtz = rtz;
+            rtz = clc_cg_dot(r, z, m.rows, partial);
+            beta = (k == 0) ? 0 : rtz / oldrtz;
+            clc_cg_waxpby(m.rows, 1.0, z, beta, p, p);
+
+            t0 = cpubench_timer_now();
+            clc_cg_spmv(&m, p, ap);
+            if (omp_get_thread_num() == 0)
+            {
+                spmv_seconds += cpubench_timer_seconds(cpubench_timer_now() - t0);
+            }
+
+            alpha = rtz / clc_cg_dot(p, ap, m.rows, partial);
+            clc_cg_waxpby(m.rows, 1.0, x, alpha, p, x);
+            clc_cg_waxpby(m.rows, 1.0, r, -alpha, ap, r);
+            norm = sqrt(clc_cg_dot(r, r, m.rows, partial));
+            #pragma omp master
+            normr = norm;
+
+            if (omp_get_thread_num() == 0 && ctx->progress_cb != NULL)
+            {
+                clc_progress(ctx, CPUBENCH_WORKLOAD_HPCG, (unsigned long long)(k + 1), (unsigned long long)iterations, start);
+            }
+        }
+        #pragma omp master
+        seconds = cpubench_timer_seconds(cpubench_timer_now() - start);
+    }
+
+    /* Every operation is deterministic, so the residual history is part of the checksum */
+    double relres = normr / normr0;
+    snprintf(label, sizeof(label), "%lu %d %.6e", (unsigned long)n, iterations, relres);
+    clc_md5(label, result->checksum);
+
+    /* Flops and bytes as HPCG counts them: every matrix entry and vector element once per kernel */
+    double rows = (double)m.rows, nnz = (double)m.nnz;
+    double matrix = nnz * (sizeof(double) + sizeof(unsigned int)) + rows * sizeof(size_t);
+    double spmv_flops = 2 * nnz, symgs_flops = 4 * nnz;
+    double flops = (spmv_flops + symgs_flops + 3 * 2 * rows + 3 * 2 * rows) * iterations;
+    double bytes = (matrix + 2 * rows * sizeof(double)
+                    + 2 * (matrix + rows * 4 * sizeof(double)) + rows * sizeof(double)
+                    + 3 * 2 * rows * sizeof(double) + 3 * 3 * rows * sizeof(double)) * iterations;
+
+    result->threads = threads;
+    result->seconds = seconds;
+    result->count = (unsigned long long)flops;
+
+    snprintf(label, sizeof(label), "%lu^3 grid, %d iterations", (unsigned long)n, iterations);
+    status = clc_add_metric(result, "flops", label, "FLOP/s", flops / seconds);
+    if (status == CPUBENCH_OK)
+    {
+        status = clc_add_metric(result, "bandwidth", "effective", "B/s", bytes / seconds);
+    }
+    if (status == CPUBENCH_OK && spmv_seconds > 0)
+    {
+        status = clc_add_metric(result, "kernel_flops", "spmv", "FLOP/s", spmv_flops * iterations / spmv_seconds);
+    }
+    if (status == CPUBENCH_OK && symgs_seconds > 0)
+    {
+        status = clc_add_metric(result, "kernel_flops", "symgs", "FLOP/s", symgs_flops * iterations / symgs_seconds);
+    }
+    if (status == CPUBENCH_OK)
+    {
+        status = clc_add_metric(result, "residual", "relative", "", relres);
+    }
+    return status;
+}
+
+/* Tables and shape of a forward FFT of dims dimensions of n points each, in split complex form */
+struct clc_fft_plan
+{
+    int dims;
+    size_t n;
+    size_t total;
+    /* A long 1D transform is done as n1 x n2 by the six-step algorithm, n1 is 0 otherwise */
+    size_t n1;
+    size_t n2;
+    /* Roots of unity for rows of length n (n1 in six-step) and n2 */
+    double *rootr;
+    double *rooti;
+    double *root2r;
+    double *root2i;
+    /* exp(-2 pi i e / n) for any e < n as hi[e >> shift] * lo[e & (2^shift - 1)], six-step only */
+    unsigned int shift;
+    double *lor;
+    double *loi;
+    double *hir;
+    double *hii;
+};
+
+/* exp(-2 pi i m / len) for m < count */
+static void clc_fft_roots(size_t len, size_t count, size_t step, double *re, double *im)
+{
+    size_t m;
+
+    for (m = 0; m < count; m++)
+    {
+        double angle = -2.0 * M_PI * (double)(m * step) / (double)len;
+        re[m] = cos(angle);
+        im[m] = sin(angle);
+    }
+}
+
+/* exp(-2 pi i e / n) from the two six-step tables */
+static __inline__ void clc_fft_root(const struct clc_fft_plan *plan, size_t e, double *re, double *im)
+{
+    size_t h = e >> plan->shift, l = e & (((size_t)1 << plan->shift) - 1);
+
+    *re = plan->hir[h] * plan->lor[l] - plan->hii[h] * plan->loi[l];
+    *im = plan->hir[h] * plan->loi[l] + plan->hii[h] * plan->lor[l];
+}
+
+/* One radix-4 butterfly: inputs i, i + step, i + 2 step and i + 3 step of a, outputs o, o + s,
+ * o + 2 s and o + 3 s of b, the last three times w1, w2 and w3 */
+static __inline__ void clc_fft_radix4(const double *ar, const double *ai, double *br, double *bi, size_t i, size_t step, size_t o, size_t s,
+                                      double w1r, double w1i, double w2r, double w2i, double w3r, double w3i)
+{
+    double apcr = ar[i] + ar[i + 2 * step], apci = ai[i] + ai[i + 2 * step];
+    double amcr = ar[i] - ar[i + 2 * step], amci = ai[i] - ai[i + 2 * step];
+    double bpdr = ar[i + step] + ar[i + 3 * step], bpdi = ai[i + step] + ai[i + 3 * step];
+    /* i (b - d) */
+    double jbmdr = ai[i + 3 * step] - ai[i + step], jbmdi = ar[i + step] - ar[i + 3 * step];
+    double t1r = amcr - jbmdr, t1i = amci - jbmdi;
+    double t2r = apcr - bpdr, t2i = apci - bpdi;
+    double t3r = amcr + jbmdr, t3i = amci + jbmdi;
+
+    br[o] = apcr + bpdr;
+    bi[o] = apci + bpdi;
+    br[o + s] = w1r * t1r - w1i * t1i;
+    bi[o + s] = w1r * t1i + w1i * t1r;
+    br[o + 2 * s] = w2r * t2r - w2i * t2i;
+    bi[o + 2 * s] = w2r * t2i + w2i * t2r;
+    br[o + 3 * s] = w3r * t3r - w3i * t3i;
+    bi[o + 3 * s] = w3r * t3i + w3i * t3r;
+}
+
+/* In-place FFT of one row of len points: radix-4 Stockham stages, which need no bit reversal,
+ * and a radix-2 stage when len is an odd power of two. y is scratch of the same length */
+CLC_SIMD_CLONES
+static void clc_fft_row(size_t len, const double *twr, const double *twi, double *xr, double *xi, double *yr, double *yi)
+{
+    double *ar = xr, *ai = xi, *br = yr, *bi = yi, *t;
+    size_t n, s, p, q;
+
+    for (n = len, s = 1; n >= 4; n /= 4, s *= 4)
+    {
+        size_t m = n / 4;
+        if (s == 1)
+        {
+            /* Only the first stage has a long p loop and a trivial q loop */
+            for (p = 0; p < m; p++)
+            {
+                clc_fft_radix4(ar, ai, br, bi, p, m, 4 * p, 1, twr[p], twi[p], twr[2 * p], twi[2 * p], twr[3 * p], twi[3 * p]);
+            }
+        }
+        else
+        {
+            for (p = 0; p < m; p++)
+            {
+                double w1r = twr[p * s], w1i = twi[p * s], w2r = twr[2 * p * s], w2i = twi[2 * p * s];
+                double w3r = twr[3 * p * s], w3i = twi[3 * p * s];
+                for (q = 0; q < s; q++)
+                {
+                    clc_fft_radix4(ar, ai, br, bi, q + s * p, s * m, q + 4 * s * p, s, w1r, w1i, w2r, w2i, w3r, w3i);
+                }
+            }
+        }
+        t = ar; ar = br; br = t;
+        t = ai; ai = bi; bi = t;
+    }
+    if (n == 2)
+    {
+        for (q = 0; q < s; q++)
+        {
+            double ur = ar[q], ui = ai[q], vr = ar[q + s], vi = ai[q + s];
+            br[q] = ur + vr;
+            bi[q] = ui + vi;
+            br[q + s] = ur - vr;
+            bi[q + s] = ui - vi;
+        }
+        t = ar; ar = br; br = t;
+        t = ai; ai = bi; bi = t;
+    }
+    if (ar != xr)
+    {
+        memcpy(xr, ar, len * sizeof(double));
+        memcpy(xi, ai, len * sizeof(double));
+    }
+}
+
+/* FFT every row of a rows x len array, split over the threads */
+static void clc_fft_rows(size_t rows, size_t len, const double *twr, const double *twi, double *re, double *im, double *scratch)
+{
+    size_t r;
+
+    #pragma omp for schedule (static)
+    for (r = 0; r < rows; r++)
+    {
+        clc_fft_row(len, twr, twi, re + r * len, im + r * len, scratch, scratch + len);
+    }
+}
+
+/* Transpose a rows x cols array from (sr, si) into (dr, di), one tile at a time. Tiles go
+ * through a local buffer, so both sides are accessed a whole row at a time: with power of two
+ * strides, writing down a column of the destination would evict itself from L1 */
+static void clc_fft_transpose(size_t rows, size_t cols, const double *sr, const double *si, double *dr, double *di)
+{
+    double bufr[CLC_FFT_TILE][CLC_FFT_TILE], bufi[CLC_FFT_TILE][CLC_FFT_TILE];
+    size_t rtiles = (rows + CLC_FFT_TILE - 1) / CLC_FFT_TILE, ctiles = (cols + CLC_FFT_TILE - 1) / CLC_FFT_TILE;
+    size_t tile, r, c;
+
+    #pragma omp for schedule (static)
+    for (tile = 0; tile < rtiles * ctiles; tile++)
+    {
+        size_t r0 = (tile / ctiles) * CLC_FFT_TILE, c0 = (tile % ctiles) * CLC_FFT_TILE;
+        size_t nr = (rows - r0 < CLC_FFT_TILE) ? rows - r0 : CLC_FFT_TILE;
+        size_t nc = (cols - c0 < CLC_FFT_TILE) ? cols - c0 : CLC_FFT_TILE;
+
+        for (r = 0; r < nr; r++)
+        {
+            for (c = 0; c < nc; c++)
+            {
+                bufr[c][r] = sr[(r0 + r) * cols + c0 + c];
+                bufi[c][r] = si[(r0 + r) * cols + c0 + c];
+            }
+        }
+        for (c = 0; c < nc; c++)
+        {
+            memcpy(dr + (c0 + c) * rows + r0, bufr[c], nr * sizeof(double));
+            memcpy(di + (c0 + c) * rows + r0, bufi[c], nr * sizeof(double));
+        }
+    }
+}
+
+/* Six-step twiddle: element (j1, k2) of the n1 x n2 array times exp(-2 pi i j1 k2 / n) */
+static void clc_fft_twiddle(const struct clc_fft_plan *plan, double *re, double *im)
+{
+    size_t j1, k2;
+
+    #pragma omp for schedule (static)
+    for (j1 = 0; j1 < plan->n1; j1++)
+    {
+        for (k2 = 0; k2 < plan->n2; k2++)
+        {
+            size_t at = j1 * plan->n2 + k2;
+            double wr, wi, xr = re[at], xi = im[at];
+            clc_fft_root(plan, j1 * k2, &wr, &wi);
+            re[at] = xr * wr - xi * wi;
+            im[at] = xr * wi + xi * wr;
+        }
+    }
+}
+
+/* Forward FFT of (ar, ai), called by every thread of a parallel region. A multidimensional
+ * transform does the rows of the last axis, then turns that axis into the first with a
+ * transpose, once per axis. Returns 1 if the result ended up in (br, bi) */
+static int clc_fft_forward(const struct clc_fft_plan *plan, double *ar, double *ai, double *br, double *bi, double *scratch)
+{
+    size_t rows = plan->total / plan->n;
+    int d, in_b = 0;
+
+    if (plan->n1 != 0)
+    {
+        clc_fft_transpose(plan->n2, plan->n1, ar, ai, br, bi);
+        clc_fft_rows(plan->n1, plan->n2, plan->root2r, plan->root2i, br, bi, scratch);
+        clc_fft_twiddle(plan, br, bi);
+        clc_fft_transpose(plan->n1, plan->n2, br, bi, ar, ai);
+        clc_fft_rows(plan->n2, plan->n1, plan->rootr, plan->rooti, ar, ai, scratch);
+        clc_fft_transpose(plan->n2, plan->n1, ar, ai, br, bi);
+        return 1;
+    }
+
+    for (d = 0; d < plan->dims; d++)
+    {
+        clc_fft_rows(rows, plan->n, plan->rootr, plan->rooti, in_b ? br : ar, in_b ? bi : ai, scratch);
+        if (plan->dims > 1)
+        {
+            clc_fft_transpose(rows, plan->n, in_b ? br : ar, in_b ? bi : ai, in_b ? ar : br, in_b ? ai : bi);
+            in_b = !in_b;
+        }
+    }
+    return in_b;
+}
+
+/* The FFT input, reproducible from the index alone */
+static void clc_fft_input(const struct clc_fft_plan *plan, double *re, double *im)
+{
+    size_t j;
+
+    #pragma omp for schedule (static)
+    for (j = 0; j < plan->total; j++)
+    {
+        re[j] = clc_unit_hash(2 * (unsigned long long)j);
+        im[j] = clc_unit_hash(2 * (unsigned long long)j + 1);
+    }
+}
+
+/* Bin k of the DFT of the input by direct summation. Every axis has n points, so the phase of
+ * input j is the sum of the products of their coordinates, modulo n */
+static void clc_fft_reference(const struct clc_fft_plan *plan, size_t k, double *re, double *im)
+{
+    unsigned int bits = 0;
+    size_t kd[3], j, mask = plan->n - 1;
+    double sr = 0, si = 0;
+    int d;
+
+    while (((size_t)1 << bits) < plan->n)
+    {
+        bits++;
+    }
+    for (d = 0; d < plan->dims; d++)
+    {
+        kd[d] = (k >> (bits * (unsigned int)d)) & mask;
+    }
+    for (j = 0; j < plan->total; j++)
+    {
+        size_t e = 0;
+        double wr, wi;
+        for (d = 0; d < plan->dims; d++)
+        {
+            e += kd[d] * ((j >> (bits * (unsigned int)d)) & mask);
+        }
+        e &= mask;
+        if (plan->n1 != 0)
+        {
+            clc_fft_root(plan, e, &wr, &wi);
+        }
+        else
+        {
+            wr = plan->rootr[e];
+            wi = plan->rooti[e];
+        }
+        double xr = clc_unit_hash(2 * (unsigned long long)j), xi = clc_unit_hash(2 * (unsigned long long)j + 1);
+        sr += xr * wr - xi * wi;
+        si += xr * wi + xi * wr;
+    }
+    *re = sr;
+    *im = si;
+}
+
+/* Complex FFT */
+static cpubench_status clc_fft(cpubench_ctx *ctx, const cpubench_params *params, cpubench_result *result)
+{
+    struct clc_fft_plan plan;
+    size_t n = params->u.fft.n;
+    int dims = params->u.fft.dims;
+    int threads = clc_threads(ctx, params);
+    unsigned int bits = 0, total_bits;
+    double seconds = 0, worst = 0, largest = 0;
+    unsigned long long start;
+    int rep, in_b = 0;
+    char label[64];
+    size_t b;
+    cpubench_status status;
+
+    while (((size_t)1 << bits) < n)
+    {
+        bits++;
+    }
+    total_bits = bits * (unsigned int)dims;
+    if (n < 2 || ((size_t)1 << bits) != n || dims < 1 || dims > 3 || params->u.fft.ntimes < 1 || total_bits > 28
+        || (dims > 1 && n > CLC_FFT_DIRECT))
+    {
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+
+    memset(&plan, 0, sizeof(plan));
+    plan.dims = dims;
+    plan.n = n;
+    plan.total = (size_t)1 << total_bits;
+    if (n > CLC_FFT_DIRECT)
+    {
+        plan.n1 = (size_t)1 << (bits / 2);
+        plan.n2 = n / plan.n1;
+        plan.shift = (bits + 1) / 2;
+    }
+    size_t len = plan.n1 ? plan.n1 : n;
+    size_t len2 = plan.n1 ? plan.n2 : 0;
+    size_t hi = plan.n1 ? n >> plan.shift : 0;
+    size_t lo = plan.n1 ? (size_t)1 << plan.shift : 0;
+    size_t longest = plan.n1 ? plan.n2 : n;
+
+    /* Two copies of the data, one row of scratch per thread and the root tables */
+    size_t array = ((plan.total * sizeof(double)) + 63) & ~(size_t)63;
+    size_t row = ((2 * longest * sizeof(double)) + 63) & ~(size_t)63;
+    char *mem = clc_scratch(ctx, params, 4 * array + (size_t)threads * row + 2 * (len + len2 + hi + lo) * sizeof(double));
+    if (mem == NULL)
+    {
+        return CPUBENCH_ERR_NOMEM;
+    }
+    double *ar = (double *)mem, *ai = (double *)(mem + array), *br = (double *)(mem + 2 * array), *bi = (double *)(mem + 3 * array);
+    char *scratch = mem + 4 * array;
+    plan.rootr = (double *)(scratch + (size_t)threads * row);
+    plan.rooti = plan.rootr + len;
+    plan.root2r = plan.rooti + len;
+    plan.root2i = plan.root2r + len2;
+    plan.lor = plan.root2i + len2;
+    plan.loi = plan.lor + lo;
+    plan.hir = plan.loi + lo;
+    plan.hii = plan.hir + hi;
+    clc_fft_roots(len, len, 1, plan.rootr, plan.rooti);
+    clc_fft_roots(len2, len2, 1, plan.root2r, plan.root2i);
+    clc_fft_roots(n, lo, 1, plan.lor, plan.loi);
+    clc_fft_roots(n, hi, lo, plan.hir, plan.hii);
+
+    /* Shared, so whichever thread reads it in the second single sees the first one's write */
+    unsigned long long t0 = 0;
+
+    /* Fresh input for every transform, so each one starts from memory like the first */
+    start = cpubench_timer_now();
+    #pragma omp parallel num_threads (threads) private (rep)
+    {
+        double *own = (double *)(scratch + (size_t)omp_get_thread_num() * row);
+        clc_place_worker(params, omp_get_thread_num());
+
+        for (rep = 0; rep <= params->u.fft.ntimes; rep++)
+        {
+            clc_fft_input(&plan, ar, ai);
+            #pragma omp single
+            t0 = cpubench_timer_now();
+
+            int where = clc_fft_forward(&plan, ar, ai, br, bi, own);
+            #pragma omp single
+            {
+                double t = cpubench_timer_seconds(cpubench_timer_now() - t0);
+                if (rep > 0 && (seconds == 0 || t < seconds))
+                {
+                    seconds = t;
+                }
+                in_b = where;
+                if (ctx->progress_cb != NULL)
+                {
+                    clc_progress(ctx, CPUBENCH_WORKLOAD_FFT, (unsigned long long)(rep + 1), (unsigned long long)params->u.fft.ntimes + 1, start);
+                }
+            }
+        }
+    }
+
+    /* Every bin of small transforms, a sample of large ones, against a direct DFT */
+    double *outr = in_b ? br : ar, *outi = in_b ? bi : ai;
+    size_t nbins = (plan.total <= CLC_FFT_CHECK_ALL) ? plan.total : CLC_FFT_CHECK_BINS;
+    #pragma omp parallel num_threads (threads) reduction (max : worst, largest)
+    {
+        clc_place_worker(params, omp_get_thread_num());
+
+        #pragma omp for schedule (dynamic)
+        for (b = 0; b < nbins; b++)
+        {
+            size_t k = (nbins == plan.total) ? b : (size_t)((b * 0x9E3779B97F4A7C15ULL) & (plan.total - 1));
+            double rr, ri;
+            clc_fft_reference(&plan, k, &rr, &ri);
+            double err = hypot(outr[k] - rr, outi[k] - ri), mag = hypot(rr, ri);
+            worst = (err > worst) ? err : worst;
+            largest = (mag > largest) ? mag : largest;
+        }
+    }
+    double error = (largest > 0) ? worst / largest : worst;
+    int valid = (error < CLC_FFT_TOLERANCE);
+
+    /* The output depends on which vector clone ran, so only the verdict goes in the checksum */
+    snprintf(label, sizeof(label), "%s %d %lu", valid ? "valid" : "invalid", dims, (unsigned long)n);
+    clc_md5(label, result->checksum);
+
+    double flops = 5.0 * (double)plan.total * (double)total_bits;
+    result->threads = threads;
+    result->seconds = seconds;
+    result->count = (unsigned long long)flops;
+
+    if (dims == 1 && plan.n1 != 0)
+    {
+        snprintf(label, sizeof(label), "1D %lu, six-step %lu x %lu", (unsigned long)n, (unsigned long)plan.n1, (unsigned long)plan.n2);
+    }
+    else
+    {
+        snprintf(label, sizeof(label), "%dD %lu%s%.0lu%s%.0lu", dims, (unsigned long)n, (dims > 1) ? "x" : "", (dims > 1) ? (unsigned long)n : 0UL,
+                 (dims > 2) ? "x" : "", (dims > 2) ? (unsigned long)n : 0UL);
+    }
+    status = clc_add_metric(result, "flops", label, "FLOP/s", flops / seconds);
+    if (status == CPUBENCH_OK)
+    {
+        snprintf(label, sizeof(label), "%lu bins vs direct DFT, %s", (unsigned long)nbins, valid ? "passed" : "failed");
+        status = clc_add_metric(result, "error", label, "", error);
+    }
+    return status;
+}
+
+/* One row of a Jacobi step, points [x0, x1) of row y of plane z from in to out. The weights
+ * add up to one: 0.4 and 0.1 per face for 7 points, 0.3, 0.05 per face, 0.025 per edge and
+ * 0.0125 per corner for 27 */
+CLC_SIMD_CLONES
+static void clc_stencil_row(int points, const double *in, double *out, size_t n, size_t z, size_t y, size_t x0, size_t x1)
+{
+    size_t plane = n * n;
+    const double *c = in + z * plane + y * n;
+    double *o = out + z * plane + y * n;
+    size_t x;
+
+    if (points == 7)
+    {
+        for (x = x0; x < x1; x++)
+        {
+            o[x] = 0.4 * c[x] + 0.1 * ((c[x - 1] + c[x + 1]) + (c[x - n] + c[x + n]) + (c[x - plane] + c[x + plane]));
+        }
+        return;
+    }
+
+    /* The nine rows around (z, y), b and a for the planes below and above */
+    const double *bs = c - plane - n, *b0 = c - plane, *bn = c - plane + n;
+    const double *cs = c - n, *cn = c + n;
+    const double *as = c + plane - n, *a0 = c + plane, *an = c + plane + n;
+    for (x = x0; x < x1; x++)
+    {
+        double faces = (c[x - 1] + c[x + 1]) + (cs[x] + cn[x]) + (b0[x] + a0[x]);
+        double edges = (cs[x - 1] + cs[x + 1]) + (cn[x - 1] + cn[x + 1]) + (b0[x - 1] + b0[x + 1]) + (a0[x - 1] + a0[x + 1])
+                       + (bs[x] + bn[x]) + (as[x] + an[x]);
+        double corners = (bs[x - 1] + bs[x + 1]) + (bn[x - 1] + bn[x + 1]) + (as[x - 1] + as[x + 1]) + (an[x - 1] + an[x + 1]);
+        o[x] = 0.3 * c[x] + 0.05 * faces + 0.025 * edges + 0.0125 * corners;
+    }
+}
+
+/* Same starting values in both grids, boundary included, which no step ever writes */
+static void clc_stencil_init(size_t n, double *a, double *b)
+{
+    size_t i;
+
+    #pragma omp for schedule (static)
+    for (i = 0; i < n * n * n; i++)
+    {
+        a[i] = b[i] = clc_unit_hash(i);
+    }
+}
+
+/* Run steps Jacobi steps with one of the three schedules: 0 sweeps the whole grid every step,
+ * 1 does every step in CLC_STENCIL_BY x CLC_STENCIL_BX columns of the grid, walking each column
+ * up in z so the planes of a block are reused from cache, and 2 advances tile steps at once in a
+ * wavefront over z, step s working on plane k - s, so a plane is used by every step of the tile
+ * while it is still in cache. Returns the grid holding the result */
+static double *clc_stencil_run(cpubench_ctx *ctx, const cpubench_params *params, int threads, int variant, double *grids[2], unsigned long long start)
+{
+    size_t n = params->u.stencil.n;
+    int points = params->u.stencil.points, steps = params->u.stencil.steps;
+    int tile = (variant == 2) ? params->u.stencil.tile : 1;
+
+    #pragma omp parallel num_threads (threads)
+    {
+        size_t nyb = (n - 2 + CLC_STENCIL_BY - 1) / CLC_STENCIL_BY, nxb = (n - 2 + CLC_STENCIL_BX - 1) / CLC_STENCIL_BX;
+        size_t y, z, k, b;
+        int t0, s;
+        clc_place_worker(params, omp_get_thread_num());
+
+        for (t0 = 0; t0 < steps; t0 += tile)
+        {
+            const double *in = grids[t0 & 1];
+            double *out = grids[(t0 + 1) & 1];
+            int depth = (steps - t0 < tile) ? steps - t0 : tile;
+
+            if (variant == 0)
+            {
+                #pragma omp for schedule (static)
+                for (z = 1; z < n - 1; z++)
+                {
+                    for (y = 1; y < n - 1; y++)
+                    {
+                        clc_stencil_row(points, in, out, n, z, y, 1, n - 1);
+                    }
+                }
+            }
+            else if (variant == 1)
+            {
+                #pragma omp for schedule (static)
+                for (b = 0; b < nyb * nxb; b++)
+                {
+                    size_t y0 = 1 + (b / nxb) * CLC_STENCIL_BY, x0 = 1 + (b % nxb) * CLC_STENCIL_BX;
+                    size_t y1 = (y0 + CLC_STENCIL_BY < n - 1) ? y0 + CLC_STENCIL_BY : n - 1;
+                    size_t x1 = (x0 + CLC_STENCIL_BX < n - 1) ? x0 + CLC_STENCIL_BX : n - 1;
+                    for (z = 1; z < n - 1; z++)
+                    {
+                        for (y = y0; y < y1; y++)
+                        {
+                            clc_stencil_row(points, in, out, n, z, y, x0, x1);
+                        }
+                    }
+                }
+            }
+            else
+            {
+                /* Step s of plane z needs step s - 1 of planes z - 1 to z + 1, all done by the time
+                 * k reaches z + s. Two grids are enough: what step s + 1 overwrites, nothing
+                 * later in the wavefront reads */
+                for (k = 1; k < n - 1 + (size_t)depth - 1; k++)
+                {
+                    for (s = 0; s < depth; s++)
+                    {
+                        if (k < 1 + (size_t)s || k - (size_t)s > n - 2)
+                        {
+                            continue;
+                        }
+                        #pragma omp for schedule (static)
+                        for (y = 1; y < n - 1; y++)
+                        {
+                            clc_stencil_row(points, grids[(t0 + s) & 1], grids[(t0 + s + 1) & 1], n, k - (size_t)s, y, 1, n - 1);
+                        }
+                    }
+                }
+            }
+
+            if (omp_get_thread_num() == 0 && ctx->progress_cb != NULL)
+            {
+                clc_progress(ctx, CPUBENCH_WORKLOAD_STENCIL, (unsigned long long)(variant * steps + t0 + depth), 3ULL * (unsigned long long)steps, start);
+            }
+        }
+    }
+    return grids[steps & 1];
+}
+
+/* 3D Jacobi stencil */
+static cpubench_status clc_stencil(cpubench_ctx *ctx, const cpubench_params *params, cpubench_result *result)
+{
+    static const char *const variants[3] = { "naive", "spatially blocked", "temporally tiled" };
+    size_t n = params->u.stencil.n;
+    int points = params->u.stencil.points;
+    int threads = clc_threads(ctx, params);
+    double rate[3];
+    const double *first = NULL;
+    unsigned long long start;
+    char label[64];
+    int v, same = 1;
+    cpubench_status status = CPUBENCH_OK;
+
+    if (n < 3 || n > 4096 || (points != 7 && points != 27) || params->u.stencil.steps < 1 || params->u.stencil.tile < 1)
+    {
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+
+    /* Two grids per variant, so the results can be compared */
+    size_t grid = ((n * n * n * sizeof(double)) + 63) & ~(size_t)63;
+    char *mem = clc_scratch(ctx, params, 4 * grid);
+    if (mem == NULL)
+    {
+        return CPUBENCH_ERR_NOMEM;
+    }
+
+    start = cpubench_timer_now();
+    for (v = 0; v < 3; v++)
+    {
+        double *grids[2];
+        grids[0] = (double *)(mem + (size_t)(v == 0 ? 0 : 2) * grid);
+        grids[1] = (double *)(mem + (size_t)(v == 0 ? 1 : 3) * grid);
+
+        #pragma omp parallel num_threads (threads)
+        {
+            clc_place_worker(params, omp_get_thread_num());
+            clc_stencil_init(n, grids[0], grids[1]);
+        }
+
+        unsigned long long t0 = cpubench_timer_now();
+        const double *out = clc_stencil_run(ctx, params, threads, v, grids, start);
+        rate[v] = (double)(n - 2) * (double)(n - 2) * (double)(n - 2) * params->u.stencil.steps / cpubench_timer_seconds(cpubench_timer_now() - t0);
+
+        /* Every point sees the same operations in the same order, so all variants must agree to the bit */
+        if (v == 0)
+        {
+            first = out;
+        }
+        else
+        {
+            same &= (memcmp(first, out, n * n * n * sizeof(double)) == 0);
+        }
+    }
+
+    snprintf(label, sizeof(label), "%s %d %lu %d", same ? "valid" : "invalid", points, (unsigned long)n, params->u.stencil.steps);
+    clc_md5(label, result->checksum);
+
+    result->threads = threads;
+    result->seconds = (double)(n - 2) * (double)(n - 2) * (double)(n - 2) * params->u.stencil.steps / rate[2];
+    result->count = (unsigned long long)(n - 2) * (n - 2) * (n - 2) * (unsigned long long)params->u.stencil.steps;
+
+    /* The headline is the fastest schedule, temporal tiling */
+    for (v = 2; v >= 0 && status == CPUBENCH_OK; v--)
+    {
+        if (v == 2)
+        {
+            snprintf(label, sizeof(label), "%d-point %s, %d steps", points, variants[v], params->u.stencil.tile);
+        }
+        else if (v == 1)
+        {
+            snprintf(label, sizeof(label), "%d-point %s %dx%d", points, variants[v], CLC_STENCIL_BY, CLC_STENCIL_BX);
+        }
+        else
+        {
+            snprintf(label, sizeof(label), "%d-point %s", points, variants[v]);
+        }
+        status = clc_add_metric(result, "updates", label, "LUP/s", rate[v]);
+    }
+    if (status == CPUBENCH_OK)
+    {
+        status = clc_add_metric(result, "speedup", "blocked over naive", "x", rate[1] / rate[0]);
+    }
+    if (status == CPUBENCH_OK)
+    {
+        status = clc_add_metric(result, "speedup", "tiled over naive", "x", rate[2] / rate[0]);
+    }
+    if (status == CPUBENCH_OK)
+    {
+        status = clc_add_metric(result, "flops", variants[2], "FLOP/s", rate[2] * (points == 7 ? 8 : 30));
+    }
+    return status;
+}
+
+/* Names of the SpMV sparsity patterns */
+static const char *const clc_spmv_patterns[] = { "all", "banded", "random", "power-law" };
+
+/* A square sparse matrix in CSR, and the same matrix in SELL-C-sigma: rows sorted by length
+ * within windows of sigma rows, then cut into chunks of c rows stored column by column, each
+ * padded to its longest row */
+struct clc_spmv_matrix
+{
+    size_t rows;
+    size_t nnz;
+    size_t *start;
+    unsigned int *cols;
+    double *vals;
+    int c;
+    size_t nchunks;
+    size_t stored;
+    size_t *cstart;
+    unsigned int *perm;
+    unsigned int *scols;
+    double *svals;
+};
+
+/* Nonzeros of row i. Power-law rows follow a Pareto distribution with the requested mean */
+static size_t clc_spmv_length(const cpubench_spmv_params *p, int pattern, size_t i)
+{
+    if (pattern != CPUBENCH_SPMV_POWERLAW)
+    {
+        return (size_t)p->nnz;
+    }
+    double alpha = p->alpha / 100.0;
+    double u = 0.5 - clc_unit_hash(0x5EEDULL * p->rows + i);
+    double len = floor((double)p->nnz * (alpha - 1) / alpha / pow(u, 1 / alpha));
+    return (len < 1) ? 1 : (len > (double)p->rows) ? p->rows : (size_t)len;
+}
+
+/* Sort keys of unsigned ints */
+static int clc_compare_uint(const void *a, const void *b)
+{
+    unsigned int x = *(const unsigned int *)a, y = *(const unsigned int *)b;
+    return (x > y) - (x < y);
+}
+
+static int clc_compare_ull(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long *)a, y = *(const unsigned long long *)b;
+    return (x > y) - (x < y);
+}
+
+/* Fill row i of the CSR matrix: columns drawn with replacement from the band around the diagonal
+ * or from the whole row, sorted, and values from their position */
+static void clc_spmv_row(const cpubench_spmv_params *p, int pattern, const struct clc_spmv_matrix *m, size_t i)
+{
+    unsigned long long state = clc_mix64(((unsigned long long)pattern << 56) ^ i);
+    size_t lo = 0, span = m->rows, e, f;
+    unsigned int *cols = m->cols + m->start[i];
+    size_t len = m->start[i + 1] - m->start[i];
+
+    if (pattern == CPUBENCH_SPMV_BANDED)
+    {
+        lo = (i > p->band) ? i - p->band : 0;
+        span = ((i + p->band < m->rows) ? i + p->band : m->rows - 1) - lo + 1;
+    }
+    for (e = 0; e < len; e++)
+    {
+        state = clc_mix64(state);
+        cols[e] = (unsigned int)(lo + state % span);
+    }
+    if (len > 64)
+    {
+        qsort(cols, len, sizeof(*cols), clc_compare_uint);
+    }
+    for (e = 1; e < len && len <= 64; e++)
+    {
+        unsigned int v = cols[e];
+        for (f = e; f > 0 && cols[f - 1] > v; f--)
+        {
+            cols[f] = cols[f - 1];
+        }
+        cols[f] = v;
+    }
+    for (e = m->start[i]; e < m->start[i + 1]; e++)
+    {
+        m->vals[e] = clc_unit_hash(~(unsigned long long)e);
+    }
+}
+
+/* y = A x over rows [r0, r1) in CSR. The sum of a row is a serial chain, as in any plain CSR code */
+CLC_SIMD_CLONES
+static void clc_spmv_csr(const struct clc_spmv_matrix *m, const double *x, double *y, size_t r0, size_t r1)
+{
+    size_t r, e;
+
+    for (r = r0; r < r1; r++)
+    {
+        double sum = 0;
+        for (e = m->start[r]; e < m->start[r + 1]; e++)
+        {
+            sum += m->vals[e] * x[m->cols[e]];
+        }
+        y[r] = sum;
+    }
+}
+
+/* y = A x over chunks [k0, k1) in SELL-C-sigma, c known at compile time where it matters. The c
+ * rows of a chunk advance together, one vector of gathers per column */
+static __inline__ __attribute__((always_inline)) void clc_spmv_chunks(const struct clc_spmv_matrix *m, size_t c, const double *x, double *y,
+                                                                      size_t k0, size_t k1)
+{
+    double sum[CLC_SELL_MAX_C];
+    size_t k, j, r;
+
+    for (k = k0; k < k1; k++)
+    {
+        size_t off = m->cstart[k], width = (m->cstart[k + 1] - off) / c;
+        for (r = 0; r < c; r++)
+        {
+            sum[r] = 0;
+        }
+        for (j = 0; j < width; j++)
+        {
+            for (r = 0; r < c; r++)
+            {
+                sum[r] += m->svals[off + j * c + r] * x[m->scols[off + j * c + r]];
+            }
+        }
+        for (r = 0; r < c && k * c + r < m->rows; r++)
+        {
+            y[m->perm[k * c + r]] = sum[r];
+        }
+    }
+}
+
+CLC_SIMD_CLONES
+static void clc_spmv_sell(const struct clc_spmv_matrix *m, const double *x, double *y, size_t k0, size_t k1)
+{
+    switch (m->c)
+    {
+    case 4:
+        clc_spmv_chunks(m, 4, x, y, k0, k1);
+        break;
+    case 8:
+        clc_spmv_chunks(m, 8, x, y, k0, k1);
+        break;
+    case 16:
+        clc_spmv_chunks(m, 16, x, y, k0, k1);
+        break;
+    default:
+        clc_spmv_chunks(m, (size_t)m->c, x, y, k0, k1);
+        break;
+    }
+}
+
+/* Split [0, count) over the threads so each gets an equal share of offsets[], i.e. of the
+ * nonzeros rather than of the rows */
+static void clc_spmv_partition(const size_t *offsets, size_t count, int threads, size_t *bounds)
+{
+    size_t lo = 0;
+    int t;
+
+    bounds[0] = 0;
+    for (t = 1; t < threads; t++)
+    {
+        size_t target = offsets[count] / (size_t)threads * (size_t)t, hi = count;
+        while (lo < hi)
+        {
+            size_t mid = lo + (hi - lo) / 2;
+            if (offsets[mid] < target)
+            {
+                lo = mid + 1;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
+        bounds[t] = lo;
+    }
+    bounds[threads] = count;
+}
+
+/* Build one pattern and time both formats. Rates are stored as CSR and SELL flops and bytes per second */
+static cpubench_status clc_spmv_pattern(cpubench_ctx *ctx, const cpubench_params *params, int threads, int pattern,
+                                        double rates[4], double *fill, int *valid)
+{
+    const cpubench_spmv_params *p = &params->u.spmv;
+    struct clc_spmv_matrix m;
+    size_t i, k, r;
+    int rep, t;
+
+    memset(&m, 0, sizeof(m));
+    m.rows = p->rows;
+    m.c = p->chunk;
+    m.nchunks = (m.rows + (size_t)m.c - 1) / (size_t)m.c;
+
+    /* Layout first: row lengths, the sigma sort and the chunk offsets, so the arena is sized once */
+    size_t *start = malloc((m.rows + 1) * sizeof(size_t));
+    unsigned long long *keys = malloc(m.nchunks * (size_t)m.c * sizeof(unsigned long long));
+    size_t *cstart = malloc((m.nchunks + 1) * sizeof(size_t));
+    size_t *bounds = malloc(2 * ((size_t)threads + 1) * sizeof(size_t));
+    if (start == NULL || keys == NULL || cstart == NULL || bounds == NULL)
+    {
+        free(start);
+        free(keys);
+        free(cstart);
+        free(bounds);
+        return CPUBENCH_ERR_NOMEM;
+    }
+    start[0] = 0;
+    for (i = 0; i < m.rows; i++)
+    {
+        start[i + 1] = start[i] + clc_spmv_length(p, pattern, i);
+    }
+    m.nnz = start[m.rows];
+
+    /* Longest first within every window, then by row number. Rows past the end pad the last chunk */
+    for (i = 0; i < m.nchunks * (size_t)m.c; i++)
+    {
+        size_t len = (i < m.rows) ? start[i + 1] - start[i] : 0;
+        keys[i] = ((unsigned long long)(0xFFFFFFFFULL - len) << 32) | i;
+    }
+    for (i = 0; i < m.rows; i += (size_t)p->sigma)
+    {
+        qsort(keys + i, (m.rows - i < (size_t)p->sigma) ? m.rows - i : (size_t)p->sigma, sizeof(*keys), clc_compare_ull);
+    }
+    cstart[0] = 0;
+    for (k = 0; k < m.nchunks; k++)
+    {
+        size_t width = 0;
+        for (r = 0; r < (size_t)m.c; r++)
+        {
+            size_t len = 0xFFFFFFFFULL - (keys[k * (size_t)m.c + r] >> 32);
+            width = (len > width) ? len : width;
+        }
+        cstart[k + 1] = cstart[k] + width * (size_t)m.c;
+    }
+    m.stored = cstart[m.nchunks];
+
+    /* CSR, SELL-C-sigma and x plus one y per format, each 64-byte aligned */
+    size_t starts = (((m.rows + 1) * sizeof(size_t)) + 63) & ~(size_t)63;
+    size_t cols = ((m.nnz * sizeof(unsigned int)) + 63) & ~(size_t)63;
+    size_t vals = ((m.nnz * sizeof(double)) + 63) & ~(size_t)63;
+    size_t cstarts = (((m.nchunks + 1) * sizeof(size_t)) + 63) & ~(size_t)63;
+    size_t perm = ((m.nchunks * (size_t)m.c * sizeof(unsigned int)) + 63) & ~(size_t)63;
+    size_t scols = ((m.stored * sizeof(unsigned int)) + 63) & ~(size_t)63;
+    size_t svals = ((m.stored * sizeof(double)) + 63) & ~(size_t)63;
+    size_t vector = ((m.rows * sizeof(double)) + 63) & ~(size_t)63;
+    char *mem = clc_scratch(ctx, params, starts + cols + vals + cstarts + perm + scols + svals + 3 * vector);
+    if (mem == NULL)
+    {
+        free(start);
+        free(keys);
+        free(cstart);
+        free(bounds);
+        return CPUBENCH_ERR_NOMEM;
+    }
+    m.start = (size_t *)mem;
+    m.cols = (unsigned int *)(mem + starts);
+    m.vals = (double *)(mem + starts + cols);
+    m.cstart = (size_t *)(mem + starts + cols + vals);
+    m.perm = (unsigned int *)(mem + starts + cols + vals + cstarts);
+    m.scols = (unsigned int *)(mem + starts + cols + vals + cstarts + perm);
+    m.svals = (double *)(mem + starts + cols + vals + cstarts + perm + scols);
+    double *x = (double *)(mem + starts + cols + vals + cstarts + perm + scols + svals);
+    double *y = x + vector / sizeof(double), *ys = y + vector / sizeof(double);
+    memcpy(m.start, start, (m.rows + 1) * sizeof(size_t));
+    memcpy(m.cstart, cstart, (m.nchunks + 1) * sizeof(size_t));
+    for (i = 0; i < m.nchunks * (size_t)m.c; i++)
+    {
+        m.perm[i] = (unsigned int)(keys[i] & 0xFFFFFFFFULL);
+    }
+    size_t *csr_bounds = bounds, *sell_bounds = bounds + threads + 1;
+    clc_spmv_partition(m.start, m.rows, threads, csr_bounds);
+    clc_spmv_partition(m.cstart, m.nchunks, threads, sell_bounds);
+    free(start);
+    free(keys);
+    free(cstart);
+
+    #pragma omp parallel num_threads (threads) private (i, k, r, rep)
+    {
+        clc_place_worker(params, omp_get_thread_num());
+
+        #pragma omp for schedule (dynamic, 1024)
+        for (i = 0; i < m.rows; i++)
+        {
+            clc_spmv_row(p, pattern, &m, i);
+            x[i] = clc_unit_hash(i);
+        }
+
+        /* Padding repeats the last column of its row, so it stays in cache and adds 0 */
+        #pragma omp for schedule (dynamic, 64)
+        for (k = 0; k < m.nchunks; k++)
+        {
+            size_t width = (m.cstart[k + 1] - m.cstart[k]) / (size_t)m.c;
+            for (r = 0; r < (size_t)m.c; r++)
+            {
+                size_t row = m.perm[k * (size_t)m.c + r], j;
+                size_t len = (row < m.rows) ? m.start[row + 1] - m.start[row] : 0;
+                for (j = 0; j < width; j++)
+                {
+                    size_t at = m.cstart[k] + j * (size_t)m.c + r;
+                    m.scols[at] = (j < len) ? m.cols[m.start[row] + j] : (len > 0) ? m.cols[m.start[row] + len - 1] : 0;
+                    m.svals[at] = (j < len) ? m.vals[m.start[row] + j] : 0;
+                }
+            }
+        }
+    }
+
+    /* Each thread runs its share of the nonzeros, the fastest of ntimes products counts */
+    double best[2] = { 0, 0 };
+    for (rep = 0; rep <= p->ntimes; rep++)
+    {
+        for (t = 0; t < 2; t++)
+        {
+            unsigned long long t0 = cpubench_timer_now();
+            #pragma omp parallel num_threads (threads)
+            {
+                int me = omp_get_thread_num();
+                clc_place_worker(params, me);
+                if (t == 0)
+                {
+                    clc_spmv_csr(&m, x, y, csr_bounds[me], csr_bounds[me + 1]);
+                }
+                else
+                {
+                    clc_spmv_sell(&m, x, ys, sell_bounds[me], sell_bounds[me + 1]);
+                }
+            }
+            double seconds = cpubench_timer_seconds(cpubench_timer_now() - t0);
+            if (rep > 0 && (best[t] == 0 || seconds < best[t]))
+            {
+                best[t] = seconds;
+            }
+        }
+    }
+    free(bounds);
+
+    /* Both formats add the same products in the same order, padding only adds zeros */
+    double worst = 0, largest = 0;
+    for (i = 0; i < m.rows; i++)
+    {
+        worst = (fabs(y[i] - ys[i]) <= worst) ? worst : fabs(y[i] - ys[i]);
+        largest = (fabs(y[i]) > largest) ? fabs(y[i]) : largest;
+    }
+    *valid = (worst <= 1E-12 * largest);
+
+    /* Bytes every product has to move: the matrix in its format, x and y once */
+    double csr_bytes = (double)m.nnz * (sizeof(double) + sizeof(unsigned int)) + (double)(m.rows + 1) * sizeof(size_t) + 2.0 * m.rows * sizeof(double);
+    double sell_bytes = (double)m.stored * (sizeof(double) + sizeof(unsigned int)) + (double)(m.nchunks + 1) * sizeof(size_t)
+                        + (double)m.rows * sizeof(unsigned int) + 2.0 * m.rows * sizeof(double);
+    rates[0] = 2.0 * m.nnz / best[0];
+    rates[1] = 2.0 * m.nnz / best[1];
+    rates[2] = csr_bytes / best[0];
+    rates[3] = sell_bytes / best[1];
+    *fill = 100.0 * (double)m.nnz / (double)m.stored;
+    return CPUBENCH_OK;
+}
+
+/* Sparse matrix-vector multiply */
+static cpubench_status clc_spmv(cpubench_ctx *ctx, const cpubench_params *params, cpubench_result *result)
+{
+    const cpubench_spmv_params *p = &params->u.spmv;
+    int threads = clc_threads(ctx, params);
+    unsigned long long start = cpubench_timer_now();
+    char label[64], verdict[64] = "";
+    int pattern, valid = 1;
+    cpubench_status status = CPUBENCH_OK;
+
+    if (p->rows < 1 || p->rows > 0x7FFFFFFFUL || p->nnz < 1 || p->chunk < 1 || p->chunk > CLC_SELL_MAX_C || p->sigma < 1
+        || p->alpha <= 100 || p->ntimes < 1 || (unsigned int)p->pattern > CPUBENCH_SPMV_POWERLAW)
+    {
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+
+    for (pattern = CPUBENCH_SPMV_BANDED; pattern <= CPUBENCH_SPMV_POWERLAW && status == CPUBENCH_OK; pattern++)
+    {
+        double rates[4], fill;
+        int ok;
+
+        if (p->pattern != CPUBENCH_SPMV_ALL && (int)p->pattern != pattern)
+        {
+            continue;
+        }
+        status = clc_spmv_pattern(ctx, params, threads, pattern, rates, &fill, &ok);
+        if (status != CPUBENCH_OK)
+        {
+            break;
+        }
+        valid &= ok;
+        snprintf(verdict + strlen(verdict), sizeof(verdict) - strlen(verdict), "%s%d", (verdict[0] != '\0') ? "," : "", pattern);
+
+        snprintf(label, sizeof(label), "%s CSR", clc_spmv_patterns[pattern]);
+        status = clc_add_metric(result, "flops", label, "FLOP/s", rates[0]);
+        if (status == CPUBENCH_OK)
+        {
+            snprintf(label, sizeof(label), "%s SELL-%d-%d", clc_spmv_patterns[pattern], p->chunk, p->sigma);
+            status = clc_add_metric(result, "flops", label, "FLOP/s", rates[1]);
+        }
+        if (status == CPUBENCH_OK)
+        {
+            snprintf(label, sizeof(label), "%s CSR", clc_spmv_patterns[pattern]);
+            status = clc_add_metric(result, "bandwidth", label, "B/s", rates[2]);
+        }
+        if (status == CPUBENCH_OK)
+        {
+            snprintf(label, sizeof(label), "%s SELL-%d-%d", clc_spmv_patterns[pattern], p->chunk, p->sigma);
+            status = clc_add_metric(result, "bandwidth", label, "B/s", rates[3]);
+        }
+        if (status == CPUBENCH_OK)
+        {
+            status = clc_add_metric(result, "sell_fill", clc_spmv_patterns[pattern], "%", fill);
+        }
+        if (ctx->progress_cb != NULL)
+        {
+            clc_progress(ctx, CPUBENCH_WORKLOAD_SPMV, (unsigned long long)pattern, CPUBENCH_SPMV_POWERLAW, start);
+        }
+    }
+    if (status != CPUBENCH_OK)
+    {
+        return status;
+    }
+
+    snprintf(label, sizeof(label), "%s %lu %d %s", valid ? "valid" : "invalid", p->rows, p->nnz, verdict);
+    clc_md5(label, result->checksum);
+    result->threads = threads;
+    result->seconds = cpubench_timer_seconds(cpubench_timer_now() - start);
+    result->count = (unsigned long long)p->rows * (unsigned long long)p->nnz;
+    return CPUBENCH_OK;
+}
+
+/* Digests of the hashing workload by their OpenSSL names, in cpubench_hash_algorithm order */
+static const char *const clc_hash_names[] = { "all", "md5", "sha1", "sha256", "sha512", "sha3-256", "blake2b512", "blake2s256" };
+
+/* Look up a digest once, so the timed loop doesn't pay for the implicit fetch of every init */
+static EVP_MD *clc_hash_fetch(int algorithm)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    return EVP_MD_fetch(NULL, clc_hash_names[algorithm], NULL);
+#else
+    return (EVP_MD *)EVP_get_digestbyname(clc_hash_names[algorithm]);
+#endif
+}
+
+static void clc_hash_release(EVP_MD *md)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    EVP_MD_free(md);
+#else
+    (void)md;
+#endif
+}
+
+/* Hash messages of size bytes on every thread, each thread count of them, one digest per message.
+ * Returns the seconds taken, or a negative value if OpenSSL failed */
+static double clc_hash_run(const cpubench_params *params, int threads, const EVP_MD *md, const unsigned char *buffer,
+                           size_t size, unsigned long long count)
+{
+    unsigned long long start = 0;
+    double seconds = 0;
+    int failed = 0;
+
+    #pragma omp parallel num_threads (threads) reduction (|:failed)
+    {
+        EVP_MD_CTX *mdctx = EVP_MD_CTX_new();
+        unsigned char digest[EVP_MAX_MD_SIZE];
+        unsigned int len;
+        unsigned long long m;
+
+        clc_place_worker(params, omp_get_thread_num());
+        failed = (mdctx == NULL || !EVP_DigestInit_ex(mdctx, md, NULL) || !EVP_DigestUpdate(mdctx, buffer, size)
+                  || !EVP_DigestFinal_ex(mdctx, digest, &len));
+
+        #pragma omp barrier
+        #pragma omp master
+        start = cpubench_timer_now();
+        #pragma omp barrier
+
+        for (m = 0; m < count && !failed; m++)
+        {
+            failed = (!EVP_DigestInit_ex(mdctx, md, NULL) || !EVP_DigestUpdate(mdctx, buffer, size) || !EVP_DigestFinal_ex(mdctx, digest, &len));
+        }
+
+        #pragma omp barrier
+        #pragma omp master
+        seconds = cpubench_timer_seconds(cpubench_timer_now() - start);
+        EVP_MD_CTX_free(mdctx);
+    }
+    return failed ? -1 : seconds;
+}
+
+/* Hashing throughput */
+static cpubench_status clc_hash(cpubench_ctx *ctx, const cpubench_params *params, cpubench_result *result)
+{
+    const cpubench_hash_params *p = &params->u.hash;
+    int threads = clc_threads(ctx, params);
+    unsigned long long start = cpubench_timer_now(), total = 0;
+    double hz = clc_measure_frequency();
+    int cores = clc_cores_used(params, threads);
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int len, d;
+    char label[64], size_name[32], digests[1024] = "";
+    size_t i, size;
+    int algorithm;
+    cpubench_status status = CPUBENCH_OK;
+
+    if (p->min < 1 || p->max < p->min || p->volume < 1 || (unsigned int)p->algorithm > CPUBENCH_HASH_BLAKE2S256)
+    {
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+    hz = (hz > 0) ? hz : clc_timer.tsc_hz;
+
+    /* One read-only message shared by every thread, the shorter ones are its prefixes */
+    unsigned char *buffer = clc_scratch(ctx, params, p->max);
+    if (buffer == NULL)
+    {
+        return CPUBENCH_ERR_NOMEM;
+    }
+    for (i = 0; i < p->max; i++)
+    {
+        buffer[i] = (unsigned char)(clc_mix64(i >> 3) >> ((i & 7) * 8));
+    }
+
+    for (algorithm = CPUBENCH_HASH_MD5; algorithm <= CPUBENCH_HASH_BLAKE2S256 && status == CPUBENCH_OK; algorithm++)
+    {
+        double best = 0;
+
+        if (p->algorithm != CPUBENCH_HASH_ALL && (int)p->algorithm != algorithm)
+        {
+            continue;
+        }
+        EVP_MD *md = clc_hash_fetch(algorithm);
+        if (md == NULL)
+        {
+            return CPUBENCH_ERR_UNSUPPORTED;
+        }
+
+        /* From a single block to beyond the last level cache, by factors of 4 */
+        for (size = p->min; size <= p->max && status == CPUBENCH_OK; size = (size > p->max / 4) ? p->max + 1 : size * 4)
+        {
+            unsigned long long count = (p->volume << 20) / size;
+            count = (count > 0) ? count : 1;
+            double seconds = clc_hash_run(params, threads, md, buffer, size, count);
+            if (seconds < 0)
+            {
+                status = CPUBENCH_ERR_UNSUPPORTED;
+                break;
+            }
+            double rate = (double)threads * count * size / seconds;
+            best = (rate > best) ? rate : best;
+            total += (unsigned long long)threads * count * size;
+            clc_format_size(size_name, sizeof(size_name), size);
+            snprintf(label, sizeof(label), "%s %s", clc_hash_names[algorithm], size_name);
+            status = clc_add_metric(result, "bandwidth", label, "B/s", rate);
+        }
+
+        /* Cycles of one core per byte, at the best message size. Threads sharing a core share its cycles */
+        if (status == CPUBENCH_OK)
+        {
+            status = clc_add_metric(result, "cycles_per_byte", clc_hash_names[algorithm], "cycles/B", hz * cores / best);
+        }
+
+        /* The digests of the whole message are the checksum, so any thread count gives the same one */
+        if (status == CPUBENCH_OK && EVP_Digest(buffer, p->max, digest, &len, md, NULL))
+        {
+            for (d = 0; d < len && strlen(digests) + 3 < sizeof(digests); d++)
+            {
+                snprintf(digests + strlen(digests), 3, "%02x", (unsigned int)digest[d]);
+            }
+        }
+        clc_hash_release(md);
+        if (ctx->progress_cb != NULL)
+        {
+            clc_progress(ctx, CPUBENCH_WORKLOAD_HASH, (unsigned long long)algorithm, CPUBENCH_HASH_BLAKE2S256, start);
+        }
+    }
+    if (status != CPUBENCH_OK)
+    {
+        return status;
+    }
+
+    clc_md5(digests, result->checksum);
+    result->threads = threads;
+    result->seconds = cpubench_timer_seconds(cpubench_timer_now() - start);
+    result->count = total;
+    return CPUBENCH_OK;
+}
+
+/* Ciphers of the AEAD workload by their OpenSSL names, in cpubench_aead_cipher order */
+static const char *const clc_aead_names[] = { "all", "aes-128-gcm", "aes-256-gcm", "chacha20-poly1305" };
+
+/* Bytes of additional data per record, the size of a TLS 1.2 record header plus sequence number */
+#define CLC_AEAD_AAD 13
+
+/* Bytes of the authentication tag */
+#define CLC_AEAD_TAG 16
+
+/* Key of every AEAD run, 32 bytes so it serves all three ciphers */
+static const unsigned char clc_aead_key[32] = "cpubench authenticated cipher!!";
+
+static EVP_CIPHER *clc_aead_fetch(int cipher)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    return EVP_CIPHER_fetch(NULL, clc_aead_names[cipher], NULL);
+#else
+    return (EVP_CIPHER *)EVP_get_cipherbyname(clc_aead_names[cipher]);
+#endif
+}
+
+static void clc_aead_release(EVP_CIPHER *cipher)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    EVP_CIPHER_free(cipher);
+#else
+    (void)cipher;
+#endif
+}
+
+/* Seal or open one record of size bytes, the key is already set. The record number goes into the
+ * nonce as TLS does. Returns 0 on failure, which for open includes a tag mismatch */
+static int clc_aead_record(EVP_CIPHER_CTX *c, int open, unsigned long long record, const unsigned char *in,
+                           unsigned char *out, size_t size, unsigned char tag[CLC_AEAD_TAG])
+{
+    unsigned char iv[12] = { 0 }, aad[CLC_AEAD_AAD] = { 0 };
+    int len, b;
+
+    for (b = 0; b < 8; b++)
+    {
+        iv[4 + b] = aad[b] = (unsigned char)(record >> (56 - 8 * b));
+    }
+    aad[11] = (unsigned char)(size >> 8);
+    aad[12] = (unsigned char)size;
+    if (!open)
+    {
+        return EVP_EncryptInit_ex(c, NULL, NULL, NULL, iv) && EVP_EncryptUpdate(c, NULL, &len, aad, CLC_AEAD_AAD)
+               && EVP_EncryptUpdate(c, out, &len, in, (int)size) && EVP_EncryptFinal_ex(c, out + len, &len)
+               && EVP_CIPHER_CTX_ctrl(c, EVP_CTRL_AEAD_GET_TAG, CLC_AEAD_TAG, tag);
+    }
+    return EVP_DecryptInit_ex(c, NULL, NULL, NULL, iv) && EVP_DecryptUpdate(c, NULL, &len, aad, CLC_AEAD_AAD)
+           && EVP_DecryptUpdate(c, out, &len, in, (int)size) && EVP_CIPHER_CTX_ctrl(c, EVP_CTRL_AEAD_SET_TAG, CLC_AEAD_TAG, tag)
+           && EVP_DecryptFinal_ex(c, out + len, &len) > 0;
+}
+
+/* Seal, or open, count records of size bytes on every thread. Each thread works on its own
+ * plaintext, sealed copy and output in buffers, 3 * stride bytes apart. Opening replays one record
+ * sealed beforehand, and checks the plaintext comes back. Returns the seconds taken, or a negative
+ * value if OpenSSL failed or a record didn't open */
+static double clc_aead_run(const cpubench_params *params, int threads, const EVP_CIPHER *cipher, int open, unsigned char *buffers,
+                           size_t stride, size_t size, unsigned long long count)
+{
+    unsigned long long start = 0;
+    double seconds = 0;
+    int failed = 0;
+
+    #pragma omp parallel num_threads (threads) reduction (|:failed)
+    {
+        EVP_CIPHER_CTX *c = EVP_CIPHER_CTX_new();
+        unsigned char *plain = buffers + 3 * stride * (size_t)omp_get_thread_num();
+        unsigned char *sealed = plain + stride, *out = sealed + stride;
+        unsigned char tag[CLC_AEAD_TAG];
+        unsigned long long m;
+
+        clc_place_worker(params, omp_get_thread_num());
+        failed = (c == NULL || !EVP_EncryptInit_ex(c, cipher, NULL, clc_aead_key, NULL) || !clc_aead_record(c, 0, 0, plain, sealed, size, tag));
+        if (!failed && open)
+        {
+            failed = (!EVP_DecryptInit_ex(c, cipher, NULL, clc_aead_key, NULL) || !clc_aead_record(c, 1, 0, sealed, out, size, tag));
+        }
+
+        #pragma omp barrier
+        #pragma omp master
+        start = cpubench_timer_now();
+        #pragma omp barrier
+
+        for (m = 0; m < count && !failed; m++)
+        {
+            failed = open ? !clc_aead_record(c, 1, 0, sealed, out, size, tag) : !clc_aead_record(c, 0, m, plain, out, size, tag);
+        }
+
+        #pragma omp barrier
+        #pragma omp master
+        seconds = cpubench_timer_seconds(cpubench_timer_now() - start);
+        failed |= (open && memcmp(out, plain, size) != 0);
+        EVP_CIPHER_CTX_free(c);
+    }
+    return failed ? -1 : seconds;
+}
+
+/* Authenticated encryption throughput */
+static cpubench_status clc_aead(cpubench_ctx *ctx, const cpubench_params *params, cpubench_result *result)
+{
+    static const char *const names[2][2] = { { "encrypt", "decrypt" }, { "encrypt_all_cores", "decrypt_all_cores" } };
+    const cpubench_aead_params *p = &params->u.aead;
+    int threads = clc_threads(ctx, params);
+    unsigned long long start = cpubench_timer_now(), total = 0;
+    double hz = clc_measure_frequency();
+    unsigned char tag[CLC_AEAD_TAG];
+    char label[64], size_name[32], tags[512] = "";
+    size_t i, size;
+    int cipher, pass, open, d;
+    cpubench_status status = CPUBENCH_OK;
+
+    if (p->min < 1 || p->max < p->min || p->max > (1UL << 30) || p->volume < 1 || (unsigned int)p->cipher > CPUBENCH_AEAD_CHACHA20_POLY1305)
+    {
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+    hz = (hz > 0) ? hz : clc_timer.tsc_hz;
+
+    /* Plaintext, sealed record and output per thread, the same plaintext on every thread */
+    size_t stride = (p->max + 63) & ~(size_t)63;
+    unsigned char *buffers = clc_scratch(ctx, params, 3 * stride * (size_t)threads);
+    if (buffers == NULL)
+    {
+        return CPUBENCH_ERR_NOMEM;
+    }
+    for (i = 0; i < 3 * stride * (size_t)threads; i++)
+    {
+        buffers[i] = (unsigned char)(clc_mix64((i % (3 * stride)) >> 3) >> ((i & 7) * 8));
+    }
+
+    for (cipher = CPUBENCH_AEAD_AES_128_GCM; cipher <= CPUBENCH_AEAD_CHACHA20_POLY1305 && status == CPUBENCH_OK; cipher++)
+    {
+        double best = 0;
+
+        if (p->cipher != CPUBENCH_AEAD_ALL && (int)p->cipher != cipher)
+        {
+            continue;
+        }
+        EVP_CIPHER *evp = clc_aead_fetch(cipher);
+        if (evp == NULL)
+        {
+            return CPUBENCH_ERR_UNSUPPORTED;
+        }
+
+        /* One core first, then all of them when there are more */
+        for (pass = 0; pass < ((threads > 1) ? 2 : 1) && status == CPUBENCH_OK; pass++)
+        {
+            int used = pass ? threads : 1;
+            for (open = 0; open < 2 && status == CPUBENCH_OK; open++)
+            {
+                for (size = p->min; size <= p->max && status == CPUBENCH_OK; size = (size > p->max / 4) ? p->max + 1 : size * 4)
+                {
+                    unsigned long long count = (p->volume << 20) / size;
+                    count = (count > 0) ? count : 1;
+                    double seconds = clc_aead_run(params, used, evp, open, buffers, stride, size, count);
+                    if (seconds < 0)
+                    {
+                        status = CPUBENCH_ERR_UNSUPPORTED;
+                        break;
+                    }
+                    double rate = (double)used * count * size / seconds;
+                    best = (!pass && !open && rate > best) ? rate : best;
+                    total += (unsigned long long)used * count * size;
+                    clc_format_size(size_name, sizeof(size_name), size);
+                    snprintf(label, sizeof(label), "%s %s", clc_aead_names[cipher], size_name);
+                    status = clc_add_metric(result, names[pass][open], label, "B/s", rate);
+                }
+            }
+        }
+
+        /* Cycles of one core per byte sealed, at the best record size */
+        if (status == CPUBENCH_OK)
+        {
+            status = clc_add_metric(result, "cycles_per_byte", clc_aead_names[cipher], "cycles/B", hz / best);
+        }
+
+        /* The tag of the largest record is the checksum, so any thread count gives the same one */
+        EVP_CIPHER_CTX *c = EVP_CIPHER_CTX_new();
+        if (status == CPUBENCH_OK && c != NULL && EVP_EncryptInit_ex(c, evp, NULL, clc_aead_key, NULL)
+            && clc_aead_record(c, 0, 0, buffers, buffers + 2 * stride, p->max, tag))
+        {
+            for (d = 0; d < CLC_AEAD_TAG; d++)
+            {
+                snprintf(tags + strlen(tags), 3, "%02x", (unsigned int)tag[d]);
+            }
+        }
+        EVP_CIPHER_CTX_free(c);
+        clc_aead_release(evp);
+        if (ctx->progress_cb != NULL)
+        {
+            clc_progress(ctx, CPUBENCH_WORKLOAD_AEAD, (unsigned long long)cipher, CPUBENCH_AEAD_CHACHA20_POLY1305, start);
+        }
+    }
+    if (status != CPUBENCH_OK)
+    {
+        return status;
+    }
+
+    clc_md5(tags, result->checksum);
+    result->threads = threads;
+    result->seconds = cpubench_timer_seconds(cpubench_timer_now() - start);
+    result->count = total;
+    return CPUBENCH_OK;
+}
+
+/* Algorithms of the public-key workload, in cpubench_pkey_algorithm order */
+static const char *const clc_pkey_names[] = { "all", "rsa2048", "rsa4096", "ecdsa-p256", "x25519", "ed25519" };
+
+/* Latencies kept per thread and operation, beyond that a uniform sample of all calls */
+#define CLC_PKEY_SAMPLES 65536
+
+/* One timed operation of an algorithm */
+static const struct clc_pkey_op
+{
+    int algorithm;
+    const char *label;
+    int verify;
+} clc_pkey_ops[] =
+{
+    { CPUBENCH_PKEY_RSA2048, "rsa2048 sign", 0 },
+    { CPUBENCH_PKEY_RSA2048, "rsa2048 verify", 1 },
+    { CPUBENCH_PKEY_RSA4096, "rsa4096 sign", 0 },
+    { CPUBENCH_PKEY_RSA4096, "rsa4096 verify", 1 },
+    { CPUBENCH_PKEY_ECDSA_P256, "ecdsa-p256 sign", 0 },
+    { CPUBENCH_PKEY_ECDSA_P256, "ecdsa-p256 verify", 1 },
+    { CPUBENCH_PKEY_X25519, "x25519 derive", 0 },
+    { CPUBENCH_PKEY_ED25519, "ed25519 sign", 0 },
+    { CPUBENCH_PKEY_ED25519, "ed25519 verify", 1 }
+};
+
+/* A fresh key pair of an algorithm, NULL on failure */
+static EVP_PKEY *clc_pkey_keygen(int algorithm)
+{
+    static const int types[] = { 0, EVP_PKEY_RSA, EVP_PKEY_RSA, EVP_PKEY_EC, EVP_PKEY_X25519, EVP_PKEY_ED25519 };
+    EVP_PKEY_CTX *c = EVP_PKEY_CTX_new_id(types[algorithm], NULL);
+    EVP_PKEY *key = NULL;
+    int ok = (c != NULL && EVP_PKEY_keygen_init(c) > 0);
+
+    if (ok && algorithm == CPUBENCH_PKEY_RSA2048)
+    {
+        ok = (EVP_PKEY_CTX_set_rsa_keygen_bits(c, 2048) > 0);
+    }
+    else if (ok && algorithm == CPUBENCH_PKEY_RSA4096)
+    {
+        ok = (EVP_PKEY_CTX_set_rsa_keygen_bits(c, 4096) > 0);
+    }
+    else if (ok && algorithm == CPUBENCH_PKEY_ECDSA_P256)
+    {
+        ok = (EVP_PKEY_CTX_set_ec_paramgen_curve_nid(c, NID_X9_62_prime256v1) > 0);
+    }
+    if (ok && EVP_PKEY_keygen(c, &key) <= 0)
+    {
+        key = NULL;
+    }
+    EVP_PKEY_CTX_free(c);
+    return key;
+}
+
+/* State of one thread running an operation: its own contexts over the shared keys, and the
+ * signature it verifies */
+struct clc_pkey_worker
+{
+    EVP_PKEY_CTX *pctx;
+    EVP_MD_CTX *mctx;
+    unsigned char sig[1024];
+    size_t siglen;
+};
+
+/* Run an operation once. The message is a SHA-256 digest, signed as is by RSA and ECDSA and as
+ * a message by Ed25519. Returns 0 on failure, which for verify includes a bad signature */
+static int clc_pkey_once(const struct clc_pkey_op *op, EVP_PKEY *key, struct clc_pkey_worker *w, const unsigned char digest[32])
+{
+    unsigned char secret[64];
+    size_t len;
+
+    switch (op->algorithm)
+    {
+    case CPUBENCH_PKEY_X25519:
+        len = sizeof(secret);
+        return EVP_PKEY_derive(w->pctx, secret, &len) > 0;
+    case CPUBENCH_PKEY_ED25519:
+        if (op->verify)
+        {
+            return EVP_DigestVerifyInit(w->mctx, NULL, NULL, NULL, key) > 0 && EVP_DigestVerify(w->mctx, w->sig, w->siglen, digest, 32) == 1;
+        }
+        w->siglen = sizeof(w->sig);
+        return EVP_DigestSignInit(w->mctx, NULL, NULL, NULL, key) > 0 && EVP_DigestSign(w->mctx, w->sig, &w->siglen, digest, 32) > 0;
+    default:
+        if (op->verify)
+        {
+            return EVP_PKEY_verify(w->pctx, w->sig, w->siglen, digest, 32) == 1;
+        }
+        w->siglen = sizeof(w->sig);
+        return EVP_PKEY_sign(w->pctx, w->sig, &w->siglen, digest, 32) > 0;
+    }
+}
+
+/* Set a worker up for an operation, signing once first if it verifies. Returns 0 on failure */
+static int clc_pkey_prepare(const struct clc_pkey_op *op, EVP_PKEY *key, EVP_PKEY *peer, struct clc_pkey_worker *w, const unsigned char digest[32])
+{
+    struct clc_pkey_op sign = *op;
+
+    if ((w->pctx = EVP_PKEY_CTX_new(key, NULL)) == NULL || (w->mctx = EVP_MD_CTX_new()) == NULL)
+    {
+        return 0;
+    }
+    switch (op->algorithm)
+    {
+    case CPUBENCH_PKEY_X25519:
+        return EVP_PKEY_derive_init(w->pctx) > 0 && EVP_PKEY_derive_set_peer(w->pctx, peer) > 0;
+    case CPUBENCH_PKEY_ED25519:
+        sign.verify = 0;
+        return !op->verify || clc_pkey_once(&sign, key, w, digest);
+    default:
+        if (op->verify)
+        {
+            sign.verify = 0;
+            if (EVP_PKEY_sign_init(w->pctx) <= 0 || EVP_PKEY_CTX_set_signature_md(w->pctx, EVP_sha256()) <= 0 || !clc_pkey_once(&sign, key, w, digest))
+            {
+                return 0;
+            }
+            return EVP_PKEY_verify_init(w->pctx) > 0 && EVP_PKEY_CTX_set_signature_md(w->pctx, EVP_sha256()) > 0;
+        }
+        return EVP_PKEY_sign_init(w->pctx) > 0 && EVP_PKEY_CTX_set_signature_md(w->pctx, EVP_sha256()) > 0;
+    }
+}
+
+/* Run an operation on every thread for seconds, timing each call. Latencies in ticks go to
+ * samples, CLC_PKEY_SAMPLES per thread by reservoir sampling once there are more calls, and the
+ * calls each thread made to counts. Returns the seconds taken, or a negative value if any call failed */
+static double clc_pkey_run(const cpubench_params *params, int threads, const struct clc_pkey_op *op, EVP_PKEY *key, EVP_PKEY *peer,
+                           double seconds, unsigned long long *samples, size_t *counts)
+{
+    static const unsigned char digest[32] = "cpubench public key message....";
+    unsigned long long start = 0, ticks = (unsigned long long)(seconds / clc_timer.seconds_per_tick);
+    double taken = 0;
+    int failed = 0;
+
+    #pragma omp parallel num_threads (threads) reduction (|:failed)
+    {
+        struct clc_pkey_worker w;
+        unsigned long long *mine = samples + (size_t)omp_get_thread_num() * CLC_PKEY_SAMPLES;
+        unsigned long long state = (unsigned long long)omp_get_thread_num();
+        size_t n = 0;
+
+        clc_place_worker(params, omp_get_thread_num());
+        memset(&w, 0, sizeof(w));
+        /* One untimed call, so per-key setup such as RSA blinding stays out of the latencies */
+        failed = !clc_pkey_prepare(op, key, peer, &w, digest) || !clc_pkey_once(op, key, &w, digest);
+
+        #pragma omp barrier
+        #pragma omp master
+        start = cpubench_timer_now();
+        #pragma omp barrier
+
+        while (!failed)
+        {
+            unsigned long long t0 = cpubench_timer_now();
+            failed = !clc_pkey_once(op, key, &w, digest);
+            unsigned long long t1 = cpubench_timer_now();
+            size_t slot = n;
+            if (n >= CLC_PKEY_SAMPLES)
+            {
+                state = clc_mix64(state);
+                slot = (size_t)(state % (n + 1));
+            }
+            if (slot < CLC_PKEY_SAMPLES)
+            {
+                mine[slot] = t1 - t0;
+            }
+            n++;
+            if (t1 - start >= ticks)
+            {
+                break;
+            }
+        }
+
+        #pragma omp barrier
+        #pragma omp master
+        taken = cpubench_timer_seconds(cpubench_timer_now() - start);
+        counts[omp_get_thread_num()] = n;
+        EVP_PKEY_CTX_free(w.pctx);
+        EVP_MD_CTX_free(w.mctx);
+    }
+    return failed ? -1 : taken;
+}
+
+/* Public-key operations per second */
+static cpubench_status clc_pkey(cpubench_ctx *ctx, const cpubench_params *params, cpubench_result *result)
+{
+    static const char *const names[2] = { "ops", "ops_all_cores" };
+    static const char *const percentiles[3] = { "latency_p50", "latency_p99", "latency_p99.9" };
+    static const double ranks[3] = { 0.5, 0.99, 0.999 };
+    const cpubench_pkey_params *p = &params->u.pkey;
+    int threads = clc_threads(ctx, params);
+    unsigned long long start = cpubench_timer_now(), total = 0;
+    char label[64], verdict[64];
+    size_t o, t, n;
+    int pass, q, valid = 1, run = 0;
+    cpubench_status status = CPUBENCH_OK;
+
+    if (p->duration < 1 || (unsigned int)p->algorithm > CPUBENCH_PKEY_ED25519)
+    {
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+    unsigned long long *samples = clc_scratch(ctx, params, (size_t)threads * CLC_PKEY_SAMPLES * sizeof(unsigned long long));
+    size_t *counts = malloc((size_t)threads * sizeof(size_t));
+    if (samples == NULL || counts == NULL)
+    {
+        free(counts);
+        return CPUBENCH_ERR_NOMEM;
+    }
+
+    /* Key pairs are made once per algorithm and shared by every thread, X25519 agrees with a second one */
+    EVP_PKEY *key = NULL, *peer = NULL;
+    for (o = 0; o < sizeof(clc_pkey_ops) / sizeof(clc_pkey_ops[0]) && status == CPUBENCH_OK; o++)
+    {
+        const struct clc_pkey_op *op = &clc_pkey_ops[o];
+
+        if (p->algorithm != CPUBENCH_PKEY_ALL && (int)p->algorithm != op->algorithm)
+        {
+            continue;
+        }
+        if (o == 0 || clc_pkey_ops[o - 1].algorithm != op->algorithm || key == NULL)
+        {
+            EVP_PKEY_free(key);
+            EVP_PKEY_free(peer);
+            key = clc_pkey_keygen(op->algorithm);
+            peer = (op->algorithm == CPUBENCH_PKEY_X25519) ? clc_pkey_keygen(op->algorithm) : NULL;
+            if (key == NULL || (op->algorithm == CPUBENCH_PKEY_X25519 && peer == NULL))
+            {
+                status = CPUBENCH_ERR_UNSUPPORTED;
+                break;
+            }
+        }
+        run |= 1 << o;
+
+        /* One core first, then all of them when there are more */
+        for (pass = 0; pass < ((threads > 1) ? 2 : 1) && status == CPUBENCH_OK; pass++)
+        {
+            int used = pass ? threads : 1;
+            double seconds = clc_pkey_run(params, used, op, key, peer, p->duration / 1E3, samples, counts);
+            if (seconds < 0)
+            {
+                valid = 0;
+                continue;
+            }
+
+            /* Gather every thread's latencies and read the percentiles by nearest rank */
+            unsigned long long calls = 0;
+            for (t = 0, n = 0; t < (size_t)used; t++)
+            {
+                size_t kept = (counts[t] < CLC_PKEY_SAMPLES) ? counts[t] : CLC_PKEY_SAMPLES;
+                memmove(samples + n, samples + t * CLC_PKEY_SAMPLES, kept * sizeof(unsigned long long));
+                n += kept;
+                calls += counts[t];
+            }
+            qsort(samples, n, sizeof(*samples), clc_compare_ull);
+            total += calls;
+
+            snprintf(label, sizeof(label), pass ? "%s all" : "%s", op->label);
+            status = clc_add_metric(result, names[pass], label, "op/s", (double)calls / seconds);
+            for (q = 0; q < 3 && status == CPUBENCH_OK; q++)
+            {
+                size_t rank = (size_t)ceil(ranks[q] * (double)n);
+                double us = cpubench_timer_seconds(samples[(rank > 0) ? rank - 1 : 0]) * 1E6;
+                status = clc_add_metric(result, percentiles[q], label, "us", us);
+            }
+        }
+        if (ctx->progress_cb != NULL)
+        {
+            clc_progress(ctx, CPUBENCH_WORKLOAD_PKEY, (unsigned long long)o + 1, sizeof(clc_pkey_ops) / sizeof(clc_pkey_ops[0]), start);
+        }
+    }
+    EVP_PKEY_free(key);
+    EVP_PKEY_free(peer);
+    free(counts);
+    if (status != CPUBENCH_OK)
+    {
+        return status;
+    }
+
+    /* Keys and ECDSA nonces are random, so the checksum only says whether every operation worked */
+    snprintf(verdict, sizeof(verdict), "%s %d", valid ? "valid" : "invalid", run);
+    clc_md5(verdict, result->checksum);
+    result->threads = threads;
+    result->seconds = cpubench_timer_seconds(cpubench_timer_now() - start);
+    result->count = total;
+    return CPUBENCH_OK;
+}
+
+/* Operations of the GMP number theory workload, in cpubench_gmp_op order */
+static const char *const clc_gmp_names[] = { "all", "powm", "powm_sec", "gcd", "gcdext", "invert" };
+
+/* Largest default exponent of powm in bits, beyond that the time per operation runs into seconds */
+#define CLC_GMP_EXPONENT 1024
+
+/* Largest operand of powm_sec in bits. It keeps to quadratic schoolbook arithmetic so its timing
+ * can't depend on the operands, and beyond this one call takes seconds */
+#define CLC_GMP_SEC_MAX (1UL << 15)
+
+/* Operands and results of one thread */
+struct clc_gmp_operands
+{
+    mpz_t a, b, m, e, r, s, t;
+};
+
+/* Random operands of exactly bits bits: a below the odd modulus m, b as long as m, and an
+ * exponent of ebits bits */
+static void clc_gmp_operands_init(struct clc_gmp_operands *o, gmp_randstate_t rng, unsigned long bits, unsigned long ebits)
+{
+    mpz_inits(o->a, o->b, o->m, o->e, o->r, o->s, o->t, NULL);
+    mpz_urandomb(o->m, rng, bits);
+    mpz_setbit(o->m, bits - 1);
+    mpz_setbit(o->m, 0);
+    mpz_urandomb(o->b, rng, bits);
+    mpz_setbit(o->b, bits - 1);
+    mpz_urandomm(o->a, rng, o->m);
+    mpz_urandomb(o->e, rng, ebits);
+    mpz_setbit(o->e, ebits - 1);
+}
+
+static void clc_gmp_operands_clear(struct clc_gmp_operands *o)
+{
+    mpz_clears(o->a, o->b, o->m, o->e, o->r, o->s, o->t, NULL);
+}
+
+/* Run an operation once, the result goes to o->r */
+static void clc_gmp_once(int op, struct clc_gmp_operands *o)
+{
+    switch (op)
+    {
+    case CPUBENCH_GMP_POWM:
+        mpz_powm(o->r, o->a, o->e, o->m);
+        break;
+    case CPUBENCH_GMP_POWM_SEC:
+        mpz_powm_sec(o->r, o->a, o->e, o->m);
+        break;
+    case CPUBENCH_GMP_GCD:
+        mpz_gcd(o->r, o->a, o->b);
+        break;
+    case CPUBENCH_GMP_GCDEXT:
+        mpz_gcdext(o->r, o->s, o->t, o->a, o->b);
+        break;
+    default:
+        mpz_invert(o->r, o->a, o->m);
+        break;
+    }
+}
+
+/* Run an operation on bits-bit operands on every thread for seconds, each thread on operands of
+ * its own, and at least once. Returns the operations done and their time in *taken, and the low
+ * limb of the first result of thread 0 in *low */
+static unsigned long long clc_gmp_run(const cpubench_params *params, int threads, int op, unsigned long bits, unsigned long ebits,
+                                      double seconds, double *taken, unsigned long *low)
+{
+    unsigned long long start = 0, ticks = (unsigned long long)(seconds / clc_timer.seconds_per_tick), done = 0;
+
+    #pragma omp parallel num_threads (threads) reduction (+:done)
+    {
+        struct clc_gmp_operands o;
+        gmp_randstate_t rng;
+        int me = omp_get_thread_num();
+
+        clc_place_worker(params, me);
+        gmp_randinit_default(rng);
+        gmp_randseed_ui(rng, (unsigned long)me * 1000003UL + bits);
+        clc_gmp_operands_init(&o, rng, bits, ebits);
+
+        #pragma omp barrier
+        #pragma omp master
+        start = cpubench_timer_now();
+        #pragma omp barrier
+
+        do
+        {
+            clc_gmp_once(op, &o);
+            if (done++ == 0 && me == 0)
+            {
+                *low = mpz_getlimbn(o.r, 0);
+            }
+        } while (cpubench_timer_now() - start < ticks);
+
+        #pragma omp barrier
+        #pragma omp master
+        *taken = cpubench_timer_seconds(cpubench_timer_now() - start);
+        clc_gmp_operands_clear(&o);
+        gmp_randclear(rng);
+    }
+    return done;
+}
+
+/* GMP modular exponentiation, GCD and inverse */
+static cpubench_status clc_gmp(cpubench_ctx *ctx, const cpubench_params *params, cpubench_result *result)
+{
+    const cpubench_gmp_params *p = &params->u.gmp;
+    int threads = clc_threads(ctx, params);
+    unsigned long long start = cpubench_timer_now(), total = 0;
+    unsigned long bits, low = 0;
+    char label[64], *lows = NULL;
+    size_t len = 0;
+    int op;
+    cpubench_status status = CPUBENCH_OK;
+
+    if (p->min < 2 || p->max < p->min || (unsigned int)p->op > CPUBENCH_GMP_INVERT || p->duration < 1)
+    {
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+    FILE *checksum = open_memstream(&lows, &len);
+    if (checksum == NULL)
+    {
+        return CPUBENCH_ERR_NOMEM;
+    }
+
+    for (op = CPUBENCH_GMP_POWM; op <= CPUBENCH_GMP_INVERT && status == CPUBENCH_OK; op++)
+    {
+        if (p->op != CPUBENCH_GMP_ALL && (int)p->op != op)
+        {
+            continue;
+        }
+
+        /* Doubling sizes, so the steps where GMP switches algorithm show as kinks in the curve */
+        for (bits = p->min; bits <= p->max && (op != CPUBENCH_GMP_POWM_SEC || bits <= CLC_GMP_SEC_MAX) && status == CPUBENCH_OK;
+             bits = (bits > p->max / 2) ? p->max + 1 : bits * 2)
+        {
+            unsigned long ebits = (p->exponent > 0) ? p->exponent : (bits < CLC_GMP_EXPONENT) ? bits : CLC_GMP_EXPONENT;
+            double seconds = 0;
+            unsigned long long done = clc_gmp_run(params, threads, op, bits, ebits, p->duration / 1E3, &seconds, &low);
+
+            total += done;
+            fprintf(checksum, "%s %lu %lx\n", clc_gmp_names[op], bits, low);
+            snprintf(label, sizeof(label), "%s %lu bits", clc_gmp_names[op], bits);
+            status = clc_add_metric(result, "ops", label, "op/s", (double)done / seconds);
+        }
+        if (ctx->progress_cb != NULL)
+        {
+            clc_progress(ctx, CPUBENCH_WORKLOAD_GMP, (unsigned long long)op, CPUBENCH_GMP_INVERT, start);
+        }
+    }
+    fclose(checksum);
+    if (status != CPUBENCH_OK || lows == NULL)
+    {
+        free(lows);
+        return (status != CPUBENCH_OK) ? status : CPUBENCH_ERR_NOMEM;
+    }
+
+    /* Thread 0 always starts from the same operands, so its first results don't depend on the thread count */
+    clc_md5(lows, result->checksum);
+    free(lows);
+    result->threads = threads;
+    result->seconds = cpubench_timer_seconds(cpubench_timer_now() - start);
+    result->count = total;
+    return CPUBENCH_OK;
+}
+
+/* Time mpz_mul of a by b, or of a by itself, for seconds and at least once. Calls run in
+ * batches that double while they are short, so reading the clock doesn't swamp one-limb products.
+ * GMP has no mpz_sqr, mpz_mul spots the repeated operand and squares. Returns the seconds per operation */
+static double clc_bigmul_time(int square, mpz_t r, const mpz_t a, const mpz_t b, double seconds)
+{
+    unsigned long long start = cpubench_timer_now(), ticks = (unsigned long long)(seconds / clc_timer.seconds_per_tick);
+    unsigned long long batch = 1, done = 0, now, k;
+
+    do
+    {
+        for (k = 0; k < batch; k++)
+        {
+            if (square)
+            {
+                mpz_mul(r, a, a);
+            }
+            else
+            {
+                mpz_mul(r, a, b);
+            }
+        }
+        done += batch;
+        now = cpubench_timer_now();
+        batch = (now - start < ticks / 64) ? batch * 2 : batch;
+    } while (now - start < ticks);
+    return cpubench_timer_seconds(now - start) / (double)done;
+}
+
+/* Big-integer multiplication and squaring */
+static cpubench_status clc_bigmul(cpubench_ctx *ctx, const cpubench_params *params, cpubench_result *result)
+{
+    static const char *const names[2] = { "mul", "sqr" };
+    const cpubench_bigmul_params *p = &params->u.bigmul;
+    unsigned long long start = cpubench_timer_now(), total = 0;
+    unsigned long limbs, last = 0, max = (p->max + GMP_NUMB_BITS - 1) / GMP_NUMB_BITS;
+    char label[64], *lows = NULL;
+    size_t len = 0;
+    gmp_randstate_t rng;
+    mpz_t a, b, r;
+    int step, square;
+    cpubench_status status = CPUBENCH_OK;
+
+    if (p->max < 1 || p->steps < 1 || p->steps > 16 || p->duration < 1)
+    {
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+    FILE *checksum = open_memstream(&lows, &len);
+    if (checksum == NULL)
+    {
+        return CPUBENCH_ERR_NOMEM;
+    }
+    gmp_randinit_default(rng);
+    mpz_inits(a, b, r, NULL);
+
+    /* steps sizes per doubling of the limb count, from one limb up through the Toom and FFT ranges */
+    for (step = 0; status == CPUBENCH_OK; step++)
+    {
+        limbs = (unsigned long)floor(pow(2.0, (double)step / p->steps) + 0.5);
+        if (limbs > max)
+        {
+            break;
+        }
+        if (limbs == last)
+        {
+            continue;
+        }
+        last = limbs;
+
+        /* Fresh operands with the top bit set, and room for the product so the loop doesn't reallocate */
+        mpz_urandomb(a, rng, limbs * GMP_NUMB_BITS);
+        mpz_setbit(a, limbs * GMP_NUMB_BITS - 1);
+        mpz_urandomb(b, rng, limbs * GMP_NUMB_BITS);
+        mpz_setbit(b, limbs * GMP_NUMB_BITS - 1);
+        mpz_realloc2(r, 2 * limbs * GMP_NUMB_BITS);
+
+        for (square = 0; square < 2 && status == CPUBENCH_OK; square++)
+        {
+            double seconds = clc_bigmul_time(square, r, a, b, p->duration / 1E3);
+            double nlogn = (double)limbs * ((limbs > 1) ? log2((double)limbs) : 1);
+
+            total += 1;
+            fprintf(checksum, "%s %lu %lx %lx\n", names[square], limbs, (unsigned long)mpz_getlimbn(r, 0),
+                    (unsigned long)mpz_getlimbn(r, (mp_size_t)mpz_size(r) - 1));
+            snprintf(label, sizeof(label), "%s %lu bits", names[square], limbs * GMP_NUMB_BITS);
+            status = clc_add_metric(result, "time", label, "ns", seconds * 1E9);
+            if (status == CPUBENCH_OK)
+            {
+                status = clc_add_metric(result, "nlogn_cost", label, "ns", seconds * 1E9 / nlogn);
+            }
+        }
+        if (ctx->progress_cb != NULL)
+        {
+            clc_progress(ctx, CPUBENCH_WORKLOAD_BIGMUL, limbs, max, start);
+        }
+    }
+    mpz_clears(a, b, r, NULL);
+    gmp_randclear(rng);
+    fclose(checksum);
+    if (status != CPUBENCH_OK || lows == NULL)
+    {
+        free(lows);
+        return (status != CPUBENCH_OK) ? status : CPUBENCH_ERR_NOMEM;
+    }
+
+    /* The operands come from a fixed seed, so the products are the same on every machine */
+    clc_md5(lows, result->checksum);
+    free(lows);
+    result->threads = 1;
+    result->seconds = cpubench_timer_seconds(cpubench_timer_now() - start);
+    result->count = total;
+    return CPUBENCH_OK;
+}
+
+/* Create a benchmark context */
+cpubench_status cpubench_ctx_create(cpubench_ctx **out)
+{
+    if (out == NULL)
+    {
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+
+    *out = calloc(1, sizeof(**out));
+    if (*out == NULL)
+    {
+        return CPUBENCH_ERR_NOMEM;
+    }
+    mpf_init2((*out)->pi_const, 64);
+    (*out)->default_threads = cpubench_max_threads();
+    pthread_once(&clc_timer_once, clc_timer_init);
+    sched_getaffinity(0, sizeof((*out)->affinity), &(*out)->affinity);
+    return CPUBENCH_OK;
+}
+
+/* Destroy a benchmark context */
+void cpubench_ctx_destroy(cpubench_ctx *ctx)
+{
+    if (ctx == NULL)
+    {
+        return;
+    }
+    mpf_clear(ctx->pi_const);
+    free(ctx->scratch);
+    free(ctx);
+}
+
+/* Register the callback invoked while a workload runs */
+void cpubench_set_progress_callback(cpubench_ctx *ctx, cpubench_progress_cb cb, void *user, double interval)
+{
+    ctx->progress_cb = cb;
+    ctx->progress_user = user;
+    ctx->progress_interval = interval;
+}
+
+/* Spin up the thread pool and pre-fault scratch memory */
+cpubench_status cpubench_ctx_warm(cpubench_ctx *ctx, int threads, size_t scratch_bytes)
+{
+    volatile int started = 0;
+
+    if (ctx == NULL || threads < 0)
+    {
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+
+    /* libgomp keeps its workers alive between parallel regions, so one region is enough */
+    #pragma omp parallel num_threads ((threads > 0) ? threads : ctx->default_threads)
+    {
+        #pragma omp atomic
+        started++;
+    }
+
+    if (scratch_bytes > 0 && clc_scratch(ctx, NULL, scratch_bytes) == NULL)
+    {
+        return CPUBENCH_ERR_NOMEM;
+    }
+    return CPUBENCH_OK;
+}
+
+/* Touch the stack the calling thread will use, so deep recursion doesn't fault it in later */
+static void __attribute__((noinline)) clc_prefault_stack(void)
+{
+    volatile char stack[CLC_STACK_PREFAULT];
+    size_t off;
+
+    for (off = 0; off < sizeof(stack); off += 4096)
+    {
+        stack[off] = 0;
+    }
+}
+
+/* Make the calling thread SCHED_FIFO at the lowest real-time priority */
+static int clc_set_fifo(void)
+{
+    struct sched_param sp;
+
+    memset(&sp, 0, sizeof(sp));
+    sp.sched_priority = sched_get_priority_min(SCHED_FIFO);
+    return pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+}
+
+/* Put the calling thread back on SCHED_OTHER */
+static void clc_clear_fifo(void)
+{
+    struct sched_param sp;
+
+    memset(&sp, 0, sizeof(sp));
+    pthread_setschedparam(pthread_self(), SCHED_OTHER, &sp);
+}
+
+/* Take measures against page-fault and scheduler noise */
+cpubench_status cpubench_ctx_isolate(cpubench_ctx *ctx, unsigned int requested, unsigned int *achieved)
+{
+    unsigned int done = 0;
+    int failed = 0;
+
+    if (ctx == NULL || (requested & ~(CPUBENCH_ISOLATE_PREFAULT | CPUBENCH_ISOLATE_MLOCK | CPUBENCH_ISOLATE_FIFO)) != 0)
+    {
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+
+    /* Locking first means everything touched below stays resident */
+    if ((requested & CPUBENCH_ISOLATE_MLOCK) && mlockall(MCL_CURRENT | MCL_FUTURE) == 0)
+    {
+        done |= CPUBENCH_ISOLATE_MLOCK;
+    }
+
+    /* Freed memory stays mapped, so GMP's allocations in later runs reuse faulted-in pages */
+    if (requested & CPUBENCH_ISOLATE_PREFAULT)
+    {
+        mallopt(M_TRIM_THRESHOLD, -1);
+        mallopt(M_MMAP_THRESHOLD, 1 << 30);
+        if (ctx->scratch != NULL)
+        {
+            clc_prefault(ctx->scratch, ctx->scratch_size);
+        }
+        clc_prefault_stack();
+        done |= CPUBENCH_ISOLATE_PREFAULT;
+    }
+
+    /* Threads created later inherit the policy, the existing pool has to be switched over */
+    if ((requested & CPUBENCH_ISOLATE_FIFO) && clc_set_fifo() == 0)
+    {
+        #pragma omp parallel num_threads (ctx->default_threads) reduction (|:failed)
+        {
+            failed |= (omp_get_thread_num() > 0 && clc_set_fifo() != 0);
+        }
+
+        /* All or nothing, a pool that is partly real-time would be neither reported nor fair */
+        if (failed)
+        {
+            #pragma omp parallel num_threads (ctx->default_threads)
+            {
+                clc_clear_fifo();
+            }
+        }
+        done |= failed ? 0 : CPUBENCH_ISOLATE_FIFO;
+    }
+
+    /* Worker stacks, once the pool exists */
+    if (requested & CPUBENCH_ISOLATE_PREFAULT)
+    {
+        #pragma omp parallel num_threads (ctx->default_threads)
+        {
+            clc_prefault_stack();
+        }
+    }
+
+    ctx->isolation = done;
+    if (achieved != NULL)
+    {
+        *achieved = done;
+    }
+    return CPUBENCH_OK;
+}
+
+/* Register the callback invoked for every result */
+void cpubench_set_result_callback(cpubench_ctx *ctx, cpubench_result_cb cb, void *user)
+{
+    ctx->result_cb = cb;
+    ctx->result_user = user;
+}
+
+/* Fill params with the defaults of a workload */
+void cpubench_params_init(cpubench_params *params, cpubench_workload workload)
+{
+    memset(params, 0, sizeof(*params));
+    params->workload = workload;
+
+    switch (workload)
+    {
+    case CPUBENCH_WORKLOAD_PI:
+        params->u.pi.digits = 10000;
+        break;
+    case CPUBENCH_WORKLOAD_PRIMES:
+        params->u.prime.max = 10000;
+        break;
+    case CPUBENCH_WORKLOAD_STREAM:
+        params->u.stream.bytes = 128ULL << 20;
+        params->u.stream.ntimes = 10;
+        break;
+    case CPUBENCH_WORKLOAD_LATENCY:
+        params->u.latency.min_bytes = 4ULL << 10;
+        params->u.latency.max_bytes = 256ULL << 20;
+        params->u.latency.hugepages = 1;
+        break;
+    case CPUBENCH_WORKLOAD_LOADED_LATENCY:
+        params->u.loaded.bytes = 256ULL << 20;
+        params->u.loaded.load_bytes = 64ULL << 20;
+        break;
+    case CPUBENCH_WORKLOAD_GEMM:
+        params->u.gemm.n = 2048;
+        params->u.gemm.ntimes = 3;
+        break;
+    case CPUBENCH_WORKLOAD_HPL:
+        params->u.hpl.n = 4096;
+        params->u.hpl.nb = 128;
+        break;
+    case CPUBENCH_WORKLOAD_HPCG:
+        params->u.hpcg.n = 104;
+        params->u.hpcg.iterations = 50;
+        break;
+    case CPUBENCH_WORKLOAD_FFT:
+        params->u.fft.n = 1UL << 20;
+        params->u.fft.dims = 1;
+        params->u.fft.ntimes = 10;
+        break;
+    case CPUBENCH_WORKLOAD_STENCIL:
+        params->u.stencil.n = 256;
+        params->u.stencil.points = 7;
+        params->u.stencil.steps = 16;
+        params->u.stencil.tile = 4;
+        break;
+    case CPUBENCH_WORKLOAD_SPMV:
+        params->u.spmv.rows = 1UL << 21;
+        params->u.spmv.nnz = 16;
+        params->u.spmv.band = 256;
+        params->u.spmv.alpha = 200;
+        params->u.spmv.chunk = 8;
+        params->u.spmv.sigma = 512;
+        params->u.spmv.ntimes = 20;
+        break;
+    case CPUBENCH_WORKLOAD_HASH:
+        params->u.hash.min = 64;
+        params->u.hash.max = 16UL << 20;
+        params->u.hash.volume = 32;
+        break;
+    case CPUBENCH_WORKLOAD_AEAD:
+        params->u.aead.min = 64;
+        params->u.aead.max = 16384;
+        params->u.aead.volume = 32;
+        break;
+    case CPUBENCH_WORKLOAD_PKEY:
+        params->u.pkey.duration = 500;
+        break;
+    case CPUBENCH_WORKLOAD_GMP:
+        params->u.gmp.min = 256;
+        params->u.gmp.max = 1UL << 20;
+        params->u.gmp.duration = 100;
+        break;
+    case CPUBENCH_WORKLOAD_BIGMUL:
+        params->u.bigmul.max = 1UL << 30;
+        params->u.bigmul.steps = 2;
+        params->u.bigmul.duration = 100;
+        break;
+    default:
+        break;
+    }
+}
+
+/* Parse an unsigned decimal parameter value */
+static cpubench_status clc_parse_ull(const char *value, unsigned long long *out)
+{
+    char *end;
+
+    errno = 0;
+    if (value == NULL || *value == '-')
+    {
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+    *out = strtoull(value, &end, 10);
+    return (errno != 0 || end == value || *end != '\0') ? CPUBENCH_ERR_INVALID_ARG : CPUBENCH_OK;
+}
+
+/* Set a parameter by name */
+cpubench_status cpubench_params_set(cpubench_params *params, const char *key, const char *value)
+{
+    unsigned long long v;
+
+    if (params == NULL || key == NULL || value == NULL)
+    {
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+
+    /* The only parameters that aren't numbers */
+    if (strcmp(key, "cpus") == 0)
+    {
+        return cpubench_cpumask_parse(&params->cpus, value);
+    }
+    if (strcmp(key, "tag") == 0)
+    {
+        snprintf(params->tag, sizeof(params->tag), "%s", value);
+        return CPUBENCH_OK;
+    }
+    if (strcmp(key, "mem") == 0)
+    {
+        static const char *const policies[] = { "default", "local", "bind", "interleave" };
+        int k;
+        for (k = 0; k < 4; k++)
+        {
+            if (strcmp(value, policies[k]) == 0)
+            {
+                params->mem_policy = (cpubench_mem_policy)k;
+                return CPUBENCH_OK;
+            }
+        }
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+    if (strcmp(key, "pattern") == 0 && params->workload == CPUBENCH_WORKLOAD_SPMV)
+    {
+        int k;
+        for (k = CPUBENCH_SPMV_ALL; k <= CPUBENCH_SPMV_POWERLAW; k++)
+        {
+            if (strcmp(value, clc_spmv_patterns[k]) == 0)
+            {
+                params->u.spmv.pattern = (cpubench_spmv_pattern)k;
+                return CPUBENCH_OK;
+            }
+        }
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+    if (strcmp(key, "algorithm") == 0 && params->workload == CPUBENCH_WORKLOAD_HASH)
+    {
+        int k;
+        for (k = CPUBENCH_HASH_ALL; k <= CPUBENCH_HASH_BLAKE2S256; k++)
+        {
+            if (strcmp(value, clc_hash_names[k]) == 0)
+            {
+                params->u.hash.algorithm = (cpubench_hash_algorithm)k;
+                return CPUBENCH_OK;
+            }
+        }
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+    if (strcmp(key, "cipher") == 0 && params->workload == CPUBENCH_WORKLOAD_AEAD)
+    {
+        int k;
+        for (k = CPUBENCH_AEAD_ALL; k <= CPUBENCH_AEAD_CHACHA20_POLY1305; k++)
+        {
+            if (strcmp(value, clc_aead_names[k]) == 0)
+            {
+                params->u.aead.cipher = (cpubench_aead_cipher)k;
+                return CPUBENCH_OK;
+            }
+        }
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+    if (strcmp(key, "algorithm") == 0 && params->workload == CPUBENCH_WORKLOAD_PKEY)
+    {
+        int k;
+        for (k = CPUBENCH_PKEY_ALL; k <= CPUBENCH_PKEY_ED25519; k++)
+        {
+            if (strcmp(value, clc_pkey_names[k]) == 0)
+            {
+                params->u.pkey.algorithm = (cpubench_pkey_algorithm)k;
+                return CPUBENCH_OK;
+            }
+        }
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+    if (strcmp(key, "op") == 0 && params->workload == CPUBENCH_WORKLOAD_GMP)
+    {
+        int k;
+        for (k = CPUBENCH_GMP_ALL; k <= CPUBENCH_GMP_INVERT; k++)
+        {
+            if (strcmp(value, clc_gmp_names[k]) == 0)
+            {
+                params->u.gmp.op = (cpubench_gmp_op)k;
+                return CPUBENCH_OK;
+            }
+        }
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+    if (strcmp(key, "nodes") == 0)
+    {
+        cpubench_cpumask nodes;
+        if (cpubench_cpumask_parse(&nodes, value) != CPUBENCH_OK || cpubench_cpumask_count(&nodes) > __builtin_popcountll(nodes.bits[0]))
+        {
+            return CPUBENCH_ERR_INVALID_ARG;
+        }
+        params->mem_nodes = nodes.bits[0];
+        return CPUBENCH_OK;
+    }
+
+    if (clc_parse_ull(value, &v) != CPUBENCH_OK)
+    {
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+
+    if (strcmp(key, "threads") == 0)
+    {
+        params->threads = (int)v;
+        return CPUBENCH_OK;
+    }
+
+    switch (params->workload)
+    {
+    case CPUBENCH_WORKLOAD_PI:
+        if (strcmp(key, "digits") == 0 || strcmp(key, "value") == 0)
+        {
+            params->u.pi.digits = (unsigned long)v;
+            return CPUBENCH_OK;
+        }
+        break;
+    case CPUBENCH_WORKLOAD_PRIMES:
+        if (strcmp(key, "max") == 0 || strcmp(key, "value") == 0)
+        {
+            params->u.prime.max = v;
+            return CPUBENCH_OK;
+        }
+        break;
+    case CPUBENCH_WORKLOAD_STREAM:
+        if ((strcmp(key, "size") == 0 || strcmp(key, "value") == 0) && v <= (~0ULL >> 20))
+        {
+            params->u.stream.bytes = v << 20;
+            return CPUBENCH_OK;
+        }
+        if (strcmp(key, "ntimes") == 0)
+        {
+            params->u.stream.ntimes = (int)v;
+            return CPUBENCH_OK;
+        }
+        if (strcmp(key, "sweep") == 0)
+        {
+            params->u.stream.sweep = (v != 0);
+            return CPUBENCH_OK;
+        }
+        break;
+    case CPUBENCH_WORKLOAD_LATENCY:
+        if ((strcmp(key, "max") == 0 || strcmp(key, "size") == 0 || strcmp(key, "value") == 0) && v <= (~0ULL >> 20))
+        {
+            params->u.latency.max_bytes = v << 20;
+            return CPUBENCH_OK;
+        }
+        if (strcmp(key, "min") == 0 && v <= (~0ULL >> 10))
+        {
+            params->u.latency.min_bytes = v << 10;
+            return CPUBENCH_OK;
+        }
+        if (strcmp(key, "hugepages") == 0)
+        {
+            params->u.latency.hugepages = (v != 0);
+            return CPUBENCH_OK;
+        }
+        break;
+    case CPUBENCH_WORKLOAD_LOADED_LATENCY:
+        if ((strcmp(key, "size") == 0 || strcmp(key, "value") == 0) && v <= (~0ULL >> 20))
+        {
+            params->u.loaded.bytes = v << 20;
+            return CPUBENCH_OK;
+        }
+        if (strcmp(key, "load") == 0 && v <= (~0ULL >> 20))
+        {
+            params->u.loaded.load_bytes = v << 20;
+            return CPUBENCH_OK;
+        }
+        if (strcmp(key, "write") == 0 && v <= 100)
+        {
+            params->u.loaded.write_percent = (int)v;
+            return CPUBENCH_OK;
+        }
+        break;
+    case CPUBENCH_WORKLOAD_GEMM:
+        if (strcmp(key, "n") == 0 || strcmp(key, "value") == 0)
+        {
+            params->u.gemm.n = (unsigned long)v;
+            return CPUBENCH_OK;
+        }
+        if (strcmp(key, "single") == 0)
+        {
+            params->u.gemm.single = (v != 0);
+            return CPUBENCH_OK;
+        }
+        if (strcmp(key, "ntimes") == 0)
+        {
+            params->u.gemm.ntimes = (int)v;
+            return CPUBENCH_OK;
+        }
+        if (strcmp(key, "generic") == 0)
+        {
+            params->u.gemm.generic = (v != 0);
+            return CPUBENCH_OK;
+        }
+        break;
+    case CPUBENCH_WORKLOAD_HPL:
+        if (strcmp(key, "n") == 0 || strcmp(key, "value") == 0)
+        {
+            params->u.hpl.n = (unsigned long)v;
+            return CPUBENCH_OK;
+        }
+        if (strcmp(key, "nb") == 0 && v <= CLC_GEMM_KC)
+        {
+            params->u.hpl.nb = (int)v;
+            return CPUBENCH_OK;
+        }
+        if (strcmp(key, "generic") == 0)
+        {
+            params->u.hpl.generic = (v != 0);
+            return CPUBENCH_OK;
+        }
+        break;
+    case CPUBENCH_WORKLOAD_HPCG:
+        if (strcmp(key, "n") == 0 || strcmp(key, "value") == 0)
+        {
+            params->u.hpcg.n = (unsigned long)v;
+            return CPUBENCH_OK;
+        }
+        if (strcmp(key, "iterations") == 0)
+        {
+            params->u.hpcg.iterations = (int)v;
+            return CPUBENCH_OK;
+        }
+        break;
+    case CPUBENCH_WORKLOAD_FFT:
+        if (strcmp(key, "n") == 0 || strcmp(key, "value") == 0)
+        {
+            params->u.fft.n = (unsigned long)v;
+            return CPUBENCH_OK;
+        }
+        if (strcmp(key, "dims") == 0)
+        {
+            params->u.fft.dims = (int)v;
+            return CPUBENCH_OK;
+        }
+        if (strcmp(key, "ntimes") == 0)
+        {
+            params->u.fft.ntimes = (int)v;
+            return CPUBENCH_OK;
+        }
+        break;
+    case CPUBENCH_WORKLOAD_STENCIL:
+        if (strcmp(key, "n") == 0 || strcmp(key, "value") == 0)
+        {
+            params->u.stencil.n = (unsigned long)v;
+            return CPUBENCH_OK;
+        }
+        if (strcmp(key, "points") == 0)
+        {
+            params->u.stencil.points = (int)v;
+            return CPUBENCH_OK;
+        }
+        if (strcmp(key, "steps") == 0)
+        {
+            params->u.stencil.steps = (int)v;
+            return CPUBENCH_OK;
+        }
+        if (strcmp(key, "tile") == 0)
+        {
+            params->u.stencil.tile = (int)v;
+            return CPUBENCH_OK;
+        }
+        break;
+    case CPUBENCH_WORKLOAD_SPMV:
+        if (strcmp(key, "rows") == 0 || strcmp(key, "value") == 0)
+        {
+            params->u.spmv.rows = (unsigned long)v;
+            return CPUBENCH_OK;
+        }
+        if (strcmp(key, "nnz") == 0)
+        {
+            params->u.spmv.nnz = (int)v;
+            return CPUBENCH_OK;
+        }
+        if (strcmp(key, "band") == 0)
+        {
+            params->u.spmv.band = (unsigned long)v;
+            return CPUBENCH_OK;
+        }
+        if (strcmp(key, "alpha") == 0)
+        {
+            params->u.spmv.alpha = (int)v;
+            return CPUBENCH_OK;
+        }
+        if (strcmp(key, "chunk") == 0)
+        {
+            params->u.spmv.chunk = (int)v;
+            return CPUBENCH_OK;
+        }
+        if (strcmp(key, "sigma") == 0)
+        {
+            params->u.spmv.sigma = (int)v;
+            return CPUBENCH_OK;
+        }
+        if (strcmp(key, "ntimes") == 0)
+        {
+            params->u.spmv.ntimes = (int)v;
+            return CPUBENCH_OK;
+        }
+        break;
+    case CPUBENCH_WORKLOAD_HASH:
+        if (strcmp(key, "max") == 0 || strcmp(key, "value") == 0)
+        {
+            params->u.hash.max = (unsigned long)v;
+            return CPUBENCH_OK;
+        }
+        if (strcmp(key, "min") == 0)
+        {
+            params->u.hash.min = (unsigned long)v;
+            return CPUBENCH_OK;
+        }
+        if (strcmp(key, "volume") == 0)
+        {
+            params->u.hash.volume = (unsigned long)v;
+            return CPUBENCH_OK;
+        }
+        break;
+    case CPUBENCH_WORKLOAD_AEAD:
+        if (strcmp(key, "max") == 0 || strcmp(key, "value") == 0)
+        {
+            params->u.aead.max = (unsigned long)v;
+            return CPUBENCH_OK;
+        }
+        if (strcmp(key, "min") == 0)
+        {
+            params->u.aead.min = (unsigned long)v;
+            return CPUBENCH_OK;
+        }
+        if (strcmp(key, "volume") == 0)
+        {
+            params->u.aead.volume = (unsigned long)v;
+            return CPUBENCH_OK;
+        }
+        break;
+    case CPUBENCH_WORKLOAD_PKEY:
+        if (strcmp(key, "duration") == 0 || strcmp(key, "value") == 0)
+        {
+            params->u.pkey.duration = (unsigned long)v;
+            return CPUBENCH_OK;
+        }
+        break;
+    case CPUBENCH_WORKLOAD_GMP:
+        if (strcmp(key, "max") == 0 || strcmp(key, "value") == 0)
+        {
+            params->u.gmp.max = (unsigned long)v;
+            return CPUBENCH_OK;
+        }
+        if (strcmp(key, "min") == 0)
+        {
+            params->u.gmp.min = (unsigned long)v;
+            return CPUBENCH_OK;
+        }
+        if (strcmp(key, "exponent") == 0)
+        {
+            params->u.gmp.exponent = (unsigned long)v;
+            return CPUBENCH_OK;
+        }
+        if (strcmp(key, "duration") == 0)
+        {
+            params->u.gmp.duration = (unsigned long)v;
+            return CPUBENCH_OK;
+        }
+        break;
+    case CPUBENCH_WORKLOAD_BIGMUL:
+        if (strcmp(key, "max") == 0 || strcmp(key, "value") == 0)
+        {
+            params->u.bigmul.max = (unsigned long)v;
+            return CPUBENCH_OK;
+        }
+        if (strcmp(key, "steps") == 0)
+        {
+            params->u.bigmul.steps = (int)v;
+            return CPUBENCH_OK;
+        }
+        if (strcmp(key, "duration") == 0)
+        {
+            params->u.bigmul.duration = (unsigned long)v;
+            return CPUBENCH_OK;
+        }
+        break;
+    default:
+        break;
+    }
+    return CPUBENCH_ERR_INVALID_ARG;
+}
+
+/* Run one workload */
+cpubench_status cpubench_run(cpubench_ctx *ctx, const cpubench_params *params, cpubench_result *result)
+{
+    cpubench_result local;
+    cpubench_params run;
+    cpubench_status status;
+
+    if (ctx == NULL || params == NULL || params->threads < 0)
+    {
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+
+    /* Resolve placement defaults: local allocation only works if threads stay put */
+    run = *params;
+    if (run.mem_policy == CPUBENCH_MEM_LOCAL && cpubench_cpumask_count(&run.cpus) == 0)
+    {
+        int cpu;
+        for (cpu = 0; cpu < CPUBENCH_MAX_CPUS && cpu < CPU_SETSIZE; cpu++)
+        {
+            if (CPU_ISSET(cpu, &ctx->affinity))
+            {
+                cpubench_cpumask_set(&run.cpus, cpu);
+            }
+        }
+    }
+    if (run.mem_nodes == 0)
+    {
+        run.mem_nodes = clc_online_nodes();
+    }
+
+    /* Callers that only use the callback don't have to supply a result */
+    cpubench_result *res = (result != NULL) ? result : &local;
+    unsigned long long periods_before, periods_after;
+    double throttled_before, throttled_after;
+    int placed = cpubench_cpumask_count(&run.cpus) > 0 || run.mem_policy != CPUBENCH_MEM_DEFAULT;
+    memset(res, 0, sizeof(*res));
+    res->workload = run.workload;
+    res->isolation = ctx->isolation;
+    snprintf(res->tag, sizeof(res->tag), "%s", run.tag);
+
+    /* Single-threaded workloads run on the calling thread, which goes to the first CPU */
+    if (run.mem_policy != CPUBENCH_MEM_DEFAULT && clc_apply_mempolicy(&run) != 0)
+    {
+        return CPUBENCH_ERR_UNSUPPORTED;
+    }
+    if (placed)
+    {
+        clc_place_worker(&run, 0);
+    }
+    clc_cgroup_throttling(&periods_before, &throttled_before);
+
+    /* Progress intervals count from each run's own start, not from the last report of a previous one */
+    ctx->progress_last = 0;
+    switch (run.workload)
+    {
+    case CPUBENCH_WORKLOAD_PI:
+        status = clc_pi(ctx, &run, res);
+        break;
+    case CPUBENCH_WORKLOAD_PRIMES:
+        status = clc_prime(ctx, &run, res);
+        break;
+    case CPUBENCH_WORKLOAD_STREAM:
+        status = clc_stream(ctx, &run, res);
+        break;
+    case CPUBENCH_WORKLOAD_LATENCY:
+        status = clc_latency(ctx, &run, res);
+        break;
+    case CPUBENCH_WORKLOAD_LOADED_LATENCY:
+        status = clc_loaded_latency(ctx, &run, res);
+        break;
+    case CPUBENCH_WORKLOAD_GEMM:
+        status = clc_gemm(ctx, &run, res);
+        break;
+    case CPUBENCH_WORKLOAD_HPL:
+        status = clc_hpl(ctx, &run, res);
+        break;
+    case CPUBENCH_WORKLOAD_HPCG:
+        status = clc_hpcg(ctx, &run, res);
+        break;
+    case CPUBENCH_WORKLOAD_FFT:
+        status = clc_fft(ctx, &run, res);
+        break;
+    case CPUBENCH_WORKLOAD_STENCIL:
+        status = clc_stencil(ctx, &run, res);
+        break;
+    case CPUBENCH_WORKLOAD_SPMV:
+        status = clc_spmv(ctx, &run, res);
+        break;
+    case CPUBENCH_WORKLOAD_HASH:
+        status = clc_hash(ctx, &run, res);
+        break;
+    case CPUBENCH_WORKLOAD_AEAD:
+        status = clc_aead(ctx, &run, res);
+        break;
+    case CPUBENCH_WORKLOAD_PKEY:
+        status = clc_pkey(ctx, &run, res);
+        break;
+    case CPUBENCH_WORKLOAD_GMP:
+        status = clc_gmp(ctx, &run, res);
+        break;
+    case CPUBENCH_WORKLOAD_BIGMUL:
+        status = clc_bigmul(ctx, &run, res);
+        break;
+    default:
+        status = CPUBENCH_ERR_INVALID_ARG;
+        break;
+    }
+
+    if (placed)
+    {
+        clc_release_workers(ctx, clc_threads(ctx, &run));
+    }
+
+    /* Any throttling during the run means the numbers understate the CPU */
+    clc_cgroup_throttling(&periods_after, &throttled_after);
+    res->throttled_periods = periods_after - periods_before;
+    res->throttled_seconds = throttled_after - throttled_before;
+
+    if (status == CPUBENCH_OK && ctx->result_cb != NULL)
+    {
+        ctx->result_cb(res, ctx->result_user);
+    }
+
+    if (status != CPUBENCH_OK || res == &local)
+    {
+        cpubench_result_clear(res);
+    }
+    return status;
+}
+
+/* Start signal shared by the instances of cpubench_run_per_node() */
+struct clc_start_gate
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int open;
+};
+
+/* One concurrent instance of cpubench_run_per_node() */
+struct clc_node_instance
+{
+    cpubench_params params;
+    cpubench_result result;
+    cpubench_status status;
+    unsigned int isolation;
+    struct clc_start_gate *gate;
+};
+
+/* Thread body of a per-node instance, with its own context so nothing is shared */
+static void *clc_node_instance_main(void *arg)
+{
+    struct clc_node_instance *inst = arg;
+    cpubench_ctx *child;
+
+    /* Scheduling policy and memory locks are inherited, only the record needs passing on */
+    if ((inst->status = cpubench_ctx_create(&child)) == CPUBENCH_OK)
+    {
+        child->isolation = inst->isolation;
+    }
+
+    /* Set up first, then start together so the instances overlap */
+    pthread_mutex_lock(&inst->gate->lock);
+    while (!inst->gate->open)
+    {
+        pthread_cond_wait(&inst->gate->cond, &inst->gate->lock);
+    }
+    pthread_mutex_unlock(&inst->gate->lock);
+    if (inst->status == CPUBENCH_OK)
+    {
+        inst->status = cpubench_run(child, &inst->params, &inst->result);
+        cpubench_ctx_destroy(child);
+    }
+    return NULL;
+}
+
+/* Run one instance per NUMA node concurrently */
+cpubench_status cpubench_run_per_node(cpubench_ctx *ctx, const cpubench_params *params, cpubench_result *results, int *nresults)
+{
+    struct clc_node_instance inst[CPUBENCH_MAX_NODES];
+    pthread_t threads[CPUBENCH_MAX_NODES];
+    struct clc_start_gate gate = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0 };
+    cpubench_topology topology;
+    cpubench_status status;
+    int n, started = 0;
+
+    if (ctx == NULL || params == NULL || results == NULL || nresults == NULL)
+    {
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+    *nresults = 0;
+    if ((status = cpubench_topology_read(&topology)) != CPUBENCH_OK)
+    {
+        return status;
+    }
+
+    for (n = 0; n < topology.nnodes; n++)
+    {
+        inst[n].params = *params;
+        inst[n].params.cpus = topology.nodes[n].cpus;
+        inst[n].params.mem_policy = CPUBENCH_MEM_BIND;
+        inst[n].params.mem_nodes = 1ULL << topology.nodes[n].id;
+        snprintf(inst[n].params.tag, sizeof(inst[n].params.tag), "%.20s%snode%d", params->tag, params->tag[0] ? "/" : "", topology.nodes[n].id);
+        inst[n].isolation = ctx->isolation;
+        inst[n].gate = &gate;
+        inst[n].status = CPUBENCH_ERR_NOMEM;
+        memset(&inst[n].result, 0, sizeof(inst[n].result));
+    }
+
+    /* Instances that couldn't be started keep their CPUBENCH_ERR_NOMEM */
+    for (n = 0; n < topology.nnodes; n++)
+    {
+        if (pthread_create(&threads[n], NULL, clc_node_instance_main, &inst[n]) != 0)
+        {
+            break;
+        }
+        started++;
+    }
+    pthread_mutex_lock(&gate.lock);
+    gate.open = 1;
+    pthread_cond_broadcast(&gate.cond);
+    pthread_mutex_unlock(&gate.lock);
+    for (n = 0; n < started; n++)
+    {
+        pthread_join(threads[n], NULL);
+    }
+
+    /* Hand back results in node order and report them through the caller's context */
+    status = CPUBENCH_OK;
+    for (n = 0; n < topology.nnodes; n++)
+    {
+        if (inst[n].status != CPUBENCH_OK)
+        {
+            status = inst[n].status;
+            cpubench_result_clear(&inst[n].result);
+            continue;
+        }
+        results[(*nresults)++] = inst[n].result;
+        if (ctx->result_cb != NULL)
+        {
+            ctx->result_cb(&inst[n].result, ctx->result_user);
+        }
+    }
+    cpubench_topology_clear(&topology);
+    return status;
+}
+
+/* Release memory owned by a result */
+void cpubench_result_clear(cpubench_result *result)
+{
+    if (result == NULL)
+    {
+        return;
+    }
+    free(result->digits);
+    free(result->metrics);
+    result->digits = NULL;
+    result->metrics = NULL;
+    result->nmetrics = 0;
+}
+
+/* Write a JSON string literal, escaping what needs escaping */
+static void clc_json_string(FILE *out, const char *str)
+{
+    fputc('"', out);
+    for (; *str; str++)
+    {
+        unsigned char c = (unsigned char)*str;
+        if (c == '"' || c == '\\')
+        {
+            fprintf(out, "\\%c", c);
+        }
+        else if (c < 0x20)
+        {
+            fprintf(out, "\\u%04x", c);
+        }
+        else
+        {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+/* Serialize a result as JSON */
+char *cpubench_result_to_json(const cpubench_result *result)
+{
+    char *json = NULL;
+    size_t len = 0;
+    size_t m;
+    int b, first;
+    FILE *out = open_memstream(&json, &len);
+
+    if (out == NULL)
+    {
+        return NULL;
+    }
+
+    fprintf(out, "{\"workload\":");
+    clc_json_string(out, cpubench_workload_name(result->workload));
+    fprintf(out, ",\"tag\":");
+    clc_json_string(out, result->tag);
+    fprintf(out, ",\"threads\":%d,\"seconds\":%.9f,\"count\":%llu,\"checksum\":\"%s\",\"throttled_periods\":%llu,\"throttled_seconds\":%.6f,\"isolation\":[",
+            result->threads, result->seconds, result->count, result->checksum, result->throttled_periods, result->throttled_seconds);
+    for (b = 0, first = 1; b < 3; b++)
+    {
+        if (result->isolation & (1u << b))
+        {
+            fprintf(out, "%s\"%s\"", first ? "" : ",", isolation_names[b]);
+            first = 0;
+        }
+    }
+    fprintf(out, "],\"metrics\":[");
+    for (m = 0; m < result->nmetrics; m++)
+    {
+        const cpubench_metric *metric = &result->metrics[m];
+        fprintf(out, "%s{\"name\":", (m > 0) ? "," : "");
+        clc_json_string(out, metric->name);
+        fprintf(out, ",\"label\":");
+        clc_json_string(out, metric->label);
+        fprintf(out, ",\"unit\":");
+        clc_json_string(out, metric->unit);
+        fprintf(out, ",\"value\":%.9g,\"lower_is_better\":%s}", metric->value, metric->lower_is_better ? "true" : "false");
+    }
+    fprintf(out, "]}");
+
+    if (fclose(out) != 0)
+    {
+        free(json);
+        return NULL;
+    }
+    return json;
+}
+
+/* Parse one workload line of a reference table */
+static cpubench_status clc_reference_entry(char *line, cpubench_reference_entry *entry)
+{
+    char *tokens[24];
+    char *save = NULL, *tok;
+    cpubench_workload workload;
+    size_t len = 0;
+    int ntokens = 0, t;
+
+    for (tok = strtok_r(line, " \t", &save); tok != NULL && ntokens < 24; tok = strtok_r(NULL, " \t", &save))
+    {
+        tokens[ntokens++] = tok;
+    }
+
+    /* Class, workload, parameters, metric, value and an optional checksum */
+    int nparams = ntokens - 4;
+    if (nparams >= 0 && strchr(tokens[ntokens - 1], '=') == NULL && strlen(tokens[ntokens - 1]) == 32 && strchr(tokens[ntokens - 2], '=') == NULL)
+    {
+        snprintf(entry->checksum, sizeof(entry->checksum), "%s", tokens[--ntokens]);
+        nparams--;
+    }
+    if (nparams < 0 || (strcmp(tokens[0], "single") != 0 && strcmp(tokens[0], "multi") != 0)
+        || cpubench_workload_from_name(tokens[1], &workload) != CPUBENCH_OK)
+    {
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+    entry->multithreaded = (strcmp(tokens[0], "multi") == 0);
+    cpubench_params_init(&entry->params, workload);
+    entry->params.threads = entry->multithreaded ? 0 : 1;
+
+    len = (size_t)snprintf(entry->name, sizeof(entry->name), "%s", tokens[1]);
+    for (t = 2; t < 2 + nparams; t++)
+    {
+        char *eq = strchr(tokens[t], '=');
+        if (eq == NULL)
+        {
+            return CPUBENCH_ERR_INVALID_ARG;
+        }
+        if (len < sizeof(entry->name))
+        {
+            len += (size_t)snprintf(entry->name + len, sizeof(entry->name) - len, " %s", tokens[t]);
+        }
+        *eq = '\0';
+        if (cpubench_params_set(&entry->params, tokens[t], eq + 1) != CPUBENCH_OK)
+        {
+            return CPUBENCH_ERR_INVALID_ARG;
+        }
+    }
+
+    snprintf(entry->metric, sizeof(entry->metric), "%s", tokens[t]);
+    entry->value = strtod(tokens[t + 1], &tok);
+    return (*tok != '\0' || !(entry->value > 0)) ? CPUBENCH_ERR_INVALID_ARG : CPUBENCH_OK;
+}
+
+/* Load a reference table */
+cpubench_status cpubench_reference_load(const char *path, cpubench_reference *out)
+{
+    char line[512];
+    cpubench_status status = CPUBENCH_OK;
+    FILE *in;
+
+    if (path == NULL || out == NULL)
+    {
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+    memset(out, 0, sizeof(*out));
+    if ((in = fopen(path, "r")) == NULL)
+    {
+        return CPUBENCH_ERR_IO;
+    }
+
+    while (status == CPUBENCH_OK && fgets(line, sizeof(line), in) != NULL)
+    {
+        char *start = line + strspn(line, " \t");
+        start[strcspn(start, "#\r\n")] = '\0';
+        if (*start == '\0')
+        {
+            continue;
+        }
+
+        if (strncmp(start, "version ", 8) == 0)
+        {
+            out->version = atoi(start + 8);
+        }
+        else if (strncmp(start, "machine ", 8) == 0)
+        {
+            snprintf(out->machine, sizeof(out->machine), "%s", start + 8 + strspn(start + 8, " \t"));
+        }
+        else if (out->nentries == CPUBENCH_MAX_REFERENCE)
+        {
+            status = CPUBENCH_ERR_INVALID_ARG;
+        }
+        else
+        {
+            status = clc_reference_entry(start, &out->entries[out->nentries++]);
+        }
+    }
+    fclose(in);
+
+    if (status == CPUBENCH_OK && (out->version <= 0 || out->nentries == 0))
+    {
+        status = CPUBENCH_ERR_INVALID_ARG;
+    }
+    return status;
+}
+
+/* Run the suite of a reference table and score against it */
+cpubench_status cpubench_score_run(cpubench_ctx *ctx, const cpubench_reference *reference, cpubench_score *out)
+{
+    double log_sum[2] = { 0, 0 };
+    int count[2] = { 0, 0 };
+    int e;
+    size_t m;
+
+    if (ctx == NULL || reference == NULL || out == NULL || reference->nentries > CPUBENCH_MAX_REFERENCE)
+    {
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+    memset(out, 0, sizeof(*out));
+    out->valid = 1;
+
+    for (e = 0; e < reference->nentries; e++)
+    {
+        const cpubench_reference_entry *entry = &reference->entries[e];
+        cpubench_score_entry *score = &out->entries[e];
+        cpubench_result result;
+        cpubench_status status;
+
+        if ((status = cpubench_run(ctx, &entry->params, &result)) != CPUBENCH_OK)
+        {
+            return status;
+        }
+        m = 0;
+        while (m < result.nmetrics && strcmp(result.metrics[m].name, entry->metric) != 0)
+        {
+            m++;
+        }
+        if (m == result.nmetrics)
+        {
+            cpubench_result_clear(&result);
+            return CPUBENCH_ERR_INVALID_ARG;
+        }
+
+        score->value = result.metrics[m].value;
+        score->ratio = score->value / entry->value;
+        score->verified = (entry->checksum[0] == '\0' || strcmp(entry->checksum, result.checksum) == 0);
+        out->valid = out->valid && score->verified;
+        out->nentries++;
+        cpubench_result_clear(&result);
+
+        /* Every workload weighs the same no matter how its throughput is measured */
+        log_sum[entry->multithreaded] += log(score->ratio);
+        count[entry->multithreaded]++;
+    }
+
+    out->single = (count[0] > 0) ? 1000 * exp(log_sum[0] / count[0]) : 0;
+    out->multi = (count[1] > 0) ? 1000 * exp(log_sum[1] / count[1]) : 0;
+    return CPUBENCH_OK;
+}
+
+/* Mean current CPU frequency, from cpufreq or failing that /proc/cpuinfo */
+static double clc_read_frequency(void)
+{
+    char path[128];
+    char line[256];
+    double sum = 0, khz, mhz;
+    int n = 0;
+    int cpu;
+    long ncpus = sysconf(_SC_NPROCESSORS_CONF);
+
+    for (cpu = 0; cpu < ncpus; cpu++)
+    {
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq", cpu);
+        if (clc_read_sysfs(path, &khz))
+        {
+            sum += khz * 1E3;
+            n++;
+        }
+    }
+    if (n > 0)
+    {
+        return sum / n;
+    }
+
+    FILE *file = fopen("/proc/cpuinfo", "r");
+    if (file == NULL)
+    {
+        return NAN;
+    }
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        if (sscanf(line, "cpu MHz : %lf", &mhz) == 1)
+        {
+            sum += mhz * 1E6;
+            n++;
+        }
+    }
+    fclose(file);
+    return (n > 0) ? sum / n : NAN;
+}
+
+/* CPU package temperature from hwmon or thermal zones */
+static double clc_read_temperature(void)
+{
+    static const char *const hwmon_names[] = { "coretemp", "k10temp", "zenpower", "cpu_thermal", NULL };
+    static const char *const zone_types[] = { "x86_pkg_temp", "cpu-thermal", "cpu_thermal", "acpitz", NULL };
+    char path[320];
+    char name[64];
+    double milli;
+    struct dirent *entry;
+    int k;
+    DIR *dir;
+
+    /* Prefer a CPU hwmon driver */
+    if ((dir = opendir("/sys/class/hwmon")) != NULL)
+    {
+        while ((entry = readdir(dir)) != NULL)
+        {
+            snprintf(path, sizeof(path), "/sys/class/hwmon/%s/name", entry->d_name);
+            FILE *file = fopen(path, "r");
+            if (file == NULL)
+            {
+                continue;
+            }
+            int got = (fscanf(file, "%63s", name) == 1);
+            fclose(file);
+            for (k = 0; got && hwmon_names[k] != NULL; k++)
+            {
+                snprintf(path, sizeof(path), "/sys/class/hwmon/%s/temp1_input", entry->d_name);
+                if (strcmp(name, hwmon_names[k]) == 0 && clc_read_sysfs(path, &milli))
+                {
+                    closedir(dir);
+                    return milli / 1E3;
+                }
+            }
+        }
+        closedir(dir);
+    }
+
+    /* Otherwise a thermal zone that belongs to the CPU */
+    for (k = 0; zone_types[k] != NULL; k++)
+    {
+        int zone;
+        for (zone = 0; zone < 64; zone++)
+        {
+            snprintf(path, sizeof(path), "/sys/class/thermal/thermal_zone%d/type", zone);
+            FILE *file = fopen(path, "r");
+            if (file == NULL)
+            {
+                break;
+            }
+            int got = (fscanf(file, "%63s", name) == 1);
+            fclose(file);
+            snprintf(path, sizeof(path), "/sys/class/thermal/thermal_zone%d/temp", zone);
+            if (got && strcmp(name, zone_types[k]) == 0 && clc_read_sysfs(path, &milli))
+            {
+                return milli / 1E3;
+            }
+        }
+    }
+    return NAN;
+}
+
+/* Read CPU sensors */
+cpubench_status cpubench_read_sensors(cpubench_sensors *out)
+{
+    if (out == NULL)
+    {
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+    out->frequency_hz = clc_read_frequency();
+    out->temperature_c = clc_read_temperature();
+    return (isnan(out->frequency_hz) && isnan(out->temperature_c)) ? CPUBENCH_ERR_UNSUPPORTED : CPUBENCH_OK;
+}
+
+/* Add a CPU to a mask */
+void cpubench_cpumask_set(cpubench_cpumask *mask, int cpu)
+{
+    if (cpu >= 0 && cpu < CPUBENCH_MAX_CPUS)
+    {
+        mask->bits[cpu / 64] |= 1ULL << (cpu % 64);
+    }
+}
+
+/* Whether a CPU is in a mask */
+int cpubench_cpumask_isset(const cpubench_cpumask *mask, int cpu)
+{
+    return (cpu >= 0 && cpu < CPUBENCH_MAX_CPUS) ? (int)((mask->bits[cpu / 64] >> (cpu % 64)) & 1) : 0;
+}
+
+/* Number of CPUs in a mask */
+int cpubench_cpumask_count(const cpubench_cpumask *mask)
+{
+    int count = 0;
+    int w;
+
+    for (w = 0; w < CPUBENCH_MAX_CPUS / 64; w++)
+    {
+        count += __builtin_popcountll(mask->bits[w]);
+    }
+    return count;
+}
+
+/* Parse a CPU list such as "0-3,8,10-11" */
+cpubench_status cpubench_cpumask_parse(cpubench_cpumask *mask, const char *list)
+{
+    const char *p = list;
+    char *end;
+
+    memset(mask, 0, sizeof(*mask));
+    while (*p != '\0' && *p != '\n')
+    {
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p || first < 0)
+        {
+            return CPUBENCH_ERR_INVALID_ARG;
+        }
+        p = end;
+        if (*p == '-')
+        {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first)
+            {
+                return CPUBENCH_ERR_INVALID_ARG;
+            }
+            p = end;
+        }
+        if (last >= CPUBENCH_MAX_CPUS)
+        {
+            return CPUBENCH_ERR_INVALID_ARG;
+        }
+        for (; first <= last; first++)
+        {
+            cpubench_cpumask_set(mask, (int)first);
+        }
+        if (*p == ',')
+        {
+            p++;
+        }
+        else if (*p != '\0' && *p != '\n')
+        {
+            return CPUBENCH_ERR_INVALID_ARG;
+        }
+    }
+    return CPUBENCH_OK;
+}
+
+/* Read a sysfs file holding a CPU list */
+static int clc_read_cpulist(const char *path, cpubench_cpumask *mask)
+{
+    char buf[4096];
+    FILE *file = fopen(path, "r");
+    int ok;
+
+    if (file == NULL)
+    {
+        return 0;
+    }
+    ok = (fgets(buf, sizeof(buf), file) != NULL && cpubench_cpumask_parse(mask, buf) == CPUBENCH_OK);
+    fclose(file);
+    return ok;
+}
+
+/* Read one integer attribute of a CPU, fallback when it isn't there */
+static int clc_read_cpu_attr(int cpu, const char *attr, int fallback)
+{
+    char path[128];
+    double value;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/%s", cpu, attr);
+    return clc_read_sysfs(path, &value) ? (int)value : fallback;
+}
+
+/* Order core types fastest first */
+static int clc_compare_capacity(const void *a, const void *b)
+{
+    return *(const int *)b - *(const int *)a;
+}
+
+/* Read the CPU topology */
+cpubench_status cpubench_topology_read(cpubench_topology *out)
+{
+    static const char *const type_names[CPUBENCH_MAX_CORE_TYPES][CPUBENCH_MAX_CORE_TYPES] =
+    {
+        { "cpu" },
+        { "performance", "efficiency" },
+        { "prime", "performance", "efficiency" },
+        { "prime", "performance", "mid", "efficiency" }
+    };
+    cpubench_cpumask intel_core, intel_atom;
+    int capacities[CPUBENCH_MAX_CORE_TYPES];
+    cpu_set_t set;
+    int cpu, c, t;
+
+    if (out == NULL)
+    {
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+    memset(out, 0, sizeof(*out));
+    if (sched_getaffinity(0, sizeof(set), &set) != 0)
+    {
+        return CPUBENCH_ERR_UNSUPPORTED;
+    }
+    if ((out->cpus = calloc((size_t)CPU_COUNT(&set), sizeof(*out->cpus))) == NULL)
+    {
+        return CPUBENCH_ERR_NOMEM;
+    }
+
+    for (cpu = 0; cpu < CPUBENCH_MAX_CPUS && cpu < CPU_SETSIZE; cpu++)
+    {
+        if (!CPU_ISSET(cpu, &set))
+        {
+            continue;
+        }
+        cpubench_cpu_info *info = &out->cpus[out->ncpus++];
+        info->cpu = cpu;
+        info->package_id = clc_read_cpu_attr(cpu, "topology/physical_package_id", 0);
+        info->core_id = clc_read_cpu_attr(cpu, "topology/core_id", cpu);
+        info->cluster_id = clc_read_cpu_attr(cpu, "topology/cluster_id", -1);
+        info->capacity = clc_read_cpu_attr(cpu, "cpu_capacity", 0);
+        /* 65535 is what x86 kernels report when there are no clusters */
+        if (info->cluster_id == 65535)
+        {
+            info->cluster_id = -1;
+        }
+    }
+
+    /* SMT siblings, ranked among the ones we may use so every core has a rank 0 */
+    for (c = 0; c < out->ncpus; c++)
+    {
+        char path[128];
+        cpubench_cpumask siblings;
+        int allowed = 0, k;
+
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", out->cpus[c].cpu);
+        if (!clc_read_cpulist(path, &siblings))
+        {
+            memset(&siblings, 0, sizeof(siblings));
+            cpubench_cpumask_set(&siblings, out->cpus[c].cpu);
+        }
+        for (k = 0; k < out->ncpus; k++)
+        {
+            if (cpubench_cpumask_isset(&siblings, out->cpus[k].cpu))
+            {
+                if (out->cpus[k].cpu < out->cpus[c].cpu)
+                {
+                    out->cpus[c].smt_rank++;
+                }
+                allowed++;
+            }
+        }
+        if (out->cpus[c].smt_rank == 0)
+        {
+            cpubench_cpumask_set(&out->physical, out->cpus[c].cpu);
+            out->ncores++;
+        }
+        if (allowed > out->threads_per_core)
+        {
+            out->threads_per_core = allowed;
+        }
+    }
+
+    /* Intel hybrid parts expose one PMU per core type */
+    if (clc_read_cpulist("/sys/devices/cpu_core/cpus", &intel_core) && clc_read_cpulist("/sys/devices/cpu_atom/cpus", &intel_atom))
+    {
+        out->ntypes = 2;
+        for (c = 0; c < out->ncpus; c++)
+        {
+            out->cpus[c].type = cpubench_cpumask_isset(&intel_atom, out->cpus[c].cpu) ? 1 : 0;
+        }
+    }
+
+    /* Everything else: distinct cpu_capacity values, the biggest being the fastest cores */
+    else
+    {
+        int *seen = malloc((size_t)out->ncpus * sizeof(int));
+        int ncaps = 0, nseen = 0;
+
+        if (seen == NULL)
+        {
+            cpubench_topology_clear(out);
+            return CPUBENCH_ERR_NOMEM;
+        }
+        for (c = 0; c < out->ncpus; c++)
+        {
+            seen[nseen++] = out->cpus[c].capacity;
+        }
+        qsort(seen, (size_t)nseen, sizeof(int), clc_compare_capacity);
+
+        /* The largest distinct values become the types, fastest first */
+        for (c = 0; c < nseen && ncaps < CPUBENCH_MAX_CORE_TYPES; c++)
+        {
+            if (ncaps == 0 || seen[c] != capacities[ncaps - 1])
+            {
+                capacities[ncaps++] = seen[c];
+            }
+        }
+        free(seen);
+        out->ntypes = (ncaps > 0) ? ncaps : 1;
+
+        /* Every capacity above the smallest one we keep is a type of its own, the ones below
+         * it are folded into that slowest type */
+        for (c = 0; c < out->ncpus; c++)
+        {
+            out->cpus[c].type = out->ntypes - 1;
+            for (t = 0; t < ncaps; t++)
+            {
+                if (out->cpus[c].capacity >= capacities[t])
+                {
+                    out->cpus[c].type = t;
+                    break;
+                }
+            }
+        }
+    }
+
+    for (t = 0; t < out->ntypes; t++)
+    {
+        snprintf(out->types[t].name, sizeof(out->types[t].name), "%s", type_names[out->ntypes - 1][t]);
+    }
+
+    /* NUMA nodes that hold at least one of our CPUs */
+    unsigned long long online = clc_online_nodes();
+    for (t = 0; t < CPUBENCH_MAX_NODES; t++)
+    {
+        char path[128];
+        char line[256];
+        unsigned long long kb;
+        cpubench_cpumask node_cpus;
+
+        if (!((online >> t) & 1))
+        {
+            continue;
+        }
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", t);
+        if (!clc_read_cpulist(path, &node_cpus))
+        {
+            /* No NUMA support in the kernel: one node with everything */
+            memset(&node_cpus, 0, sizeof(node_cpus));
+            for (c = 0; c < out->ncpus; c++)
+            {
+                cpubench_cpumask_set(&node_cpus, out->cpus[c].cpu);
+            }
+        }
+
+        cpubench_numa_node *node = &out->nodes[out->nnodes];
+        memset(node, 0, sizeof(*node));
+        node->id = t;
+        for (c = 0; c < out->ncpus; c++)
+        {
+            if (cpubench_cpumask_isset(&node_cpus, out->cpus[c].cpu))
+            {
+                cpubench_cpumask_set(&node->cpus, out->cpus[c].cpu);
+                out->cpus[c].node = t;
+                node->ncpus++;
+            }
+        }
+        if (node->ncpus == 0)
+        {
+            continue;
+        }
+
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/meminfo", t);
+        FILE *file = fopen(path, "r");
+        while (file != NULL && fgets(line, sizeof(line), file) != NULL)
+        {
+            if (sscanf(line, "Node %*d MemTotal: %llu kB", &kb) == 1)
+            {
+                node->mem_bytes = kb * 1024;
+                break;
+            }
+        }
+        if (file != NULL)
+        {
+            fclose(file);
+        }
+        out->nnodes++;
+    }
+    for (c = 0; c < out->ncpus; c++)
+    {
+        cpubench_core_type *type = &out->types[out->cpus[c].type];
+        cpubench_cpumask_set(&type->cpus, out->cpus[c].cpu);
+        type->ncpus++;
+        if (out->cpus[c].capacity > type->capacity)
+        {
+            type->capacity = out->cpus[c].capacity;
+        }
+    }
+    return CPUBENCH_OK;
+}
+
+/* Release a topology */
+void cpubench_topology_clear(cpubench_topology *topology)
+{
+    if (topology != NULL)
+    {
+        free(topology->cpus);
+        topology->cpus = NULL;
+        topology->ncpus = 0;
+    }
+}
+
+/* Number of threads parallel workloads use by default */
+int cpubench_max_threads(void)
+{
+    cpubench_cpu_limits limits;
+
+    cpubench_read_cpu_limits(&limits);
+    return limits.effective_cpus;
+}
+
+/* Detect online CPUs, cpuset and cgroup CPU quota */
+cpubench_status cpubench_read_cpu_limits(cpubench_cpu_limits *out)
+{
+    cpu_set_t set;
+    char dir[512];
+
+    if (out == NULL)
+    {
+        return CPUBENCH_ERR_INVALID_ARG;
+    }
+    memset(out, 0, sizeof(*out));
+    out->online_cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    out->cpuset_cpus = (sched_getaffinity(0, sizeof(set), &set) == 0) ? CPU_COUNT(&set) : out->online_cpus;
+    out->cgroup_version = clc_cgroup_dir(dir, sizeof(dir));
+    if (out->cgroup_version != 0)
+    {
+        out->quota_cpus = clc_cgroup_quota(dir, out->cgroup_version);
+    }
+
+    /* A quota of 2.5 CPUs still lets three threads make progress */
+    out->effective_cpus = out->cpuset_cpus;
+    if (out->quota_cpus > 0 && ceil(out->quota_cpus) < out->effective_cpus)
+    {
+        out->effective_cpus = (int)ceil(out->quota_cpus);
+    }
+    if (out->effective_cpus < 1)
+    {
+        out->effective_cpus = 1;
+    }
+
+    /* An explicit OMP_NUM_THREADS is the user's call */
+    if (getenv("OMP_NUM_THREADS") != NULL)
+    {
+        out->effective_cpus = omp_get_max_threads();
+    }
+    return CPUBENCH_OK;
+}
+
+/* Describe a status code */
+const char *cpubench_strerror(cpubench_status status)
+{
+    switch (status)
+    {
+    case CPUBENCH_OK:
+        return "Success";
+    case CPUBENCH_ERR_INVALID_ARG:
+        return "Invalid argument";
+    case CPUBENCH_ERR_NOMEM:
+        return "Out of memory";
+    case CPUBENCH_ERR_IO:
+        return "I/O error";
+    case CPUBENCH_ERR_UNSUPPORTED:
+        return "Not supported on this system";
+    }
+    return "Unknown error";
+}
+
+/* Name of a workload */
+const char *cpubench_workload_name(cpubench_workload workload)
+{
+    return ((unsigned int)workload < CPUBENCH_WORKLOAD_COUNT) ? workload_names[workload] : "unknown";
+}
+
+/* Look up a workload by name */
+cpubench_status cpubench_workload_from_name(const char *name, cpubench_workload *out)
+{
+    int w;
+
+    for (w = 0; w < CPUBENCH_WORKLOAD_COUNT; w++)
+    {
+        if (strcmp(name, workload_names[w]) == 0)
+        {
+            *out = (cpubench_workload)w;
+            return CPUBENCH_OK;
+        }
+    }
+    return CPUBENCH_ERR_INVALID_ARG;
 }
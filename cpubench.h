@@ -0,0 +1,680 @@
+/*
+*
+* cpubench.h - Public interface of libcpubench
+* Author: Suyash Srijan
+* Email: suyashsrijan@outlook.com
+*
+* libcpubench runs the cpubench workloads in-process. A caller creates a context, fills in a
+* cpubench_params for the workload it wants, and calls cpubench_run(). Results are returned
+* through a cpubench_result and, if one is registered, through the context's result callback.
+* No function in the library prints to the console or terminates the process; every failure
+* is reported as a cpubench_status.
+*
+*/
+
+#ifndef CPUBENCH_H
+#define CPUBENCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+/* Library version */
+#define CPUBENCH_VERSION_MAJOR 1
+#define CPUBENCH_VERSION_MINOR 0
+#define CPUBENCH_VERSION_STRING "1.0 beta"
+
+/* Status codes returned by every fallible library call */
+typedef enum cpubench_status
+{
+    CPUBENCH_OK = 0,
+    CPUBENCH_ERR_INVALID_ARG,
+    CPUBENCH_ERR_NOMEM,
+    CPUBENCH_ERR_IO,
+    CPUBENCH_ERR_UNSUPPORTED
+} cpubench_status;
+
+/* Workloads the library knows how to run */
+typedef enum cpubench_workload
+{
+    CPUBENCH_WORKLOAD_PI = 0,
+    CPUBENCH_WORKLOAD_PRIMES,
+    CPUBENCH_WORKLOAD_STREAM,
+    CPUBENCH_WORKLOAD_LATENCY,
+    CPUBENCH_WORKLOAD_LOADED_LATENCY,
+    CPUBENCH_WORKLOAD_GEMM,
+    CPUBENCH_WORKLOAD_HPL,
+    CPUBENCH_WORKLOAD_HPCG,
+    CPUBENCH_WORKLOAD_FFT,
+    CPUBENCH_WORKLOAD_STENCIL,
+    CPUBENCH_WORKLOAD_SPMV,
+    CPUBENCH_WORKLOAD_HASH,
+    CPUBENCH_WORKLOAD_AEAD,
+    CPUBENCH_WORKLOAD_PKEY,
+    CPUBENCH_WORKLOAD_GMP,
+    CPUBENCH_WORKLOAD_BIGMUL,
+    CPUBENCH_WORKLOAD_COUNT
+} cpubench_workload;
+
+/* Largest CPU number the library can pin to */
+#define CPUBENCH_MAX_CPUS 1024
+
+/* Most distinct core types we tell apart */
+#define CPUBENCH_MAX_CORE_TYPES 4
+
+/* Most NUMA nodes the library handles */
+#define CPUBENCH_MAX_NODES 64
+
+/* Measures cpubench_ctx_isolate() can take against page-fault and scheduler noise, as a bit mask */
+/* Pre-fault scratch memory and thread stacks, and keep freed heap memory mapped between runs */
+#define CPUBENCH_ISOLATE_PREFAULT (1u << 0)
+/* Lock all current and future memory with mlockall(), so nothing is faulted in or swapped out */
+#define CPUBENCH_ISOLATE_MLOCK    (1u << 1)
+/* Run the calling thread and the workers SCHED_FIFO, so ordinary tasks can't preempt them */
+#define CPUBENCH_ISOLATE_FIFO     (1u << 2)
+
+/* Where the memory of a run is placed */
+typedef enum cpubench_mem_policy
+{
+    /* Whatever the kernel does, usually first touch */
+    CPUBENCH_MEM_DEFAULT = 0,
+    /* Threads are spread over all CPUs and allocate on their own node */
+    CPUBENCH_MEM_LOCAL,
+    /* Only allocate on mem_nodes */
+    CPUBENCH_MEM_BIND,
+    /* Interleave pages over mem_nodes */
+    CPUBENCH_MEM_INTERLEAVE
+} cpubench_mem_policy;
+
+/* A set of logical CPUs */
+typedef struct cpubench_cpumask
+{
+    unsigned long long bits[CPUBENCH_MAX_CPUS / 64];
+} cpubench_cpumask;
+
+/* Parameters of the PI workload (Chudnovsky algorithm, single-threaded) */
+typedef struct cpubench_pi_params
+{
+    unsigned long digits;
+} cpubench_pi_params;
+
+/* Parameters of the prime counting workload (multithreaded trial division) */
+typedef struct cpubench_prime_params
+{
+    unsigned long long max;
+} cpubench_prime_params;
+
+/* Parameters of the memory bandwidth workload (STREAM copy, scale, add and triad, plus a
+ * read-only sum and a write-only fill with non-temporal stores) */
+typedef struct cpubench_stream_params
+{
+    /* Bytes per array, three arrays are used. Should be well above the last level cache */
+    unsigned long long bytes;
+    /* Passes over every kernel, the fastest one counts */
+    int ntimes;
+    /* Also run triad with 1, 2, 4, ... threads to show how bandwidth scales */
+    int sweep;
+} cpubench_stream_params;
+
+/* Parameters of the cache and TLB latency probe (single-threaded pointer chasing over random
+ * cyclic permutations of cache lines, two working set sizes per doubling) */
+typedef struct cpubench_latency_params
+{
+    /* Smallest and largest working set, up to several GiB when memory allows */
+    unsigned long long min_bytes;
+    unsigned long long max_bytes;
+    /* Also chase over huge pages, which takes the TLB out of the picture */
+    int hugepages;
+} cpubench_latency_params;
+
+/* Parameters of the loaded latency workload: thread 0 chases pointers through memory while all
+ * other threads stream over their own buffers at a series of throttled injection rates */
+typedef struct cpubench_loaded_latency_params
+{
+    /* Working set of the latency chase */
+    unsigned long long bytes;
+    /* Buffer of every load generating thread */
+    unsigned long long load_bytes;
+    /* Share of cache lines the load threads write rather than read, 0 to 100 */
+    int write_percent;
+} cpubench_loaded_latency_params;
+
+/* Parameters of the dense matrix multiply workload (C = A * B on square row-major matrices,
+ * cache blocked with packed panels and AVX2/FMA or AVX-512 micro-kernels where available) */
+typedef struct cpubench_gemm_params
+{
+    /* Matrix order */
+    unsigned long n;
+    /* Single precision (SGEMM) instead of double (DGEMM) */
+    int single;
+    /* Timed multiplies after one untimed one, the fastest counts */
+    int ntimes;
+    /* Use the portable kernel even if the CPU has a SIMD one */
+    int generic;
+} cpubench_gemm_params;
+
+/* Parameters of the HPL-style solve (Ax = b on a random dense matrix by blocked LU with partial
+ * pivoting and one panel of look-ahead, checked with HPL's scaled residual) */
+typedef struct cpubench_hpl_params
+{
+    /* Matrix order */
+    unsigned long n;
+    /* Panel width, at most 256 */
+    int nb;
+    /* Use the portable GEMM kernel for the trailing update */
+    int generic;
+} cpubench_hpl_params;
+
+/* Parameters of the HPCG-style solve (conjugate gradient with a symmetric Gauss-Seidel
+ * preconditioner on the 27-point operator of an n x n x n grid) */
+typedef struct cpubench_hpcg_params
+{
+    /* Grid edge, the matrix has n^3 rows */
+    unsigned long n;
+    /* CG iterations, always run to the end */
+    int iterations;
+} cpubench_hpcg_params;
+
+/* Parameters of the complex FFT workload (forward transforms of double precision complex data,
+ * radix-4 Stockham rows, six-step for long 1D transforms) */
+typedef struct cpubench_fft_params
+{
+    /* Points per dimension, a power of two. 2^28 points at most in total */
+    unsigned long n;
+    /* 1, 2 or 3 dimensions, at most 16384 points per dimension above 1 */
+    int dims;
+    /* Timed transforms after one untimed one, the fastest counts */
+    int ntimes;
+} cpubench_fft_params;
+
+/* Parameters of the 3D Jacobi stencil workload (7 or 27 points on an n x n x n grid with fixed
+ * boundaries, run naive, spatially blocked and temporally tiled) */
+typedef struct cpubench_stencil_params
+{
+    /* Grid edge, boundary included */
+    unsigned long n;
+    /* 7 or 27 */
+    int points;
+    /* Time steps of every variant */
+    int steps;
+    /* Time steps per temporal tile */
+    int tile;
+} cpubench_stencil_params;
+
+/* Sparsity patterns of the SpMV workload */
+typedef enum cpubench_spmv_pattern
+{
+    /* Each of the three below in turn */
+    CPUBENCH_SPMV_ALL = 0,
+    /* Columns within band of the diagonal */
+    CPUBENCH_SPMV_BANDED,
+    /* Columns anywhere */
+    CPUBENCH_SPMV_RANDOM,
+    /* Columns anywhere, row lengths drawn from a Pareto distribution */
+    CPUBENCH_SPMV_POWERLAW
+} cpubench_spmv_pattern;
+
+/* Parameters of the sparse matrix-vector multiply workload (a generated square matrix in CSR and
+ * in SELL-C-sigma, rows split over the threads by nonzeros) */
+typedef struct cpubench_spmv_params
+{
+    /* Rows and columns */
+    unsigned long rows;
+    /* Nonzeros per row, the mean for power-law rows */
+    int nnz;
+    /* Set by name: "all", "banded", "random" or "power-law" */
+    cpubench_spmv_pattern pattern;
+    /* Half-width of the band, in columns */
+    unsigned long band;
+    /* Shape of the power-law row lengths in hundredths, above 100. Smaller is more skewed */
+    int alpha;
+    /* SELL-C-sigma chunk height (at most 32) and sorting window */
+    int chunk;
+    int sigma;
+    /* Timed products after one untimed one, the fastest counts */
+    int ntimes;
+} cpubench_spmv_params;
+
+/* Digests of the hashing workload */
+typedef enum cpubench_hash_algorithm
+{
+    /* Each of the ones below in turn */
+    CPUBENCH_HASH_ALL = 0,
+    CPUBENCH_HASH_MD5,
+    CPUBENCH_HASH_SHA1,
+    CPUBENCH_HASH_SHA256,
+    CPUBENCH_HASH_SHA512,
+    CPUBENCH_HASH_SHA3_256,
+    CPUBENCH_HASH_BLAKE2B512,
+    CPUBENCH_HASH_BLAKE2S256
+} cpubench_hash_algorithm;
+
+/* Parameters of the hashing workload (OpenSSL EVP digests of one message per call, on every thread) */
+typedef struct cpubench_hash_params
+{
+    /* Smallest and largest message in bytes, sizes in between go up by factors of 4 */
+    unsigned long min;
+    unsigned long max;
+    /* Set by OpenSSL name: "all", "md5", "sha1", "sha256", "sha512", "sha3-256", "blake2b512" or "blake2s256" */
+    cpubench_hash_algorithm algorithm;
+    /* MiB each thread hashes per message size */
+    unsigned long volume;
+} cpubench_hash_params;
+
+/* Ciphers of the authenticated encryption workload */
+typedef enum cpubench_aead_cipher
+{
+    /* Each of the ones below in turn */
+    CPUBENCH_AEAD_ALL = 0,
+    CPUBENCH_AEAD_AES_128_GCM,
+    CPUBENCH_AEAD_AES_256_GCM,
+    CPUBENCH_AEAD_CHACHA20_POLY1305
+} cpubench_aead_cipher;
+
+/* Parameters of the authenticated encryption workload (OpenSSL EVP AEAD ciphers sealing and
+ * opening TLS-like records, on one core and on every thread) */
+typedef struct cpubench_aead_params
+{
+    /* Smallest and largest record in bytes, sizes in between go up by factors of 4 */
+    unsigned long min;
+    unsigned long max;
+    /* Set by OpenSSL name: "all", "aes-128-gcm", "aes-256-gcm" or "chacha20-poly1305" */
+    cpubench_aead_cipher cipher;
+    /* MiB each thread seals or opens per record size */
+    unsigned long volume;
+} cpubench_aead_params;
+
+/* Algorithms of the public-key workload */
+typedef enum cpubench_pkey_algorithm
+{
+    /* Each of the ones below in turn */
+    CPUBENCH_PKEY_ALL = 0,
+    /* Sign and verify, PKCS#1 v1.5 over SHA-256 */
+    CPUBENCH_PKEY_RSA2048,
+    CPUBENCH_PKEY_RSA4096,
+    /* Sign and verify over SHA-256 */
+    CPUBENCH_PKEY_ECDSA_P256,
+    /* Key agreement */
+    CPUBENCH_PKEY_X25519,
+    /* Sign and verify */
+    CPUBENCH_PKEY_ED25519
+} cpubench_pkey_algorithm;
+
+/* Parameters of the public-key workload (OpenSSL operations per second and their latencies, on
+ * one core and on every thread) */
+typedef struct cpubench_pkey_params
+{
+    /* Set by name: "all", "rsa2048", "rsa4096", "ecdsa-p256", "x25519" or "ed25519" */
+    cpubench_pkey_algorithm algorithm;
+    /* Milliseconds each operation runs per pass */
+    unsigned long duration;
+} cpubench_pkey_params;
+
+/* Operations of the GMP number theory workload */
+typedef enum cpubench_gmp_op
+{
+    /* Each of the ones below in turn */
+    CPUBENCH_GMP_ALL = 0,
+    CPUBENCH_GMP_POWM,
+    CPUBENCH_GMP_POWM_SEC,
+    CPUBENCH_GMP_GCD,
+    CPUBENCH_GMP_GCDEXT,
+    CPUBENCH_GMP_INVERT
+} cpubench_gmp_op;
+
+/* Parameters of the GMP number theory workload (mpz_powm, mpz_powm_sec, mpz_gcd, mpz_gcdext and
+ * mpz_invert over doubling operand sizes, every thread on operands of its own) */
+typedef struct cpubench_gmp_params
+{
+    /* Smallest and largest operand in bits */
+    unsigned long min;
+    unsigned long max;
+    /* Bits of the powm exponent, 0 for as many as the modulus up to 1024 */
+    unsigned long exponent;
+    /* Set by name: "all", "powm", "powm_sec", "gcd", "gcdext" or "invert" */
+    cpubench_gmp_op op;
+    /* Milliseconds each operation runs per size, every thread does at least one */
+    unsigned long duration;
+} cpubench_gmp_params;
+
+/* Parameters of the big-integer multiplication workload (mpz_mul of two operands, and of one
+ * operand by itself, which GMP squares as it has no public mpz_sqr, from one limb up, on one
+ * thread) */
+typedef struct cpubench_bigmul_params
+{
+    /* Largest operand in bits */
+    unsigned long max;
+    /* Sizes per doubling of the operand */
+    int steps;
+    /* Milliseconds each size runs, at least one call */
+    unsigned long duration;
+} cpubench_bigmul_params;
+
+/* Workload selection and parameters for one run */
+typedef struct cpubench_params
+{
+    cpubench_workload workload;
+    /* Number of threads for parallel workloads, 0 means all available (or one per CPU in cpus) */
+    int threads;
+    /* CPUs to pin threads to, thread n goes to the n-th CPU in the set. Empty runs unpinned */
+    cpubench_cpumask cpus;
+    /* Free-form tag copied to the result, e.g. the core type a run was pinned to */
+    char tag[32];
+    /* Memory placement, mem_nodes is a bit mask of NUMA nodes where 0 means all of them */
+    cpubench_mem_policy mem_policy;
+    unsigned long long mem_nodes;
+    union
+    {
+        cpubench_pi_params pi;
+        cpubench_prime_params prime;
+        cpubench_stream_params stream;
+        cpubench_latency_params latency;
+        cpubench_loaded_latency_params loaded;
+        cpubench_gemm_params gemm;
+        cpubench_hpl_params hpl;
+        cpubench_hpcg_params hpcg;
+        cpubench_fft_params fft;
+        cpubench_stencil_params stencil;
+        cpubench_spmv_params spmv;
+        cpubench_hash_params hash;
+        cpubench_aead_params aead;
+        cpubench_pkey_params pkey;
+        cpubench_gmp_params gmp;
+        cpubench_bigmul_params bigmul;
+    } u;
+} cpubench_params;
+
+/* A named measurement attached to a result, e.g. throughput at one buffer size */
+typedef struct cpubench_metric
+{
+    char name[48];
+    char label[64];
+    char unit[16];
+    double value;
+    /* Set for times and costs (ns, us, cycles/B), where a smaller value is the better one */
+    int lower_is_better;
+} cpubench_metric;
+
+/* Outcome of one run. Release with cpubench_result_clear() */
+typedef struct cpubench_result
+{
+    cpubench_workload workload;
+    int threads;
+    char tag[32];
+    /* Wall-clock time of the measured region */
+    double seconds;
+    /* What count holds, by workload:
+     * PI: iterations executed
+     * PRIMES: primes found
+     * STREAM: elements per array
+     * LATENCY: working set sizes measured
+     * LOADED_LATENCY: points on the curve
+     * GEMM: floating point operations per multiply
+     * HPL: floating point operations per solve
+     * HPCG: floating point operations over all iterations
+     * FFT: floating point operations per transform
+     * STENCIL: lattice updates per schedule
+     * SPMV: nonzeros per product, rows times the mean row length
+     * HASH: bytes hashed
+     * AEAD: bytes sealed and opened
+     * PKEY: operations timed
+     * GMP: operations timed
+     * BIGMUL: multiplies and squares timed, one of each per size */
+    unsigned long long count;
+    /* MD5 checksum of the workload output, for verification */
+    char checksum[33];
+    /* CPUBENCH_ISOLATE_* measures that were in effect */
+    unsigned int isolation;
+    /* cgroup CPU bandwidth throttling that happened during the run */
+    unsigned long long throttled_periods;
+    double throttled_seconds;
+    /* Digits of PI as returned by mpf_get_str, NULL for other workloads */
+    char *digits;
+    cpubench_metric *metrics;
+    size_t nmetrics;
+} cpubench_result;
+
+/* Snapshot of a running workload */
+typedef struct cpubench_progress
+{
+    cpubench_workload workload;
+    /* Share of the work units completed, 0 to 1 */
+    double fraction;
+    /* Seconds since the measured region started */
+    double elapsed;
+    /* Work units completed per second so far (digits or numbers tested) */
+    double rate;
+} cpubench_progress;
+
+/* CPU sensor readings, NAN when the system doesn't expose them */
+typedef struct cpubench_sensors
+{
+    /* Mean current frequency over all online CPUs */
+    double frequency_hz;
+    /* CPU package temperature */
+    double temperature_c;
+} cpubench_sensors;
+
+/* CPU resources available to this process */
+typedef struct cpubench_cpu_limits
+{
+    int online_cpus;
+    /* CPUs in our affinity mask, i.e. the cpuset we are confined to */
+    int cpuset_cpus;
+    /* cgroup CPU bandwidth limit (cpu.max or cfs_quota_us) in CPUs, 0 when unlimited */
+    double quota_cpus;
+    /* 1 or 2, 0 when no cgroup CPU controller was found */
+    int cgroup_version;
+    /* Threads parallel workloads use when params->threads is 0 */
+    int effective_cpus;
+} cpubench_cpu_limits;
+
+/* One logical CPU */
+typedef struct cpubench_cpu_info
+{
+    int cpu;
+    int package_id;
+    int core_id;
+    /* Cluster sharing an L2 or similar, -1 when the kernel doesn't report one */
+    int cluster_id;
+    /* Relative compute capacity (cpu_capacity, max 1024), 0 when unknown */
+    int capacity;
+    /* NUMA node */
+    int node;
+    /* Index into cpubench_topology.types */
+    int type;
+    /* Position among the hardware threads of its core that we may use, 0 for the first */
+    int smt_rank;
+} cpubench_cpu_info;
+
+/* A class of cores, e.g. performance or efficiency cores of a hybrid CPU */
+typedef struct cpubench_core_type
+{
+    char name[16];
+    int capacity;
+    int ncpus;
+    cpubench_cpumask cpus;
+} cpubench_core_type;
+
+/* A NUMA node, limited to the CPUs we may run on */
+typedef struct cpubench_numa_node
+{
+    int id;
+    int ncpus;
+    cpubench_cpumask cpus;
+    unsigned long long mem_bytes;
+} cpubench_numa_node;
+
+/* CPUs this process may run on. Release with cpubench_topology_clear() */
+typedef struct cpubench_topology
+{
+    int ncpus;
+    cpubench_cpu_info *cpus;
+    /* Core types, fastest first. A non-hybrid CPU has exactly one */
+    int ntypes;
+    cpubench_core_type types[CPUBENCH_MAX_CORE_TYPES];
+    /* One CPU per physical core, i.e. the CPUs with smt_rank 0 */
+    int ncores;
+    cpubench_cpumask physical;
+    /* Most hardware threads we may use on one core, 1 without SMT */
+    int threads_per_core;
+    /* NUMA nodes with at least one of our CPUs. Machines without NUMA have one */
+    int nnodes;
+    cpubench_numa_node nodes[CPUBENCH_MAX_NODES];
+} cpubench_topology;
+
+/* The clock libcpubench measures with */
+typedef struct cpubench_timer_info
+{
+    /* "rdtscp", "rdtsc" or "clock_gettime" */
+    const char *source;
+    /* Calibrated TSC frequency, 0 when the TSC isn't used */
+    double tsc_hz;
+    /* Smallest step between two consecutive reads */
+    double resolution_ns;
+    /* Cost of one read */
+    double overhead_ns;
+} cpubench_timer_info;
+
+/* Most entries a reference table may hold */
+#define CPUBENCH_MAX_REFERENCE 32
+
+/* One workload of the scoring suite and the result the reference machine got for it */
+typedef struct cpubench_reference_entry
+{
+    /* Workload and parameters as written in the table, e.g. "primes max=100000" */
+    char name[64];
+    /* Counts towards the multi-thread score rather than the single-thread one */
+    int multithreaded;
+    cpubench_params params;
+    /* Metric that is compared, and its value on the reference machine */
+    char metric[48];
+    double value;
+    /* Expected checksum, empty when the table doesn't give one */
+    char checksum[33];
+} cpubench_reference_entry;
+
+/* A reference table. Scores are only comparable between runs against the same version */
+typedef struct cpubench_reference
+{
+    int version;
+    char machine[64];
+    int nentries;
+    cpubench_reference_entry entries[CPUBENCH_MAX_REFERENCE];
+} cpubench_reference;
+
+/* How one workload of the suite compared to the reference machine */
+typedef struct cpubench_score_entry
+{
+    double value;
+    /* value over the reference value, above 1 is faster */
+    double ratio;
+    /* 0 when the checksum didn't match the reference table */
+    int verified;
+} cpubench_score_entry;
+
+/* Geometric means of the ratios, scaled so that the reference machine scores 1000.
+ * A class without entries scores 0 */
+typedef struct cpubench_score
+{
+    double single;
+    double multi;
+    /* 0 when any workload produced a wrong result, the score then means nothing */
+    int valid;
+    int nentries;
+    cpubench_score_entry entries[CPUBENCH_MAX_REFERENCE];
+} cpubench_score;
+
+/* Opaque benchmark context */
+typedef struct cpubench_ctx cpubench_ctx;
+
+/* Invoked once for every result produced by cpubench_run() */
+typedef void (*cpubench_result_cb)(const cpubench_result *result, void *user);
+
+/* Invoked at most every interval seconds while a workload runs. It may be called from any
+ * worker thread, but never from two threads at once, and it adds to the measured time */
+typedef void (*cpubench_progress_cb)(const cpubench_progress *progress, void *user);
+
+/* Context lifetime */
+cpubench_status cpubench_ctx_create(cpubench_ctx **out);
+void cpubench_ctx_destroy(cpubench_ctx *ctx);
+void cpubench_set_result_callback(cpubench_ctx *ctx, cpubench_result_cb cb, void *user);
+void cpubench_set_progress_callback(cpubench_ctx *ctx, cpubench_progress_cb cb, void *user, double interval);
+
+/* Start the worker threads and pre-fault a scratch arena of at least scratch_bytes, so that
+ * later runs on this context don't pay thread creation, allocation or page-fault costs */
+cpubench_status cpubench_ctx_warm(cpubench_ctx *ctx, int threads, size_t scratch_bytes);
+
+/* Take the requested CPUBENCH_ISOLATE_* measures for all later runs on this context. Measures
+ * the process isn't allowed to take (mlockall and SCHED_FIFO usually need root or raised limits)
+ * are skipped; achieved (if not NULL) receives the ones that succeeded, and every result records
+ * them. SCHED_FIFO threads that never block can starve the rest of the system, so leave it off
+ * unless the kernel's real-time throttling is in place or the run is pinned to isolated CPUs */
+cpubench_status cpubench_ctx_isolate(cpubench_ctx *ctx, unsigned int requested, unsigned int *achieved);
+
+/* Fill params with the defaults of the given workload */
+void cpubench_params_init(cpubench_params *params, cpubench_workload workload);
+
+/* Set one parameter by name, e.g. "threads", "cpus", "mem", "nodes", "digits", "max" or "size".
+ * Sizes are in MiB (STREAM arrays, largest LATENCY working set, LOADED_LATENCY chase and "load"
+ * buffers) except the LATENCY "min", which is in KiB. "value" sets the main size parameter of
+ * the workload, the same number the command line tool takes */
+cpubench_status cpubench_params_set(cpubench_params *params, const char *key, const char *value);
+
+/* Run one workload. On success, result (if not NULL) owns the output and must be cleared */
+cpubench_status cpubench_run(cpubench_ctx *ctx, const cpubench_params *params, cpubench_result *result);
+void cpubench_result_clear(cpubench_result *result);
+
+/* Run one instance of the workload per NUMA node at the same time, each pinned to the CPUs of
+ * its node with memory bound to it. results must have room for CPUBENCH_MAX_NODES entries */
+cpubench_status cpubench_run_per_node(cpubench_ctx *ctx, const cpubench_params *params, cpubench_result *results, int *nresults);
+
+/* Serialize a result as a single-line JSON object. Returns a malloc'd string or NULL */
+char *cpubench_result_to_json(const cpubench_result *result);
+
+/* Load a reference table. Each line is "single" or "multi", the workload name, any number of
+ * key=value parameters as taken by cpubench_params_set(), the metric, the reference value and
+ * optionally the expected checksum. "version" and "machine" lines describe the table */
+cpubench_status cpubench_reference_load(const char *path, cpubench_reference *out);
+
+/* Run every workload of a reference table and score this machine against it. Single-thread
+ * entries run on one thread unless the table says otherwise, multi-thread ones on all */
+cpubench_status cpubench_score_run(cpubench_ctx *ctx, const cpubench_reference *reference, cpubench_score *out);
+
+/* Timestamps from the calibrated clock every workload uses. The invariant TSC is calibrated
+ * against CLOCK_MONOTONIC_RAW on first use and read with rdtscp; without a reliable TSC this
+ * falls back to clock_gettime. Ticks are only meaningful as differences */
+unsigned long long cpubench_timer_now(void);
+double cpubench_timer_seconds(unsigned long long ticks);
+cpubench_status cpubench_timer_get_info(cpubench_timer_info *out);
+
+/* Read CPU frequency and temperature from sysfs */
+cpubench_status cpubench_read_sensors(cpubench_sensors *out);
+
+/* Detect the CPUs we may actually use. OMP_NUM_THREADS, when set, overrides the result */
+cpubench_status cpubench_read_cpu_limits(cpubench_cpu_limits *out);
+
+/* Read the topology of the CPUs in our affinity mask from sysfs. Core types come from the
+ * cpu_core/cpu_atom PMUs on Intel hybrid parts, otherwise from cpu_capacity */
+cpubench_status cpubench_topology_read(cpubench_topology *out);
+void cpubench_topology_clear(cpubench_topology *topology);
+
+/* CPU mask helpers. cpubench_cpumask_parse() takes the sysfs list format, e.g. "0-3,8" */
+void cpubench_cpumask_set(cpubench_cpumask *mask, int cpu);
+int cpubench_cpumask_isset(const cpubench_cpumask *mask, int cpu);
+int cpubench_cpumask_count(const cpubench_cpumask *mask);
+cpubench_status cpubench_cpumask_parse(cpubench_cpumask *mask, const char *list);
+
+/* Helpers */
+int cpubench_max_threads(void);
+const char *cpubench_strerror(cpubench_status status);
+const char *cpubench_workload_name(cpubench_workload workload);
+cpubench_status cpubench_workload_from_name(const char *name, cpubench_workload *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CPUBENCH_H */
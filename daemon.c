@@ -0,0 +1,398 @@
+/*
+*
+* daemon.c - cpubench daemon (cpubenchd)
+* Author: Suyash Srijan
+* Email: suyashsrijan@outlook.com
+*
+* Keeps one warmed libcpubench context alive and serves benchmark requests over a Unix domain
+* socket, so frequent short probes don't pay process startup, thread creation and page faults.
+*
+* Every request is one line holding a flat JSON object, for example
+*   {"workload":"primes","value":100000,"threads":4}
+* Every key other than "workload" is passed to cpubench_params_set(). The reply is one line,
+* either the JSON result or {"error":"..."}. A connection may carry any number of requests.
+* Requests are served one at a time so that benchmarks never overlap. A connection that sends
+* nothing for IDLE_TIMEOUT seconds is dropped, so one idle client can't starve the next.
+*
+* Compile using gcc : gcc -O3 -Wall -o cpubenchd cpubench.c daemon.c -lgmp -lssl -lcrypto -lm -fopenmp
+*
+*/
+
+#include <ctype.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "cpubench.h"
+
+/* Default location of the socket */
+#define DEFAULT_SOCKET "/tmp/cpubenchd.sock"
+
+/* Default size of the pre-faulted scratch arena (MB) */
+#define DEFAULT_SCRATCH_MB 64
+
+/* Longest request line we accept */
+#define MAX_REQUEST 4096
+
+/* Most keys in one request */
+#define MAX_KEYS 32
+
+/* Seconds a client may stay silent, or not read its reply, before we hang up */
+#define IDLE_TIMEOUT 5
+
+/* Set by the signal handler to stop serving */
+static volatile sig_atomic_t stop_requested = 0;
+
+/* One key/value pair from a request */
+struct request_field
+{
+    char key[64];
+    char value[256];
+};
+
+/* Ask the accept loop to stop */
+static void handle_stop(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+/* Copy a JSON string or bare scalar starting at p into out, returning the position after it */
+static const char *parse_token(const char *p, char *out, size_t len)
+{
+    size_t n = 0;
+
+    if (*p == '"')
+    {
+        for (p++; *p && *p != '"'; p++)
+        {
+            if (*p == '\\' && p[1])
+            {
+                p++;
+            }
+            if (n + 1 < len)
+            {
+                out[n++] = *p;
+            }
+        }
+        if (*p != '"')
+        {
+            return NULL;
+        }
+        p++;
+    }
+    else
+    {
+        for (; *p && *p != ',' && *p != '}' && !isspace((unsigned char)*p); p++)
+        {
+            if (n + 1 < len)
+            {
+                out[n++] = *p;
+            }
+        }
+    }
+    out[n] = '\0';
+    return (n > 0) ? p : NULL;
+}
+
+/* Parse a flat JSON object of scalars. Returns the number of fields or -1 */
+static int parse_request(const char *p, struct request_field *fields, int max)
+{
+    int n = 0;
+
+    while (isspace((unsigned char)*p))
+    {
+        p++;
+    }
+    if (*p++ != '{')
+    {
+        return -1;
+    }
+
+    for (;;)
+    {
+        while (isspace((unsigned char)*p) || *p == ',')
+        {
+            p++;
+        }
+        if (*p == '}')
+        {
+            return n;
+        }
+        if (n == max || (p = parse_token(p, fields[n].key, sizeof(fields[n].key))) == NULL)
+        {
+            return -1;
+        }
+        while (isspace((unsigned char)*p))
+        {
+            p++;
+        }
+        if (*p++ != ':')
+        {
+            return -1;
+        }
+        while (isspace((unsigned char)*p))
+        {
+            p++;
+        }
+        if ((p = parse_token(p, fields[n].value, sizeof(fields[n].value))) == NULL)
+        {
+            return -1;
+        }
+        n++;
+    }
+}
+
+/* Write a complete buffer to a socket */
+static int write_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t w = write(fd, buf, len);
+        if (w < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        buf += w;
+        len -= (size_t)w;
+    }
+    return 0;
+}
+
+/* Send an error reply */
+static int reply_error(int fd, const char *message)
+{
+    char buf[256];
+    int len = snprintf(buf, sizeof(buf), "{\"error\":\"%s\"}\n", message);
+    return write_all(fd, buf, (size_t)len);
+}
+
+/* Run one request line and send the reply */
+static int serve_request(cpubench_ctx *ctx, int fd, const char *line)
+{
+    struct request_field fields[MAX_KEYS];
+    cpubench_params params;
+    cpubench_result result;
+    cpubench_workload workload;
+    cpubench_status status;
+    int nfields, f;
+    int have_workload = 0;
+
+    if ((nfields = parse_request(line, fields, MAX_KEYS)) < 0)
+    {
+        return reply_error(fd, "Malformed request");
+    }
+
+    /* Select the workload first so the other keys apply to its parameters */
+    for (f = 0; f < nfields; f++)
+    {
+        if (strcmp(fields[f].key, "workload") == 0)
+        {
+            if (cpubench_workload_from_name(fields[f].value, &workload) != CPUBENCH_OK)
+            {
+                return reply_error(fd, "Unknown workload");
+            }
+            have_workload = 1;
+        }
+    }
+    if (!have_workload)
+    {
+        return reply_error(fd, "Missing workload");
+    }
+
+    cpubench_params_init(&params, workload);
+    for (f = 0; f < nfields; f++)
+    {
+        if (strcmp(fields[f].key, "workload") != 0 && cpubench_params_set(&params, fields[f].key, fields[f].value) != CPUBENCH_OK)
+        {
+            return reply_error(fd, "Invalid parameter");
+        }
+    }
+
+    if ((status = cpubench_run(ctx, &params, &result)) != CPUBENCH_OK)
+    {
+        return reply_error(fd, cpubench_strerror(status));
+    }
+
+    char *json = cpubench_result_to_json(&result);
+    cpubench_result_clear(&result);
+    if (json == NULL)
+    {
+        return reply_error(fd, cpubench_strerror(CPUBENCH_ERR_NOMEM));
+    }
+
+    int rc = write_all(fd, json, strlen(json));
+    if (rc == 0)
+    {
+        rc = write_all(fd, "\n", 1);
+    }
+    free(json);
+    return rc;
+}
+
+/* Serve requests on one connection until the client hangs up or goes idle. The receive timeout
+ * makes read() fail with EAGAIN, which ends the connection like a hang-up */
+static void serve_client(cpubench_ctx *ctx, int fd)
+{
+    char buf[MAX_REQUEST];
+    size_t used = 0;
+
+    while (!stop_requested)
+    {
+        ssize_t r = read(fd, buf + used, sizeof(buf) - 1 - used);
+        if (r < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (r <= 0)
+        {
+            return;
+        }
+        used += (size_t)r;
+        buf[used] = '\0';
+
+        /* Handle every complete line in the buffer */
+        char *line = buf;
+        char *nl;
+        while ((nl = strchr(line, '\n')) != NULL)
+        {
+            *nl = '\0';
+            if (*line != '\0' && serve_request(ctx, fd, line) != 0)
+            {
+                return;
+            }
+            line = nl + 1;
+        }
+        used -= (size_t)(line - buf);
+        memmove(buf, line, used);
+
+        /* A line that fills the whole buffer can never complete */
+        if (used == sizeof(buf) - 1)
+        {
+            reply_error(fd, "Request too long");
+            return;
+        }
+    }
+}
+
+/* Entry point of the daemon */
+int main(int argc, char *argv[])
+{
+    const char *path = DEFAULT_SOCKET;
+    int threads = 0;
+    int isolate = 0;
+    unsigned long scratch_mb = DEFAULT_SCRATCH_MB;
+    struct sockaddr_un addr;
+    struct sigaction sa;
+    cpubench_ctx *ctx;
+    cpubench_status status;
+    int opt;
+    int sock;
+
+    /* Parse command line */
+    while ((opt = getopt(argc, argv, "s:t:m:ih")) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            path = optarg;
+            break;
+        case 't':
+            threads = atoi(optarg);
+            break;
+        case 'm':
+            scratch_mb = strtoul(optarg, NULL, 10);
+            break;
+        case 'i':
+            isolate = 1;
+            break;
+        default:
+            fprintf(stderr, "Usage: cpubenchd [-s socket] [-t threads] [-m scratch MB] [-i]\n-i: pre-fault and lock all memory\nDefaults: -s %s -t all -m %d\n", DEFAULT_SOCKET, DEFAULT_SCRATCH_MB);
+            return (opt == 'h') ? 0 : 1;
+        }
+    }
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "Error: Socket path too long\n");
+        return 1;
+    }
+
+    /* Create and warm up the context before accepting anything */
+    if ((status = cpubench_ctx_create(&ctx)) != CPUBENCH_OK || (status = cpubench_ctx_warm(ctx, threads, scratch_mb << 20)) != CPUBENCH_OK)
+    {
+        fprintf(stderr, "Error: %s\n", cpubench_strerror(status));
+        return 1;
+    }
+
+    /* Results record whether locking worked, the daemon runs either way */
+    unsigned int achieved = 0;
+    if (isolate && cpubench_ctx_isolate(ctx, CPUBENCH_ISOLATE_PREFAULT | CPUBENCH_ISOLATE_MLOCK, &achieved) == CPUBENCH_OK && !(achieved & CPUBENCH_ISOLATE_MLOCK))
+    {
+        fprintf(stderr, "Warning: Unable to lock memory, check RLIMIT_MEMLOCK\n");
+    }
+
+    /* Stop cleanly on SIGINT/SIGTERM and survive clients hanging up mid-reply */
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    /* Bind the socket */
+    if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    {
+        perror("socket");
+        cpubench_ctx_destroy(ctx);
+        return 1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(sock, 16) < 0)
+    {
+        perror("bind");
+        close(sock);
+        cpubench_ctx_destroy(ctx);
+        return 1;
+    }
+
+    printf("cpubenchd v%s listening on %s\n", CPUBENCH_VERSION_STRING, path);
+    fflush(stdout);
+
+    /* Serve clients one after the other */
+    while (!stop_requested)
+    {
+        int fd = accept(sock, NULL, NULL);
+        if (fd < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("accept");
+            break;
+        }
+        struct timeval idle = { IDLE_TIMEOUT, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &idle, sizeof(idle));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &idle, sizeof(idle));
+        serve_client(ctx, fd);
+        close(fd);
+    }
+
+    close(sock);
+    unlink(path);
+    cpubench_ctx_destroy(ctx);
+    return 0;
+}
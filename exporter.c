@@ -0,0 +1,423 @@
+/*
+*
+* exporter.c - OpenMetrics output of cpubench
+* Author: Suyash Srijan
+* Email: suyashsrijan@outlook.com
+*
+* Every update re-renders the whole exposition. The file is written next to its final name and
+* renamed over it, so the textfile collector never reads a partial file. The HTTP server runs on
+* its own thread, binds to 127.0.0.1 only and answers every request with the latest exposition.
+*
+*/
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/utsname.h>
+
+#include "exporter.h"
+
+/* Results we keep around for the exposition */
+#define MAX_RESULTS 64
+
+/* Exporter state */
+struct exporter
+{
+    pthread_mutex_t lock;
+    char *path;
+    char *tmp_path;
+    int sock;
+    pthread_t thread;
+    int have_thread;
+
+    /* Latest rendered exposition */
+    char *text;
+    size_t text_len;
+
+    /* What is running right now */
+    int running;
+    cpubench_workload workload;
+    cpubench_progress progress;
+    cpubench_sensors sensors;
+
+    /* Copies of finished results */
+    cpubench_result results[MAX_RESULTS];
+    size_t nresults;
+};
+
+/* Write a label value, escaping as OpenMetrics requires */
+static void write_label(FILE *out, const char *value)
+{
+    for (; *value; value++)
+    {
+        if (*value == '"' || *value == '\\')
+        {
+            fputc('\\', out);
+            fputc(*value, out);
+        }
+        else if (*value == '\n')
+        {
+            fputs("\\n", out);
+        }
+        else
+        {
+            fputc(*value, out);
+        }
+    }
+}
+
+/* Write a metric name, replacing characters OpenMetrics doesn't allow */
+static void write_name(FILE *out, const char *name)
+{
+    for (; *name; name++)
+    {
+        char c = *name;
+        int ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == ':';
+        fputc(ok ? c : '_', out);
+    }
+}
+
+/* Write a sample value, OpenMetrics spells non-finite numbers its own way */
+static void write_value(FILE *out, double value)
+{
+    if (isnan(value))
+    {
+        fputs(" NaN\n", out);
+    }
+    else
+    {
+        fprintf(out, " %.9g\n", value);
+    }
+}
+
+/* Render the exposition into exp->text. Caller holds the lock */
+static void render(exporter *exp)
+{
+    char *text = NULL;
+    size_t len = 0;
+    size_t r, m, k;
+    struct utsname uts;
+    FILE *out = open_memstream(&text, &len);
+
+    if (out == NULL)
+    {
+        return;
+    }
+    uname(&uts);
+
+    fputs("# TYPE cpubench_info gauge\n# HELP cpubench_info cpubench build and host\n", out);
+    fprintf(out, "cpubench_info{version=\"%s\",machine=\"", CPUBENCH_VERSION_STRING);
+    write_label(out, uts.machine);
+    fputs("\"} 1\n", out);
+
+    /* Live state */
+    const char *live = cpubench_workload_name(exp->workload);
+    fputs("# TYPE cpubench_running gauge\n# HELP cpubench_running Whether a workload is running\n", out);
+    fprintf(out, "cpubench_running{workload=\"%s\"} %d\n", live, exp->running);
+    fputs("# TYPE cpubench_progress_ratio gauge\n# HELP cpubench_progress_ratio Share of the running workload completed\n", out);
+    fprintf(out, "cpubench_progress_ratio{workload=\"%s\"}", live);
+    write_value(out, exp->progress.fraction);
+    fputs("# TYPE cpubench_throughput gauge\n# HELP cpubench_throughput Work units per second of the running workload so far\n", out);
+    fprintf(out, "cpubench_throughput{workload=\"%s\"}", live);
+    write_value(out, exp->progress.rate);
+    fputs("# TYPE cpubench_cpu_frequency_hertz gauge\n# UNIT cpubench_cpu_frequency_hertz hertz\n# HELP cpubench_cpu_frequency_hertz Mean current CPU frequency\n", out);
+    fputs("cpubench_cpu_frequency_hertz", out);
+    write_value(out, exp->sensors.frequency_hz);
+    fputs("# TYPE cpubench_cpu_temperature_celsius gauge\n# UNIT cpubench_cpu_temperature_celsius celsius\n# HELP cpubench_cpu_temperature_celsius CPU package temperature\n", out);
+    fputs("cpubench_cpu_temperature_celsius", out);
+    write_value(out, exp->sensors.temperature_c);
+
+    /* Finished results */
+    if (exp->nresults > 0)
+    {
+        fputs("# TYPE cpubench_duration_seconds gauge\n# UNIT cpubench_duration_seconds seconds\n# HELP cpubench_duration_seconds Time of the measured region\n", out);
+        for (r = 0; r < exp->nresults; r++)
+        {
+            fprintf(out, "cpubench_duration_seconds{workload=\"%s\",threads=\"%d\",tag=\"", cpubench_workload_name(exp->results[r].workload), exp->results[r].threads);
+            write_label(out, exp->results[r].tag);
+            fputs("\"}", out);
+            write_value(out, exp->results[r].seconds);
+        }
+    }
+
+    /* cgroup throttling during each result */
+    if (exp->nresults > 0)
+    {
+        fputs("# TYPE cpubench_throttled_periods gauge\n# HELP cpubench_throttled_periods cgroup CPU quota periods throttled during the run\n", out);
+        for (r = 0; r < exp->nresults; r++)
+        {
+            fprintf(out, "cpubench_throttled_periods{workload=\"%s\",threads=\"%d\",tag=\"", cpubench_workload_name(exp->results[r].workload), exp->results[r].threads);
+            write_label(out, exp->results[r].tag);
+            fprintf(out, "\"} %llu\n", exp->results[r].throttled_periods);
+        }
+        fputs("# TYPE cpubench_throttled_seconds gauge\n# UNIT cpubench_throttled_seconds seconds\n# HELP cpubench_throttled_seconds Time spent throttled by the cgroup CPU quota during the run\n", out);
+        for (r = 0; r < exp->nresults; r++)
+        {
+            fprintf(out, "cpubench_throttled_seconds{workload=\"%s\",threads=\"%d\",tag=\"", cpubench_workload_name(exp->results[r].workload), exp->results[r].threads);
+            write_label(out, exp->results[r].tag);
+            fputs("\"}", out);
+            write_value(out, exp->results[r].throttled_seconds);
+        }
+    }
+
+    /* One family per distinct metric name, all samples of a family must be adjacent */
+    for (r = 0; r < exp->nresults; r++)
+    {
+        for (m = 0; m < exp->results[r].nmetrics; m++)
+        {
+            const char *name = exp->results[r].metrics[m].name;
+            int seen = 0;
+            size_t r2, m2;
+
+            for (r2 = 0; r2 <= r && !seen; r2++)
+            {
+                for (m2 = 0; m2 < ((r2 == r) ? m : exp->results[r2].nmetrics); m2++)
+                {
+                    if (strcmp(exp->results[r2].metrics[m2].name, name) == 0)
+                    {
+                        seen = 1;
+                        break;
+                    }
+                }
+            }
+            if (seen)
+            {
+                continue;
+            }
+
+            fputs("# TYPE cpubench_", out);
+            write_name(out, name);
+            fputs(" gauge\n", out);
+            for (r2 = r; r2 < exp->nresults; r2++)
+            {
+                for (k = 0; k < exp->results[r2].nmetrics; k++)
+                {
+                    const cpubench_metric *metric = &exp->results[r2].metrics[k];
+                    if (strcmp(metric->name, name) != 0)
+                    {
+                        continue;
+                    }
+                    fputs("cpubench_", out);
+                    write_name(out, name);
+                    fprintf(out, "{workload=\"%s\",threads=\"%d\",tag=\"", cpubench_workload_name(exp->results[r2].workload), exp->results[r2].threads);
+                    write_label(out, exp->results[r2].tag);
+                    fputs("\",case=\"", out);
+                    write_label(out, metric->label);
+                    fputs("\",unit=\"", out);
+                    write_label(out, metric->unit);
+                    fputs("\"}", out);
+                    write_value(out, metric->value);
+                }
+            }
+        }
+    }
+    fputs("# EOF\n", out);
+
+    if (fclose(out) != 0)
+    {
+        free(text);
+        return;
+    }
+    free(exp->text);
+    exp->text = text;
+    exp->text_len = len;
+}
+
+/* Re-render and replace the file. Caller holds the lock */
+static void publish(exporter *exp)
+{
+    render(exp);
+    if (exp->path == NULL || exp->text == NULL)
+    {
+        return;
+    }
+
+    FILE *file = fopen(exp->tmp_path, "w");
+    if (file == NULL)
+    {
+        return;
+    }
+    int ok = (fwrite(exp->text, 1, exp->text_len, file) == exp->text_len);
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(exp->tmp_path, exp->path) != 0)
+    {
+        unlink(exp->tmp_path);
+    }
+}
+
+/* Answer HTTP requests until the socket is shut down */
+static void *serve_http(void *arg)
+{
+    exporter *exp = arg;
+    char request[2048];
+    char header[256];
+
+    for (;;)
+    {
+        int fd = accept(exp->sock, NULL, NULL);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            break;
+        }
+
+        /* We serve the same document whatever was asked for */
+        if (read(fd, request, sizeof(request)) > 0)
+        {
+            pthread_mutex_lock(&exp->lock);
+            int hlen = snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\nContent-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n", exp->text_len);
+            if (send(fd, header, (size_t)hlen, MSG_NOSIGNAL) == hlen && exp->text_len > 0)
+            {
+                send(fd, exp->text, exp->text_len, MSG_NOSIGNAL);
+            }
+            pthread_mutex_unlock(&exp->lock);
+        }
+        close(fd);
+    }
+    return NULL;
+}
+
+/* Start the exporter */
+exporter *exporter_start(const char *path, int port)
+{
+    exporter *exp = calloc(1, sizeof(*exp));
+
+    if (exp == NULL)
+    {
+        return NULL;
+    }
+    pthread_mutex_init(&exp->lock, NULL);
+    exp->sock = -1;
+    exp->progress.fraction = NAN;
+    exp->progress.rate = NAN;
+    cpubench_read_sensors(&exp->sensors);
+
+    if (path != NULL)
+    {
+        exp->path = strdup(path);
+        exp->tmp_path = malloc(strlen(path) + 5);
+        if (exp->path == NULL || exp->tmp_path == NULL)
+        {
+            exporter_stop(exp);
+            return NULL;
+        }
+        sprintf(exp->tmp_path, "%s.tmp", path);
+    }
+
+    if (port > 0)
+    {
+        struct sockaddr_in addr;
+        int one = 1;
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((unsigned short)port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if ((exp->sock = socket(AF_INET, SOCK_STREAM, 0)) < 0
+            || setsockopt(exp->sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0
+            || bind(exp->sock, (struct sockaddr *)&addr, sizeof(addr)) < 0
+            || listen(exp->sock, 8) < 0
+            || pthread_create(&exp->thread, NULL, serve_http, exp) != 0)
+        {
+            exporter_stop(exp);
+            return NULL;
+        }
+        exp->have_thread = 1;
+    }
+
+    pthread_mutex_lock(&exp->lock);
+    publish(exp);
+    pthread_mutex_unlock(&exp->lock);
+    return exp;
+}
+
+/* A workload is about to start */
+void exporter_begin(exporter *exp, cpubench_workload workload)
+{
+    pthread_mutex_lock(&exp->lock);
+    exp->running = 1;
+    exp->workload = workload;
+    exp->progress.fraction = 0;
+    exp->progress.rate = NAN;
+    cpubench_read_sensors(&exp->sensors);
+    publish(exp);
+    pthread_mutex_unlock(&exp->lock);
+}
+
+/* Progress callback */
+void exporter_progress(const cpubench_progress *progress, void *arg)
+{
+    exporter *exp = arg;
+
+    pthread_mutex_lock(&exp->lock);
+    exp->progress = *progress;
+    cpubench_read_sensors(&exp->sensors);
+    publish(exp);
+    pthread_mutex_unlock(&exp->lock);
+}
+
+/* Result callback, keeps a copy of the result */
+void exporter_result(const cpubench_result *result, void *arg)
+{
+    exporter *exp = arg;
+
+    pthread_mutex_lock(&exp->lock);
+    exp->running = 0;
+    exp->progress.fraction = 1;
+    exp->progress.rate = NAN;
+    cpubench_read_sensors(&exp->sensors);
+
+    if (exp->nresults < MAX_RESULTS)
+    {
+        cpubench_result *copy = &exp->results[exp->nresults];
+        *copy = *result;
+        copy->digits = NULL;
+        copy->metrics = malloc(result->nmetrics * sizeof(*copy->metrics) + 1);
+        if (copy->metrics != NULL)
+        {
+            memcpy(copy->metrics, result->metrics, result->nmetrics * sizeof(*copy->metrics));
+            exp->nresults++;
+        }
+    }
+    publish(exp);
+    pthread_mutex_unlock(&exp->lock);
+}
+
+/* Stop exporting */
+void exporter_stop(exporter *exp)
+{
+    size_t r;
+
+    if (exp == NULL)
+    {
+        return;
+    }
+    if (exp->sock >= 0)
+    {
+        shutdown(exp->sock, SHUT_RDWR);
+        if (exp->have_thread)
+        {
+            pthread_join(exp->thread, NULL);
+        }
+        close(exp->sock);
+    }
+    for (r = 0; r < exp->nresults; r++)
+    {
+        cpubench_result_clear(&exp->results[r]);
+    }
+    pthread_mutex_destroy(&exp->lock);
+    free(exp->text);
+    free(exp->path);
+    free(exp->tmp_path);
+    free(exp);
+}
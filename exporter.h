@@ -0,0 +1,30 @@
+/*
+*
+* exporter.h - OpenMetrics output of cpubench
+* Author: Suyash Srijan
+* Email: suyashsrijan@outlook.com
+*
+* Publishes live progress and final results in OpenMetrics text format, either to a file that is
+* replaced atomically (for node_exporter's textfile collector) or over HTTP on a local port.
+*
+*/
+
+#ifndef EXPORTER_H
+#define EXPORTER_H
+
+#include "cpubench.h"
+
+typedef struct exporter exporter;
+
+/* Start exporting to path (may be NULL) and/or HTTP port (0 for none). Returns NULL on failure */
+exporter *exporter_start(const char *path, int port);
+
+/* Feed the exporter. These match the libcpubench callback signatures */
+void exporter_begin(exporter *exp, cpubench_workload workload);
+void exporter_progress(const cpubench_progress *progress, void *exp);
+void exporter_result(const cpubench_result *result, void *exp);
+
+/* Stop the HTTP server and release everything */
+void exporter_stop(exporter *exp);
+
+#endif /* EXPORTER_H */
@@ -0,0 +1,709 @@
+/*
+*
+* main.c - Command line front end of cpubench
+* Author: Suyash Srijan
+* Email: suyashsrijan@outlook.com
+*
+* Parses the command line, runs the requested workload through libcpubench and prints the result.
+*
+* Compile using gcc : gcc -O3 -Wall -o cpubench cpubench.c main.c exporter.c profiler.c -lgmp -lssl -lcrypto -lm -fopenmp -lpthread -rdynamic
+*
+*/
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/utsname.h>
+
+#include "cpubench.h"
+#include "exporter.h"
+#include "profiler.h"
+
+/* Build timestamp */
+#define build_time __TIME__
+#define build_date __DATE__
+
+/* Define color codes that we will be using */
+#define TXTNORMAL  "\x1B[0m"
+#define TXTRED     "\x1B[31m"
+#define TXTYELLOW  "\x1B[33m"
+#define TXTGREEN   "\x1B[32m"
+
+/* How often live metrics are refreshed (seconds) */
+#define METRICS_INTERVAL 1.0
+
+/* Profiler sampling rate, slightly off 1 kHz so it doesn't beat against periodic work */
+#define PROFILE_HZ 997
+
+/* Reference table used by --score when no other is given */
+#define REFERENCE_FILE "reference.txt"
+
+/* Set when the user asks us to stop serving metrics */
+static volatile sig_atomic_t stop_requested = 0;
+
+/* Stop lingering after the benchmark */
+static void handle_stop(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+/* Workloads that run on one thread whatever the thread count says */
+static int single_threaded(cpubench_workload workload)
+{
+    return workload == CPUBENCH_WORKLOAD_PI || workload == CPUBENCH_WORKLOAD_LATENCY || workload == CPUBENCH_WORKLOAD_BIGMUL;
+}
+
+/* Run the workload once pinned to each core type and compare their throughput.
+ * Leaves the result of the fastest core type in result */
+static cpubench_status run_per_core_type(cpubench_ctx *ctx, const cpubench_params *params, cpubench_result *result)
+{
+    cpubench_topology topology;
+    cpubench_result runs[CPUBENCH_MAX_CORE_TYPES];
+    cpubench_status status;
+    int t, r;
+
+    if ((status = cpubench_topology_read(&topology)) != CPUBENCH_OK)
+    {
+        return status;
+    }
+    if (topology.ntypes == 1)
+    {
+        printf("%sWARN: No hybrid topology detected, all CPUs are of one type%s\n", TXTYELLOW, TXTNORMAL);
+    }
+
+    for (t = 0; t < topology.ntypes; t++)
+    {
+        cpubench_params pinned = *params;
+        pinned.cpus = topology.types[t].cpus;
+        snprintf(pinned.tag, sizeof(pinned.tag), "%s", topology.types[t].name);
+        printf("Running on %s cores (%d CPUs)...\n", topology.types[t].name, topology.types[t].ncpus);
+        if ((status = cpubench_run(ctx, &pinned, &runs[t])) != CPUBENCH_OK)
+        {
+            for (r = 0; r < t; r++)
+            {
+                cpubench_result_clear(&runs[r]);
+            }
+            cpubench_topology_clear(&topology);
+            return status;
+        }
+    }
+
+    /* Throughput per type, in total and per thread, and how each compares to the fastest */
+    if (!runs[0].metrics[0].lower_is_better)
+    {
+        printf("\nCore type        Threads  Seconds      Throughput (%s)   Per thread\n", runs[0].metrics[0].name);
+        for (t = 0; t < topology.ntypes; t++)
+        {
+            printf("%-16s %7d  %-11lf  %-22.1lf  %.1lf\n", runs[t].tag, runs[t].threads, runs[t].seconds, runs[t].metrics[0].value, runs[t].metrics[0].value / runs[t].threads);
+        }
+        for (t = 1; t < topology.ntypes; t++)
+        {
+            printf("Ratio %s/%s: %.3lf total, %.3lf per thread\n", runs[0].tag, runs[t].tag,
+                   runs[0].metrics[0].value / runs[t].metrics[0].value,
+                   (runs[0].metrics[0].value / runs[0].threads) / (runs[t].metrics[0].value / runs[t].threads));
+        }
+    }
+
+    /* A time says nothing per thread, and the ratio is turned around so above 1 is still faster */
+    else
+    {
+        printf("\nCore type        Threads  Seconds      Time (%s)\n", runs[0].metrics[0].name);
+        for (t = 0; t < topology.ntypes; t++)
+        {
+            printf("%-16s %7d  %-11lf  %.1lf\n", runs[t].tag, runs[t].threads, runs[t].seconds, runs[t].metrics[0].value);
+        }
+        for (t = 1; t < topology.ntypes; t++)
+        {
+            printf("Ratio %s/%s: %.3lf\n", runs[0].tag, runs[t].tag, runs[t].metrics[0].value / runs[0].metrics[0].value);
+        }
+    }
+    printf("\n");
+
+    *result = runs[0];
+    for (t = 1; t < topology.ntypes; t++)
+    {
+        cpubench_result_clear(&runs[t]);
+    }
+    cpubench_topology_clear(&topology);
+    return CPUBENCH_OK;
+}
+
+/* Run the workload with one thread per physical core, then on every hardware thread, and report
+ * what SMT adds. Leaves the result of the run with all hardware threads in result */
+static cpubench_status run_smt_comparison(cpubench_ctx *ctx, const cpubench_params *params, cpubench_result *result)
+{
+    cpubench_topology topology;
+    cpubench_params cores, all;
+    cpubench_result off;
+    cpubench_status status;
+    int c;
+
+    if (single_threaded(params->workload))
+    {
+        printf("%sWARN: %s is single-threaded, SMT makes no difference to it%s\n", TXTYELLOW, cpubench_workload_name(params->workload), TXTNORMAL);
+    }
+    if ((status = cpubench_topology_read(&topology)) != CPUBENCH_OK)
+    {
+        return status;
+    }
+    if (topology.threads_per_core < 2)
+    {
+        printf("%sWARN: SMT is off or not supported, both runs use the same CPUs%s\n", TXTYELLOW, TXTNORMAL);
+    }
+
+    cores = *params;
+    cores.threads = 0;
+    cores.cpus = topology.physical;
+    snprintf(cores.tag, sizeof(cores.tag), "smt-off");
+    all = *params;
+    all.threads = 0;
+    memset(&all.cpus, 0, sizeof(all.cpus));
+    for (c = 0; c < topology.ncpus; c++)
+    {
+        cpubench_cpumask_set(&all.cpus, topology.cpus[c].cpu);
+    }
+    snprintf(all.tag, sizeof(all.tag), "smt-on");
+
+    printf("Running on %d physical cores, one thread each...\n", topology.ncores);
+    if ((status = cpubench_run(ctx, &cores, &off)) != CPUBENCH_OK)
+    {
+        cpubench_topology_clear(&topology);
+        return status;
+    }
+    printf("Running on all %d hardware threads...\n", topology.ncpus);
+    if ((status = cpubench_run(ctx, &all, result)) != CPUBENCH_OK)
+    {
+        cpubench_result_clear(&off);
+        cpubench_topology_clear(&topology);
+        return status;
+    }
+
+    /* The uplift is in speed, so a time that drops counts as a gain */
+    int lower = off.metrics[0].lower_is_better;
+    double speedup = lower ? off.metrics[0].value / result->metrics[0].value : result->metrics[0].value / off.metrics[0].value;
+    printf("\nSMT         Threads  Seconds      %s (%s)\n", lower ? "Time" : "Throughput", off.metrics[0].name);
+    printf("%-11s %7d  %-11lf  %.1lf\n", off.tag, off.threads, off.seconds, off.metrics[0].value);
+    printf("%-11s %7d  %-11lf  %.1lf\n", result->tag, result->threads, result->seconds, result->metrics[0].value);
+    printf("SMT uplift: %+.1lf%%\n\n", (speedup - 1) * 100);
+
+    cpubench_result_clear(&off);
+    cpubench_topology_clear(&topology);
+    return CPUBENCH_OK;
+}
+
+/* Run one instance per NUMA node at the same time and report each and their sum.
+ * Leaves the result of the first node in result */
+static cpubench_status run_per_node(cpubench_ctx *ctx, const cpubench_params *params, cpubench_result *result)
+{
+    cpubench_result runs[CPUBENCH_MAX_NODES];
+    cpubench_status status;
+    double total = 0;
+    int nruns, n;
+
+    printf("Running one instance per NUMA node, memory bound to the local node...\n");
+    if ((status = cpubench_run_per_node(ctx, params, runs, &nruns)) != CPUBENCH_OK)
+    {
+        for (n = 0; n < nruns; n++)
+        {
+            cpubench_result_clear(&runs[n]);
+        }
+        return status;
+    }
+
+    /* Throughputs add up over the nodes, times don't, so for those the slowest node is given */
+    int lower = runs[0].metrics[0].lower_is_better;
+    printf("\nInstance         Threads  Seconds      %s (%s)\n", lower ? "Time" : "Throughput", runs[0].metrics[0].name);
+    for (n = 0; n < nruns; n++)
+    {
+        printf("%-16s %7d  %-11lf  %.1lf\n", runs[n].tag, runs[n].threads, runs[n].seconds, runs[n].metrics[0].value);
+        if (lower)
+        {
+            total = (runs[n].metrics[0].value > total) ? runs[n].metrics[0].value : total;
+        }
+        else
+        {
+            total += runs[n].metrics[0].value;
+        }
+    }
+    printf("%s: %.1lf\n\n", lower ? "Slowest node" : "All nodes", total);
+
+    *result = runs[0];
+    for (n = 1; n < nruns; n++)
+    {
+        cpubench_result_clear(&runs[n]);
+    }
+    return CPUBENCH_OK;
+}
+
+/* Print every metric of a result, bandwidths in GB/s, flops in GFLOPS, frequencies in GHz and
+ * sizes in KiB or MiB */
+static void print_metrics(const cpubench_result *result)
+{
+    size_t m;
+
+    for (m = 0; m < result->nmetrics; m++)
+    {
+        const cpubench_metric *metric = &result->metrics[m];
+        if (strcmp(metric->unit, "B/s") == 0)
+        {
+            printf("%-20s %-24s %.2lf GB/s\n", metric->name, metric->label, metric->value / 1E9);
+        }
+        else if (strcmp(metric->unit, "FLOP/s") == 0)
+        {
+            printf("%-20s %-24s %.2lf GFLOPS\n", metric->name, metric->label, metric->value / 1E9);
+        }
+        else if (strcmp(metric->unit, "LUP/s") == 0)
+        {
+            printf("%-20s %-24s %.1lf MLUP/s\n", metric->name, metric->label, metric->value / 1E6);
+        }
+        else if (strcmp(metric->unit, "Hz") == 0)
+        {
+            printf("%-20s %-24s %.3lf GHz\n", metric->name, metric->label, metric->value / 1E9);
+        }
+        else if (strcmp(metric->unit, "B") == 0 && metric->value >= 1048576)
+        {
+            printf("%-20s %-24s %.1lf MiB\n", metric->name, metric->label, metric->value / 1048576);
+        }
+        else if (strcmp(metric->unit, "B") == 0)
+        {
+            printf("%-20s %-24s %.0lf KiB\n", metric->name, metric->label, metric->value / 1024);
+        }
+        else
+        {
+            printf("%-20s %-24s %.6g %s\n", metric->name, metric->label, metric->value, metric->unit);
+        }
+    }
+}
+
+/* Run the scoring suite of a reference table and print how this machine compares */
+static int run_score(const char *path)
+{
+    cpubench_reference reference;
+    cpubench_score score;
+    cpubench_ctx *ctx;
+    cpubench_status status;
+    int e;
+
+    if ((status = cpubench_reference_load(path, &reference)) != CPUBENCH_OK)
+    {
+        fprintf(stderr, "%sError: Unable to load reference table %s: %s%s\n", TXTRED, path, cpubench_strerror(status), TXTNORMAL);
+        return 1;
+    }
+    if ((status = cpubench_ctx_create(&ctx)) != CPUBENCH_OK)
+    {
+        fprintf(stderr, "%sError: %s%s\n", TXTRED, cpubench_strerror(status), TXTNORMAL);
+        return 1;
+    }
+
+    printf("Scoring against reference v%d (%s), %d workloads...\n", reference.version, reference.machine, reference.nentries);
+    fflush(stdout);
+    status = cpubench_score_run(ctx, &reference, &score);
+    cpubench_ctx_destroy(ctx);
+    if (status != CPUBENCH_OK)
+    {
+        fprintf(stderr, "%sError: %s%s\n", TXTRED, cpubench_strerror(status), TXTNORMAL);
+        return 1;
+    }
+
+    printf("\nClass   Workload                         Result           Reference        Ratio\n");
+    for (e = 0; e < score.nentries; e++)
+    {
+        printf("%-7s %-32s %-16.1lf %-16.1lf %.3lf%s\n", reference.entries[e].multithreaded ? "multi" : "single",
+               reference.entries[e].name, score.entries[e].value, reference.entries[e].value, score.entries[e].ratio,
+               score.entries[e].verified ? "" : "  (wrong checksum)");
+    }
+    printf("\nSingle-thread score: %.0lf\nMulti-thread score: %.0lf\n", score.single, score.multi);
+    if (!score.valid)
+    {
+        printf("%sWARN: Some workloads produced wrong results, the scores are not valid%s\n", TXTYELLOW, TXTNORMAL);
+    }
+    return score.valid ? 0 : 1;
+}
+
+/* Entry point of program */
+int main(int argc, char *argv[])
+{
+
+    /* Variable declaration and initialization */
+    unsigned long cpvalue = 10000;
+    unsigned int base = 10;
+    char *tmp_ptr;
+    int pd = 0;
+    int dd = 0;
+    int threading = 0;
+    int a;
+    const char *metrics_file = NULL;
+    int metrics_port = 0;
+    const char *profile_file = NULL;
+    int per_core_type = 0;
+    int per_node = 0;
+    int smt = 0;
+    unsigned int isolate = 0;
+    const char *numa = NULL;
+    const char *workload = NULL;
+    const char *overrides[16];
+    int noverrides = 0;
+    exporter *exp = NULL;
+    cpubench_ctx *ctx;
+    cpubench_params params;
+    cpubench_result result;
+    cpubench_status status;
+
+    /* Try setting process priority to highest */
+    int returnvalue = setpriority(PRIO_PROCESS, (id_t)0, -20);
+    if (returnvalue == -1)
+    {
+        printf("%sWARN: Unable to max out priority. Did you not run this app as root?%s\n", TXTYELLOW, TXTNORMAL);
+    }
+
+    /* Scoring runs a fixed suite and takes no other arguments */
+    if (argc >= 2 && argc <= 3 && strcmp(argv[1], "--score") == 0)
+    {
+        return run_score((argc == 3) ? argv[2] : REFERENCE_FILE);
+    }
+
+    /* Parse optional trailing options */
+    for (a = 4; a < argc; a++)
+    {
+        if (strcmp(argv[a], "--openmetrics") == 0 && a + 1 < argc)
+        {
+            metrics_file = argv[++a];
+        }
+        else if (strcmp(argv[a], "--metrics-port") == 0 && a + 1 < argc)
+        {
+            metrics_port = atoi(argv[++a]);
+        }
+        else if (strcmp(argv[a], "--numa") == 0 && a + 1 < argc)
+        {
+            numa = argv[++a];
+            per_node = (strcmp(numa, "per-node") == 0);
+        }
+        else if (strcmp(argv[a], "--isolate") == 0)
+        {
+            isolate |= CPUBENCH_ISOLATE_PREFAULT | CPUBENCH_ISOLATE_MLOCK;
+        }
+        else if (strcmp(argv[a], "--isolate-fifo") == 0)
+        {
+            isolate |= CPUBENCH_ISOLATE_PREFAULT | CPUBENCH_ISOLATE_MLOCK | CPUBENCH_ISOLATE_FIFO;
+        }
+        else if (strcmp(argv[a], "--workload") == 0 && a + 1 < argc)
+        {
+            workload = argv[++a];
+        }
+        else if (strcmp(argv[a], "--param") == 0 && a + 1 < argc && noverrides < 16)
+        {
+            overrides[noverrides++] = argv[++a];
+        }
+        else if (strcmp(argv[a], "--smt") == 0)
+        {
+            smt = 1;
+        }
+        else if (strcmp(argv[a], "--per-core-type") == 0)
+        {
+            per_core_type = 1;
+        }
+        else if (strcmp(argv[a], "--profile") == 0 && a + 1 < argc)
+        {
+            profile_file = argv[++a];
+        }
+        else
+        {
+            argc = 0;
+        }
+    }
+
+    /* Parse command line */
+    if (argc >= 4 && ((strcmp(argv[3], "--printdigits") == 0) || (strcmp(argv[3], "--nodigits") == 0) || (strcmp(argv[3], "--dumpdigits") == 0)))
+    {
+        cpvalue = strtol(argv[1], &tmp_ptr, base);
+        threading = (strcmp(argv[2], "--singlethreaded") == 0) ? 1 : 0;
+        threading = (strcmp(argv[2], "--multithreaded") == 0) ? 0 : 1;
+        pd = (strcmp(argv[3], "--printdigits") == 0) ? 1 : 0;
+        dd = (strcmp(argv[3], "--dumpdigits") == 0) ? 1 : 0;
+    }
+
+    /* Invalid command line parameters */
+    else
+    {
+        fprintf(stderr, "%sError: Invalid command-line arguments!%s\nUsage: cpubench [value] [threading] [parameter]\nValue: Any number from 1 to 2^32-1\n(in case of single threaded bench, it will be used to compute primes from 1 to n (where n = value between 1 and 2^32-1) or n digits of PI (where n = value between 1 and 2^32-1)\nParameter:\n--printdigits : Prints all digits of PI on console\n--nodigits : Suppresses printing of digits of PI on console (Use this when doing multithreaded bench)\n--dumpdigits : Saves all the digits of PI to a text file\nThreading:\n--singlethreaded : Stresses only one core (PI)\n--multithreaded : Stresses all the cores (PRIMES)\nOptions:\n--openmetrics <file> : Keeps progress and results in OpenMetrics format in <file>\n--metrics-port <port> : Serves progress and results in OpenMetrics format on 127.0.0.1:<port> until Ctrl-C\n--profile <file> : Samples call stacks during the run and writes them to <file> as folded stacks for flame graphs\n--per-core-type : Runs once pinned to each core type of a hybrid CPU and compares them\n--numa <local|interleave|per-node> : Allocates on each thread's own node, interleaves over all nodes, or runs one instance per node\n--workload <name> : Runs another workload: stream, latency, loaded_latency, gemm, hpl, hpcg, fft, stencil, spmv, hash, aead, pkey, gmp or bigmul. [value] is its main size (MiB per array for stream, largest working set for latency, chased working set for loaded_latency, matrix order for gemm and hpl, grid edge for hpcg and stencil, points per dimension for fft, rows for spmv, largest message in bytes for hash, largest record in bytes for aead, milliseconds per operation for pkey, largest operand in bits for gmp and bigmul), --singlethreaded uses one thread\n--param <key=value> : Sets a workload parameter, e.g. ntimes=20 or sweep=1 for stream, min=16 (KiB) or hugepages=0 for latency, load=128 (MiB per thread) or write=50 (percent) for loaded_latency, single=1 or generic=1 for gemm, nb=192 (panel width) for hpl, iterations=100 for hpcg, dims=2 for fft, points=27 or tile=8 for stencil, pattern=random or chunk=16 for spmv, algorithm=sha256 or min=4096 for hash, cipher=aes-256-gcm for aead, algorithm=rsa2048 for pkey, op=gcd or min=4096 for gmp, steps=4 for bigmul\n--smt : Runs once with one thread per physical core and once on all hardware threads and reports the SMT uplift\n--isolate : Pre-faults and locks all memory so page faults stay out of the measurement\n--isolate-fifo : Like --isolate, and runs the benchmark threads SCHED_FIFO\n\nScoring: cpubench --score [reference]\nRuns the suite of the reference table (default %s) and prints single-thread and multi-thread scores, the reference machine scores 1000\n\nUsage example: cpubench 50000 --singlethreaded --printdigits\n", TXTRED, TXTNORMAL, REFERENCE_FILE);
+        exit(1);
+    }
+
+    /* Print introductory text */
+    struct utsname uname_ptr;
+    uname(&uname_ptr);
+    printf("%s\n---------------------------------------------------------------", TXTGREEN);
+    printf("\nCPU Bench v%s (%s)\nBuild date: %s %s\n", CPUBENCH_VERSION_STRING, uname_ptr.machine, build_date, build_time);
+    cpubench_timer_info timer;
+    cpubench_timer_get_info(&timer);
+    if (timer.tsc_hz > 0)
+    {
+        printf("Timer: %s (invariant TSC at %.3lf GHz), resolution %.1lf ns, overhead %.1lf ns\n", timer.source, timer.tsc_hz / 1E9, timer.resolution_ns, timer.overhead_ns);
+    }
+    else
+    {
+        printf("Timer: %s, resolution %.1lf ns, overhead %.1lf ns\n", timer.source, timer.resolution_ns, timer.overhead_ns);
+    }
+    printf("---------------------------------------------------------------%s\n\n", TXTNORMAL);
+
+    /* Check if digits isnt zero or below */
+    if (cpvalue < 1)
+    {
+        fprintf(stderr, "%sError: Digit cannot be lower than 1%s\n", TXTRED, TXTNORMAL);
+        exit(1);
+    }
+
+    /* Set up the library */
+    if ((status = cpubench_ctx_create(&ctx)) != CPUBENCH_OK)
+    {
+        fprintf(stderr, "%sError: %s%s\n", TXTRED, cpubench_strerror(status), TXTNORMAL);
+        exit(1);
+    }
+
+    /* Tell the user when a container limits the CPUs we get */
+    cpubench_cpu_limits limits;
+    if (cpubench_read_cpu_limits(&limits) == CPUBENCH_OK && (limits.cpuset_cpus < limits.online_cpus || limits.quota_cpus > 0))
+    {
+        printf("CPU limits: %d of %d CPUs in cpuset", limits.cpuset_cpus, limits.online_cpus);
+        if (limits.quota_cpus > 0)
+        {
+            printf(", cgroup v%d quota %.2f CPUs", limits.cgroup_version, limits.quota_cpus);
+        }
+        printf(", using %d threads\n\n", limits.effective_cpus);
+    }
+
+    /* Keep page faults and other tasks out of the measured region, as far as we are allowed to */
+    if (isolate != 0)
+    {
+        static const char *const names[] = { "prefault", "mlock", "SCHED_FIFO" };
+        unsigned int achieved = 0;
+        int m;
+
+        cpubench_ctx_warm(ctx, 0, 0);
+        cpubench_ctx_isolate(ctx, isolate, &achieved);
+        printf("Isolation:");
+        for (m = 0; m < 3; m++)
+        {
+            if (isolate & (1u << m))
+            {
+                printf(" %s %s%s%s", names[m], (achieved & (1u << m)) ? TXTGREEN : TXTYELLOW, (achieved & (1u << m)) ? "ok" : "failed", TXTNORMAL);
+            }
+        }
+        printf("\n\n");
+    }
+
+    /* Export live progress and results if asked to */
+    if (metrics_file != NULL || metrics_port > 0)
+    {
+        if ((exp = exporter_start(metrics_file, metrics_port)) == NULL)
+        {
+            fprintf(stderr, "%sError: Unable to start the OpenMetrics exporter%s\n", TXTRED, TXTNORMAL);
+            cpubench_ctx_destroy(ctx);
+            exit(1);
+        }
+        cpubench_set_progress_callback(ctx, exporter_progress, exp, METRICS_INTERVAL);
+        cpubench_set_result_callback(ctx, exporter_result, exp);
+    }
+
+    /* Any other workload takes the value as its main size parameter */
+    if (workload != NULL)
+    {
+        cpubench_workload w;
+        if (cpubench_workload_from_name(workload, &w) != CPUBENCH_OK)
+        {
+            fprintf(stderr, "%sError: Unknown workload %s%s\n", TXTRED, workload, TXTNORMAL);
+            exporter_stop(exp);
+            cpubench_ctx_destroy(ctx);
+            exit(1);
+        }
+        cpubench_params_init(&params, w);
+        params.threads = (threading == 1) ? 1 : 0;
+        if (cpubench_params_set(&params, "value", argv[1]) != CPUBENCH_OK)
+        {
+            fprintf(stderr, "%sError: Invalid value %s for %s%s\n", TXTRED, argv[1], workload, TXTNORMAL);
+            exporter_stop(exp);
+            cpubench_ctx_destroy(ctx);
+            exit(1);
+        }
+        printf("Performing %s benchmarking [%s]\n\n", (threading == 1) ? "single-threaded" : "multi-threaded", workload);
+    }
+
+    /* Perform single threaded benchmark */
+    else if (threading == 1)
+    {
+
+        /* Calculate digits of pi */
+        printf("Performing single-threaded benchmarking [PI]\nComputing %lu digits of PI...\n", cpvalue);
+        cpubench_params_init(&params, CPUBENCH_WORKLOAD_PI);
+        params.u.pi.digits = cpvalue;
+        printf("Total iterations: %lu\n\n", cpvalue / 15);
+    }
+
+    /* Perform multi-threaded benchmark */
+    else
+    {
+        printf("Performing multi-threaded benchmarking [Primes]\nComputing primes under %lu...\n", cpvalue);
+        cpubench_params_init(&params, CPUBENCH_WORKLOAD_PRIMES);
+        params.u.prime.max = cpvalue;
+    }
+
+    /* Parameters given as key=value */
+    for (a = 0; a < noverrides; a++)
+    {
+        char key[32];
+        const char *eq = strchr(overrides[a], '=');
+        if (eq == NULL || eq - overrides[a] >= (int)sizeof(key))
+        {
+            status = CPUBENCH_ERR_INVALID_ARG;
+        }
+        else
+        {
+            snprintf(key, sizeof(key), "%.*s", (int)(eq - overrides[a]), overrides[a]);
+            status = cpubench_params_set(&params, key, eq + 1);
+        }
+        if (status != CPUBENCH_OK)
+        {
+            fprintf(stderr, "%sError: Invalid parameter %s%s\n", TXTRED, overrides[a], TXTNORMAL);
+            exporter_stop(exp);
+            cpubench_ctx_destroy(ctx);
+            exit(1);
+        }
+    }
+
+    /* NUMA placement */
+    if (numa != NULL && !per_node && cpubench_params_set(&params, "mem", numa) != CPUBENCH_OK)
+    {
+        fprintf(stderr, "%sError: Unknown NUMA mode %s%s\n", TXTRED, numa, TXTNORMAL);
+        exporter_stop(exp);
+        cpubench_ctx_destroy(ctx);
+        exit(1);
+    }
+
+    if (exp != NULL)
+    {
+        exporter_begin(exp, params.workload);
+    }
+    if (profile_file != NULL && profiler_start(PROFILE_HZ) != 0)
+    {
+        printf("%sWARN: Unable to start the profiler, running without it%s\n", TXTYELLOW, TXTNORMAL);
+        profile_file = NULL;
+    }
+    if (per_node)
+    {
+        status = run_per_node(ctx, &params, &result);
+    }
+    else if (smt)
+    {
+        status = run_smt_comparison(ctx, &params, &result);
+    }
+    else if (per_core_type)
+    {
+        status = run_per_core_type(ctx, &params, &result);
+    }
+    else
+    {
+        status = cpubench_run(ctx, &params, &result);
+    }
+    if (profile_file != NULL)
+    {
+        profiler_stop();
+    }
+    if (status != CPUBENCH_OK)
+    {
+        fprintf(stderr, "%sError: %s%s\n", TXTRED, cpubench_strerror(status), TXTNORMAL);
+        exporter_stop(exp);
+        cpubench_ctx_destroy(ctx);
+        exit(1);
+    }
+    if (result.tag[0] != '\0')
+    {
+        printf("Done!\n\nTime taken (seconds) [%s]: %lf\n", result.tag, result.seconds);
+    }
+    else
+    {
+        printf("Done!\n\nTime taken (seconds): %lf\n", result.seconds);
+    }
+
+    if (result.workload == CPUBENCH_WORKLOAD_PI)
+    {
+        char *digits_of_pi = result.digits;
+
+        /* Print the digits if user specified the --printdigits flag */
+        if (pd == 1)
+        {
+            printf("Here are the digits:\n\n%.1s.%s\n", digits_of_pi, digits_of_pi + 1);
+        }
+
+        /* Save digits to text file if user specified the --dumpdigits flag */
+        if (dd == 1)
+        {
+            FILE *file;
+            if ((file = fopen("pidigits.txt", "w")) == NULL)
+            {
+                fprintf(stderr, "%sError while opening file%s\n", TXTRED, TXTNORMAL);
+                exit(-1);
+            }
+            else
+            {
+                fprintf(file, "%.1s.%s\n", digits_of_pi, digits_of_pi + 1);
+                fclose(file);
+            }
+        }
+    }
+    else if (result.workload == CPUBENCH_WORKLOAD_PRIMES)
+    {
+        printf("Total primes found are %llu\n", result.count);
+    }
+    else
+    {
+        print_metrics(&result);
+    }
+
+    /* Print MD5 checksum */
+    printf("MD5 checksum (for verification): %s\n", result.checksum);
+
+    /* Results taken while the cgroup throttled us don't reflect the CPU */
+    if (result.throttled_periods > 0)
+    {
+        printf("%sWARN: Throttled by the cgroup CPU quota in %llu periods (%.3lf seconds), results are not representative%s\n", TXTYELLOW, result.throttled_periods, result.throttled_seconds, TXTNORMAL);
+    }
+
+    /* Save the profile if user specified the --profile flag */
+    if (profile_file != NULL)
+    {
+        if (profiler_write(profile_file) != 0)
+        {
+            fprintf(stderr, "%sError while writing profile%s\n", TXTRED, TXTNORMAL);
+        }
+        else
+        {
+            printf("Profile: %lu samples (%lu dropped) written to %s\n", profiler_samples(), profiler_dropped(), profile_file);
+        }
+    }
+
+    /* Keep the final results scrapeable until the user is done with them */
+    if (metrics_port > 0)
+    {
+        printf("Serving metrics on http://127.0.0.1:%d/metrics, press Ctrl-C to quit\n", metrics_port);
+        fflush(stdout);
+        signal(SIGINT, handle_stop);
+        signal(SIGTERM, handle_stop);
+        while (!stop_requested)
+        {
+            pause();
+        }
+    }
+
+    /* Free the memory */
+    cpubench_result_clear(&result);
+    exporter_stop(exp);
+    cpubench_ctx_destroy(ctx);
+
+    /* Time to go! */
+    printf("Goodbye!\n");
+    return 0;
+}
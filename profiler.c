@@ -0,0 +1,365 @@
+/*
+*
+* profiler.c - Sampling profiler of cpubench
+* Author: Suyash Srijan
+* Email: suyashsrijan@outlook.com
+*
+* ITIMER_PROF raises SIGPROF for every interval of CPU time the process consumes, on whichever
+* thread was running, so all OpenMP workers are sampled in proportion to the time they burn.
+* The handler unwinds with backtrace() and counts the stack in a fixed open-addressing table
+* using only atomics, so nothing in the handler allocates or locks. Symbols are resolved after
+* sampling stops, with dladdr() for shared libraries and the executable's own symbol table for
+* static functions such as the OpenMP outlined loop bodies. Stacks that only differ in the
+* instruction within a function are merged. GMP's assembly kernels carry no unwind tables, so
+* samples taken inside them usually end at the kernel itself.
+*
+*/
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <elf.h>
+#include <execinfo.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "profiler.h"
+
+/* Deepest stack we record */
+#define MAX_FRAMES 48
+
+/* Distinct stacks we can hold, must be a power of two */
+#define TABLE_SIZE 16384
+
+/* Frames belonging to the signal handler and the kernel's signal trampoline */
+#define SKIP_FRAMES 2
+
+/* One distinct stack and how often it was seen */
+struct stack_entry
+{
+    uint64_t hash;
+    unsigned long count;
+    int depth;
+    void *frames[MAX_FRAMES];
+};
+
+/* A function from the executable's symbol table */
+struct exe_symbol
+{
+    unsigned long start;
+    unsigned long size;
+    const char *name;
+};
+
+static struct stack_entry *table = NULL;
+static unsigned long samples = 0;
+static unsigned long dropped = 0;
+static struct sigaction old_action;
+
+/* FNV-1a over the frame addresses */
+static uint64_t hash_stack(void *const *frames, int depth)
+{
+    uint64_t h = 1469598103934665603ULL;
+    int f;
+
+    for (f = 0; f < depth; f++)
+    {
+        h = (h ^ (uint64_t)(uintptr_t)frames[f]) * 1099511628211ULL;
+    }
+    return (h == 0) ? 1 : h;
+}
+
+/* SIGPROF handler, records the interrupted stack */
+static void on_sample(int sig, siginfo_t *info, void *uctx)
+{
+    void *frames[MAX_FRAMES + SKIP_FRAMES];
+    uint64_t h, expected;
+    unsigned long slot, probe;
+    (void)sig;
+    (void)info;
+    (void)uctx;
+
+    int depth = backtrace(frames, MAX_FRAMES + SKIP_FRAMES) - SKIP_FRAMES;
+    if (depth <= 0)
+    {
+        return;
+    }
+    __atomic_add_fetch(&samples, 1, __ATOMIC_RELAXED);
+
+    /* The thread that claims a slot fills it in, everyone else only bumps the count */
+    h = hash_stack(frames + SKIP_FRAMES, depth);
+    slot = h & (TABLE_SIZE - 1);
+    for (probe = 0; probe < TABLE_SIZE; probe++, slot = (slot + 1) & (TABLE_SIZE - 1))
+    {
+        struct stack_entry *e = &table[slot];
+        expected = 0;
+        if (__atomic_load_n(&e->hash, __ATOMIC_ACQUIRE) == h)
+        {
+            __atomic_add_fetch(&e->count, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        if (__atomic_compare_exchange_n(&e->hash, &expected, h, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            memcpy(e->frames, frames + SKIP_FRAMES, (size_t)depth * sizeof(void *));
+            e->depth = depth;
+            __atomic_add_fetch(&e->count, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        if (expected == h)
+        {
+            __atomic_add_fetch(&e->count, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+    __atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+}
+
+/* Start sampling */
+int profiler_start(int hz)
+{
+    struct sigaction sa;
+    struct itimerval timer;
+    void *warm[4];
+
+    if (hz <= 0 || hz > 1000000)
+    {
+        return -1;
+    }
+    if (table == NULL && (table = calloc(TABLE_SIZE, sizeof(*table))) == NULL)
+    {
+        return -1;
+    }
+
+    /* The first backtrace() call loads libgcc_s, which must not happen inside the handler */
+    backtrace(warm, 4);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = on_sample;
+    sa.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGPROF, &sa, &old_action) != 0)
+    {
+        return -1;
+    }
+
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = 1000000 / hz;
+    timer.it_value = timer.it_interval;
+    if (setitimer(ITIMER_PROF, &timer, NULL) != 0)
+    {
+        sigaction(SIGPROF, &old_action, NULL);
+        return -1;
+    }
+    return 0;
+}
+
+/* Stop sampling */
+void profiler_stop(void)
+{
+    struct itimerval timer;
+
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, NULL);
+    sigaction(SIGPROF, &old_action, NULL);
+}
+
+/* Load the function symbols of the running executable, at their run-time addresses.
+ * Returns the count, the names point into *image */
+static size_t load_exe_symbols(char **image, struct exe_symbol **out, void **exe_base)
+{
+    FILE *exe = fopen("/proc/self/exe", "rb");
+    size_t size, count = 0;
+    Dl_info dl;
+    int sec;
+
+    /* Anything linked into the executable tells us where it was loaded */
+    *exe_base = (dladdr((void *)profiler_start, &dl) != 0) ? dl.dli_fbase : NULL;
+
+    *image = NULL;
+    *out = NULL;
+    if (exe == NULL)
+    {
+        return 0;
+    }
+    fseek(exe, 0, SEEK_END);
+    size = (size_t)ftell(exe);
+    rewind(exe);
+    if ((*image = malloc(size)) == NULL || fread(*image, 1, size, exe) != size)
+    {
+        fclose(exe);
+        return 0;
+    }
+    fclose(exe);
+
+    const Elf64_Ehdr *eh = (const Elf64_Ehdr *)*image;
+    if (size < sizeof(*eh) || memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0 || eh->e_ident[EI_CLASS] != ELFCLASS64
+        || eh->e_shoff + (size_t)eh->e_shnum * sizeof(Elf64_Shdr) > size)
+    {
+        return 0;
+    }
+    /* Position independent executables store symbols relative to the load base */
+    unsigned long bias = (eh->e_type == ET_DYN) ? (unsigned long)(uintptr_t)*exe_base : 0;
+    const Elf64_Shdr *sh = (const Elf64_Shdr *)(*image + eh->e_shoff);
+    for (sec = 0; sec < eh->e_shnum; sec++)
+    {
+        if (sh[sec].sh_type != SHT_SYMTAB || sh[sec].sh_link >= eh->e_shnum
+            || sh[sec].sh_offset + sh[sec].sh_size > size || sh[sh[sec].sh_link].sh_offset + sh[sh[sec].sh_link].sh_size > size)
+        {
+            continue;
+        }
+        const Elf64_Sym *syms = (const Elf64_Sym *)(*image + sh[sec].sh_offset);
+        const char *strtab = *image + sh[sh[sec].sh_link].sh_offset;
+        size_t nsyms = sh[sec].sh_size / sizeof(Elf64_Sym);
+        size_t k;
+
+        if ((*out = calloc(nsyms, sizeof(**out))) == NULL)
+        {
+            return 0;
+        }
+        for (k = 0; k < nsyms; k++)
+        {
+            if (ELF64_ST_TYPE(syms[k].st_info) == STT_FUNC && syms[k].st_value != 0 && syms[k].st_name < sh[sh[sec].sh_link].sh_size)
+            {
+                (*out)[count].start = syms[k].st_value + bias;
+                (*out)[count].size = syms[k].st_size;
+                (*out)[count].name = strtab + syms[k].st_name;
+                count++;
+            }
+        }
+        break;
+    }
+    return count;
+}
+
+/* Write one frame as a symbol name, or module+offset when there is no symbol */
+static void write_frame(FILE *out, void *addr, int interrupted, const struct exe_symbol *syms, size_t nsyms, void *exe_base)
+{
+    Dl_info dl;
+    size_t k;
+    /* Return addresses point past the call, step back into it */
+    void *pc = interrupted ? addr : (void *)((char *)addr - 1);
+
+    if (dladdr(pc, &dl) == 0 || dl.dli_fname == NULL)
+    {
+        fprintf(out, "[%p]", pc);
+        return;
+    }
+    if (dl.dli_sname != NULL)
+    {
+        fputs(dl.dli_sname, out);
+        return;
+    }
+
+    /* Static functions of the executable */
+    for (k = 0; dl.dli_fbase == exe_base && k < nsyms; k++)
+    {
+        if ((uintptr_t)pc >= syms[k].start && (uintptr_t)pc < syms[k].start + syms[k].size)
+        {
+            fputs(syms[k].name, out);
+            return;
+        }
+    }
+
+    const char *base = strrchr(dl.dli_fname, '/');
+    fprintf(out, "[%s+0x%lx]", base ? base + 1 : dl.dli_fname, (unsigned long)((char *)pc - (char *)dl.dli_fbase));
+}
+
+/* Sort folded lines so identical stacks are adjacent */
+static int compare_lines(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* Write folded stacks, outermost frame first */
+int profiler_write(const char *path)
+{
+    unsigned long slot;
+    size_t nlines = 0, l, nsyms;
+    char **lines;
+    char *image;
+    struct exe_symbol *syms;
+    void *exe_base;
+    int f;
+    FILE *out;
+
+    if (table == NULL || (lines = calloc(TABLE_SIZE, sizeof(*lines))) == NULL)
+    {
+        return -1;
+    }
+    nsyms = load_exe_symbols(&image, &syms, &exe_base);
+
+    /* Render every stack as "frame;frame;frame\tcount" */
+    for (slot = 0; slot < TABLE_SIZE; slot++)
+    {
+        const struct stack_entry *e = &table[slot];
+        char *line = NULL;
+        size_t len = 0;
+        FILE *mem;
+
+        if (e->hash == 0 || e->depth == 0 || (mem = open_memstream(&line, &len)) == NULL)
+        {
+            continue;
+        }
+        for (f = e->depth - 1; f >= 0; f--)
+        {
+            write_frame(mem, e->frames[f], f == 0, syms, nsyms, exe_base);
+            if (f > 0)
+            {
+                fputc(';', mem);
+            }
+        }
+        fprintf(mem, "\t%lu", e->count);
+        if (fclose(mem) == 0)
+        {
+            lines[nlines++] = line;
+        }
+        else
+        {
+            free(line);
+        }
+    }
+    free(syms);
+    free(image);
+    qsort(lines, nlines, sizeof(*lines), compare_lines);
+
+    /* Merge stacks that resolved to the same names */
+    if ((out = fopen(path, "w")) != NULL)
+    {
+        for (l = 0; l < nlines; )
+        {
+            char *tab = strrchr(lines[l], '\t');
+            size_t stack_len = (size_t)(tab - lines[l]);
+            unsigned long count = 0;
+            size_t m = l;
+
+            while (m < nlines && strncmp(lines[m], lines[l], stack_len) == 0 && lines[m][stack_len] == '\t')
+            {
+                count += strtoul(lines[m] + stack_len + 1, NULL, 10);
+                m++;
+            }
+            fprintf(out, "%.*s %lu\n", (int)stack_len, lines[l], count);
+            l = m;
+        }
+    }
+    for (l = 0; l < nlines; l++)
+    {
+        free(lines[l]);
+    }
+    free(lines);
+    return (out != NULL && fclose(out) == 0) ? 0 : -1;
+}
+
+/* Samples taken */
+unsigned long profiler_samples(void)
+{
+    return samples;
+}
+
+/* Samples lost to a full table */
+unsigned long profiler_dropped(void)
+{
+    return dropped;
+}
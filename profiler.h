@@ -0,0 +1,28 @@
+/*
+*
+* profiler.h - Sampling profiler of cpubench
+* Author: Suyash Srijan
+* Email: suyashsrijan@outlook.com
+*
+* Samples the call stacks of every thread of the process while a workload runs and writes them
+* as folded stacks, the input format of flamegraph.pl and most other flame graph tools.
+*
+*/
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+/* Start sampling at roughly hz samples per second of CPU time. Returns 0 on success */
+int profiler_start(int hz);
+
+/* Stop sampling */
+void profiler_stop(void);
+
+/* Write the folded stacks collected so far to path. Returns 0 on success */
+int profiler_write(const char *path);
+
+/* Samples taken and samples that didn't fit into the table */
+unsigned long profiler_samples(void);
+unsigned long profiler_dropped(void);
+
+#endif /* PROFILER_H */